@@ -1,19 +1,32 @@
-
 find_program(GlslangValidator NAMES glslangValidator DOC "glsl to SPIR-V compiler")
 if(NOT GlslangValidator)
    message(FATAL_ERROR "failed to find glslangValidator")
 endif()
+set(CompileShaderDir ${CMAKE_CURRENT_LIST_DIR})
 
+# compile_shader(<name> SOURCE <shader.comp> TARGET <shader.spv> [EMBED])
+# With EMBED the SPIR-V words are also written to <shader.spv>.inc, which is included
+# into a constexpr uint32_t array to have the shader compiled into the binary.
 function(compile_shader)
+   set(Options EMBED)
    set(OneValueArgs SOURCE TARGET)
-   cmake_parse_arguments(COMPILE_SHADER "" "${OneValueArgs}" "" ${ARGN})
+   cmake_parse_arguments(COMPILE_SHADER "${Options}" "${OneValueArgs}" "" ${ARGN})
 
    get_filename_component(TargetDir ${COMPILE_SHADER_TARGET} DIRECTORY)
+   set(Outputs ${COMPILE_SHADER_TARGET})
+   set(EmbedCommand)
+   if(COMPILE_SHADER_EMBED)
+      list(APPEND Outputs ${COMPILE_SHADER_TARGET}.inc)
+      set(EmbedCommand COMMAND ${CMAKE_COMMAND} ARGS -DSPIRV=${COMPILE_SHADER_TARGET}
+                                                    -DOUTPUT=${COMPILE_SHADER_TARGET}.inc
+                                                    -P ${CompileShaderDir}/EmbedSpirv.cmake)
+   endif()
    add_custom_command(
       COMMAND ${CMAKE_COMMAND} ARGS -E make_directory ${TargetDir}
       COMMAND ${GlslangValidator} ARGS -V ${COMPILE_SHADER_SOURCE} -o ${COMPILE_SHADER_TARGET}
-      DEPENDS ${COMPILE_SHADER_SOURCE}
-      OUTPUT ${COMPILE_SHADER_TARGET}
+      ${EmbedCommand}
+      DEPENDS ${COMPILE_SHADER_SOURCE} ${CompileShaderDir}/EmbedSpirv.cmake
+      OUTPUT ${Outputs}
    )
-   add_custom_target(${ARGV0} DEPENDS ${COMPILE_SHADER_TARGET})
+   add_custom_target(${ARGV0} DEPENDS ${Outputs})
 endfunction()
@@ -0,0 +1,20 @@
+# Write SPIR-V binary as a list of 32-bit words, to be included into a uint32_t array initializer.
+# Usage: cmake -DSPIRV=<shader.spv> -DOUTPUT=<shader.spv.inc> -P EmbedSpirv.cmake
+
+file(READ ${SPIRV} Hex HEX)
+string(LENGTH "${Hex}" Length)
+math(EXPR Tail "${Length} % 8")
+if(NOT Tail EQUAL 0)
+   message(FATAL_ERROR "${SPIRV} size is not a multiple of 4 bytes")
+endif()
+
+set(Words "// generated from ${SPIRV}, do not edit\n")
+set(Offset 0)
+while(Offset LESS Length)
+   string(SUBSTRING "${Hex}" ${Offset} 64 Line) # 8 words per line
+   string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1, " Line "${Line}") # SPIR-V binaries are little-endian
+   string(STRIP "${Line}" Line)
+   string(APPEND Words "${Line}\n")
+   math(EXPR Offset "${Offset} + 64")
+endwhile()
+file(WRITE ${OUTPUT} "${Words}")
@@ -0,0 +1,247 @@
+#include "allocator.h"
+
+#include <algorithm>
+#include <system_error>
+
+namespace vuh {
+
+constexpr vk::DeviceSize Allocator::MinClassSize;
+constexpr vk::DeviceSize Allocator::BlockSize;
+constexpr uint32_t Allocator::NumClasses;
+constexpr uint32_t Allocator::Dedicated;
+constexpr uint32_t Allocator::NumRangeClasses;
+constexpr uint32_t Allocator::NoBlock;
+
+namespace {
+	/// @return x rounded up to the closest multiple of alignment
+	auto align_up(vk::DeviceSize x, vk::DeviceSize alignment)-> vk::DeviceSize {
+		return (x + alignment - 1)/alignment*alignment;
+	}
+} // namespace
+
+/// Constructor. No memory is reserved untill the first allocation.
+Allocator::Allocator(const vk::Device& device, const vk::PhysicalDevice& physDev)
+   : _device(device)
+   , _memProperties(physDev.getMemoryProperties())
+   , _atomSize(std::max<vk::DeviceSize>(1, physDev.getProperties().limits.nonCoherentAtomSize))
+   , _pools(_memProperties.memoryTypeCount)
+{
+	static_assert((MinClassSize << (NumRangeClasses - 1)) == BlockSize
+	              , "largest range class should cover the whole block");
+}
+
+/// Destructor. Releases all memory blocks, allocations still alive become invalid.
+Allocator::~Allocator() noexcept {
+	for(auto& pool: _pools){
+		for(auto& b: pool.blocks){
+			if(b.memory){
+				_device.freeMemory(b.memory); // implicitly unmaps
+			}
+		}
+	}
+}
+
+/// Allocate memory satisfying the given requirements from the memory type with given index.
+/// Does not call into the driver unless the pool of corresponding memory type is exhausted.
+auto Allocator::alloc(const vk::MemoryRequirements& reqs, uint32_t memoryId)-> Allocation {
+	const auto cls = std::max(sizeClass(reqs.size), sizeClass(reqs.alignment)); // ranges are aligned to their size
+	if(cls == Dedicated){
+		return allocDedicated(reqs, memoryId);
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto& pool = _pools.at(memoryId);
+	auto k = cls; // smallest class of the free ranges fitting the request
+	while(k < NumRangeClasses && pool.freeLists[k].empty()){
+		++k;
+	}
+	auto range = Range{};
+	if(k == NumRangeClasses){
+		range = Range{newBlock(pool, cls, memoryId), 0};
+		k = pool.blocks[range.block].sizeClass;
+	} else {
+		range = *begin(pool.freeLists[k]);
+		pool.freeLists[k].erase(begin(pool.freeLists[k]));
+		if(range.block == pool.emptyBlock){
+			pool.emptyBlock = NoBlock;
+		}
+	}
+	while(k > cls){ // split the range, upper halves go to the free lists
+		--k;
+		pool.freeLists[k].insert(Range{range.block, range.offset + classSize(k)});
+	}
+
+	const auto& b = pool.blocks[range.block];
+	_bytesInUse += reqs.size;
+	_bytesLive += classSize(cls);
+	return Allocation{b.memory, range.offset, reqs.size
+	                  , b.mapped ? static_cast<char*>(b.mapped) + range.offset : nullptr
+	                  , memoryId, range.block, cls};
+}
+
+/// Return allocation to the pool. Dedicated allocations are released to the driver right away.
+/// Freed range is merged with its free buddies, an emptied block is released unless it is
+/// the only empty block of the memory type.
+auto Allocator::free(const Allocation& a)-> void {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_bytesInUse -= a.size;
+	if(a.sizeClass == Dedicated){
+		_device.freeMemory(a.memory);
+		_dedicatedBytes -= a.size;
+		--_dedicatedCount;
+		return;
+	}
+	_bytesLive -= classSize(a.sizeClass);
+	auto& pool = _pools.at(a.memoryId);
+	const auto blockClass = pool.blocks[a.block].sizeClass;
+	auto range = Range{a.block, a.offset};
+	auto k = a.sizeClass;
+	for(; k < blockClass; ++k){
+		auto buddy = pool.freeLists[k].find(Range{range.block, range.offset ^ classSize(k)});
+		if(buddy == end(pool.freeLists[k])){
+			break;
+		}
+		pool.freeLists[k].erase(buddy);
+		range.offset &= ~classSize(k);
+	}
+	if(k == blockClass && pool.emptyBlock != NoBlock){ // another empty block is already kept
+		auto& b = pool.blocks[a.block];
+		_device.freeMemory(b.memory); // implicitly unmaps
+		b = Block{};
+		return;
+	}
+	if(k == blockClass){
+		pool.emptyBlock = a.block;
+	}
+	pool.freeLists[k].insert(range);
+}
+
+/// @return memory usage statistics
+auto Allocator::stats() const-> Stats {
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto ret = Stats{_dedicatedCount, _dedicatedBytes, _bytesInUse, _dedicatedBytes + _bytesLive, 0};
+	for(const auto& pool: _pools){
+		for(const auto& b: pool.blocks){
+			if(b.memory){
+				++ret.blockCount;
+				ret.bytesReserved += b.size;
+			}
+		}
+		for(uint32_t cls = 0; cls < NumRangeClasses; ++cls){
+			ret.bytesCached += pool.freeLists[cls].size()*classSize(cls);
+		}
+		if(pool.emptyBlock != NoBlock){
+			ret.bytesCached -= pool.blocks[pool.emptyBlock].size;
+		}
+	}
+	ret.bytesCarved += ret.bytesCached;
+	return ret;
+}
+
+/// Make host writes to the range of the allocation visible to the device.
+/// Does nothing for host-coherent memory.
+/// @param offset offset of the range within the allocation
+/// @param size size of the range, VK_WHOLE_SIZE for the rest of the allocation
+auto Allocator::flush(const Allocation& a, vk::DeviceSize offset, vk::DeviceSize size) const-> void {
+	if(a.mapped && !isCoherent(a.memoryId)){
+		_device.flushMappedMemoryRanges({mappedRange(a, offset, size)});
+	}
+}
+
+/// Make device writes to the range of the allocation visible to the host.
+/// Does nothing for host-coherent memory.
+auto Allocator::invalidate(const Allocation& a, vk::DeviceSize offset, vk::DeviceSize size) const-> void {
+	if(a.mapped && !isCoherent(a.memoryId)){
+		_device.invalidateMappedMemoryRanges({mappedRange(a, offset, size)});
+	}
+}
+
+/// @return true if memory of the given type does not need explicit flushes and invalidations
+auto Allocator::isCoherent(uint32_t memoryId) const-> bool {
+	return bool(_memProperties.memoryTypes[memoryId].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+}
+
+/// @return range of the memory object covering the given range of the allocation,
+///         expanded to nonCoherentAtomSize boundaries.
+/// Size classes are aligned to at least MinClassSize, which is not less than any valid atom size,
+/// so the expanded range never leaves the size class range. Dedicated allocations are
+/// covered till the end of the memory object instead.
+auto Allocator::mappedRange(const Allocation& a, vk::DeviceSize offset, vk::DeviceSize size
+                            ) const-> vk::MappedMemoryRange
+{
+	const auto end = std::min(a.size, offset + std::min(size, a.size));
+	const auto first = (a.offset + offset)/_atomSize*_atomSize;
+	const auto last = align_up(a.offset + end, _atomSize);
+	const auto limit = a.sizeClass == Dedicated ? a.size : a.offset + classSize(a.sizeClass);
+	return vk::MappedMemoryRange(a.memory, first, last <= limit ? last - first : VK_WHOLE_SIZE);
+}
+
+/// Reserve new block for a range of at least the given size class.
+/// Block size is halved while the device is out of memory, down to the requested class.
+/// @return index of the block in the pool, its whole range is not in the free lists
+auto Allocator::newBlock(Pool& pool, uint32_t minClass, uint32_t memoryId)-> uint32_t {
+	auto blockClass = NumRangeClasses - 1;
+	auto block = Block{};
+	for(;;){
+		try {
+			block = allocBlock(classSize(blockClass), memoryId);
+			break;
+		} catch(const std::system_error& e) {
+			if(e.code() != vk::make_error_code(vk::Result::eErrorOutOfDeviceMemory) || blockClass == minClass){
+				throw;
+			}
+			--blockClass;
+		}
+	}
+	block.sizeClass = blockClass;
+	auto slot = std::find_if(begin(pool.blocks), end(pool.blocks), [](const Block& b){ return !b.memory; });
+	if(slot != end(pool.blocks)){
+		*slot = block;
+		return uint32_t(std::distance(begin(pool.blocks), slot));
+	}
+	pool.blocks.push_back(block);
+	return uint32_t(pool.blocks.size() - 1);
+}
+
+/// Reserve memory block of a given size. Host-visible blocks are mapped right away.
+auto Allocator::allocBlock(vk::DeviceSize size, uint32_t memoryId)-> Block {
+	auto mem = _device.allocateMemory({size, memoryId});
+	auto mapped = static_cast<void*>(nullptr);
+	if(_memProperties.memoryTypes[memoryId].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible){
+		try {
+			mapped = _device.mapMemory(mem, 0, VK_WHOLE_SIZE);
+		} catch(...) {
+			_device.freeMemory(mem);
+			throw;
+		}
+	}
+	return Block{mem, size, 0, mapped};
+}
+
+/// Allocate standalone memory object for requests too big to be pooled.
+auto Allocator::allocDedicated(const vk::MemoryRequirements& reqs, uint32_t memoryId)-> Allocation {
+	auto b = allocBlock(reqs.size, memoryId);
+	std::lock_guard<std::mutex> lock(_mutex);
+	_dedicatedBytes += reqs.size;
+	++_dedicatedCount;
+	_bytesInUse += reqs.size;
+	return Allocation{b.memory, 0, reqs.size, b.mapped, memoryId, 0, Dedicated};
+}
+
+/// @return size class for the given request size, Dedicated if the request is too big to be pooled.
+auto Allocator::sizeClass(vk::DeviceSize size)-> uint32_t {
+	auto cls = uint32_t(0);
+	for(auto s = MinClassSize; s < size; s *= 2){
+		if(++cls == NumClasses){
+			return Dedicated;
+		}
+	}
+	return cls;
+}
+
+/// @return size in bytes of the ranges of given size class
+auto Allocator::classSize(uint32_t sizeClass)-> vk::DeviceSize {
+	return MinClassSize << sizeClass;
+}
+
+} // namespace vuh
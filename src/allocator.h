@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace vuh {
+
+/// Range of device memory handed out by the Allocator.
+struct Allocation {
+	vk::DeviceMemory memory;   ///< memory object the range belongs to
+	vk::DeviceSize offset;     ///< offset of the range within the memory object
+	vk::DeviceSize size;       ///< requested size in bytes
+	void* mapped;              ///< host pointer to the first byte of the range, nullptr if memory is not host-visible
+	uint32_t memoryId;         ///< memory type index
+	uint32_t block;            ///< index of the block within the memory type pool
+	uint32_t sizeClass;        ///< size class index of the range, Allocator::Dedicated for standalone allocations
+};
+
+/// Block-based device memory sub-allocator.
+/// Device memory is reserved in large blocks per memory type. Requests are rounded up to
+/// power-of-two size classes and carved out of blocks by halving bigger free ranges (buddy system).
+/// Freed ranges are merged with their free buddies and kept in per-class free lists, reused by
+/// later requests without calling into the driver. A block that becomes empty is kept for reuse
+/// if it is the only empty block of its memory type, otherwise it is released to the driver.
+/// Blocks smaller than BlockSize are reserved when the device is out of memory for a full one.
+/// Requests larger than the biggest size class get a dedicated memory object.
+/// Memory of host-visible blocks is mapped once for the whole lifetime of the block.
+/// Host access to memory that is not host-coherent should be bracketed by flush() and invalidate().
+class Allocator {
+public:
+	static constexpr vk::DeviceSize MinClassSize = 256;            ///< smallest size class, bytes
+	static constexpr vk::DeviceSize BlockSize = 64u << 20;         ///< size of the pooled memory blocks, bytes
+	static constexpr uint32_t NumClasses = 17;                     ///< size classes from MinClassSize up to BlockSize/4
+	static constexpr uint32_t Dedicated = uint32_t(-1);            ///< size class of standalone allocations
+
+	/// Memory usage statistics.
+	struct Stats {
+		size_t blockCount;             ///< number of device memory objects held by the allocator
+		vk::DeviceSize bytesReserved;  ///< total size of the device memory objects held
+		vk::DeviceSize bytesInUse;     ///< bytes requested by live allocations
+		vk::DeviceSize bytesCarved;    ///< bytes of the ranges split off blocks (live or in free lists), empty blocks excluded
+		vk::DeviceSize bytesCached;    ///< bytes of freed ranges waiting in free lists for reuse, empty blocks excluded
+
+		/// Share of memory carved out of blocks that does not hold live data,
+		/// due to size class rounding or ranges idling in free lists. 0 when nothing is carved.
+		auto fragmentation() const-> double {
+			return bytesCarved == 0 ? 0.0 : 1.0 - double(bytesInUse)/double(bytesCarved);
+		}
+	};
+
+	Allocator(const vk::Device& device, const vk::PhysicalDevice& physDev);
+	~Allocator() noexcept;
+	Allocator(const Allocator&) = delete;
+	auto operator=(const Allocator&)-> Allocator& = delete;
+
+	auto alloc(const vk::MemoryRequirements& reqs, uint32_t memoryId)-> Allocation;
+	auto free(const Allocation& a)-> void;
+	auto stats() const-> Stats;
+	auto flush(const Allocation& a, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const-> void;
+	auto invalidate(const Allocation& a, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const-> void;
+	auto isCoherent(uint32_t memoryId) const-> bool;
+private: // helpers
+	static constexpr uint32_t NumRangeClasses = 19; ///< size classes of the free ranges, up to BlockSize
+	static constexpr uint32_t NoBlock = uint32_t(-1);
+
+	struct Block {
+		vk::DeviceMemory memory;   ///< memory object, null if released
+		vk::DeviceSize size;       ///< memory object size
+		uint32_t sizeClass;        ///< size class of the whole block
+		void* mapped;              ///< host pointer to the memory object if it is host-visible
+	};
+
+	struct Range {
+		uint32_t block;            ///< block index
+		vk::DeviceSize offset;     ///< offset within the block
+
+		auto operator<(const Range& r) const-> bool {
+			return block < r.block || (block == r.block && offset < r.offset);
+		}
+	};
+
+	/// All blocks and free ranges of a single memory type.
+	struct Pool {
+		std::vector<Block> blocks;                            ///< released blocks leave null slots for reuse
+		std::array<std::set<Range>, NumRangeClasses> freeLists;
+		uint32_t emptyBlock = NoBlock;                        ///< empty block kept for reuse
+	};
+
+	auto newBlock(Pool& pool, uint32_t minClass, uint32_t memoryId)-> uint32_t;
+	auto allocBlock(vk::DeviceSize size, uint32_t memoryId)-> Block;
+	auto allocDedicated(const vk::MemoryRequirements& reqs, uint32_t memoryId)-> Allocation;
+	auto mappedRange(const Allocation& a, vk::DeviceSize offset, vk::DeviceSize size) const-> vk::MappedMemoryRange;
+	static auto sizeClass(vk::DeviceSize size)-> uint32_t;
+	static auto classSize(uint32_t sizeClass)-> vk::DeviceSize;
+private: // data
+	vk::Device _device;
+	vk::PhysicalDeviceMemoryProperties _memProperties;
+	vk::DeviceSize _atomSize;                 ///< granularity of flushes and invalidations of non-coherent memory
+	std::vector<Pool> _pools;                 ///< one pool per memory type
+	vk::DeviceSize _dedicatedBytes = 0;       ///< total size of live dedicated allocations
+	size_t _dedicatedCount = 0;               ///< number of live dedicated allocations
+	vk::DeviceSize _bytesInUse = 0;           ///< bytes requested by live allocations
+	vk::DeviceSize _bytesLive = 0;            ///< bytes of the size class ranges of live pooled allocations
+	mutable std::mutex _mutex;
+}; // class Allocator
+
+} // namespace vuh
@@ -0,0 +1,64 @@
+#include "auto_filter.h"
+
+#include <cassert>
+#include <cstdlib>
+
+constexpr const char* AutoFilter::BackendEnv;
+
+/// Constructor
+/// @param shaderPath shader file overriding the one compiled into the binary, empty to use the latter
+/// @param backend backend to use, with Backend::Auto the BackendEnv environment variable is respected
+/// @throw std::runtime_error if Vulkan backend is requested and can not be created.
+///        Only the missing or failing device makes the automatic choice fall back to the CPU,
+///        errors creating the filter on a working device (like a broken shader file) are thrown.
+AutoFilter::AutoFilter(const std::string& shaderPath, Backend backend) {
+	if(backend == Backend::Auto){
+		auto env = std::getenv(BackendEnv);
+		const auto spec = std::string(env ? env : "");
+		if(spec == "cpu"){
+			backend = Backend::Cpu;
+		} else if(spec == "vulkan"){
+			backend = Backend::Vulkan;
+		}
+	}
+
+	if(backend != Backend::Cpu){
+		auto context = std::shared_ptr<vuh::Context>{};
+		try { // instance creation, device selection and device creation
+			context = std::make_shared<vuh::Context>();
+		} catch(const std::exception& e) {
+			if(backend == Backend::Vulkan){
+				throw;
+			}
+			_reason = std::string("no usable vulkan device (") + e.what() + ")";
+		}
+		if(context){
+			_gpu = std::make_unique<ExampleFilter>(std::move(context), shaderPath);
+			_reason = "vulkan device " + _gpu->deviceInfo.name;
+			return;
+		}
+	} else {
+		_reason = "cpu backend forced";
+	}
+	_cpu = std::make_unique<CpuFilter>();
+	_reason += ", running on " + std::to_string(_cpu->threads()) + " cpu thread(s), " + CpuFilter::isa();
+}
+
+/// Run the filter, y = y + a*x.
+/// @param y in-out array of p.width*p.height elements
+/// @param x input array of p.width*p.height elements
+auto AutoFilter::operator()(float* y, const float* x, const ExampleFilter::PushParams& p)-> void {
+	if(_gpu){
+		_gpu->stream({{y, x}}, p);
+	} else {
+		(*_cpu)(y, x, p);
+	}
+}
+
+/// Run the filter on the frame held in std::vector-s.
+auto AutoFilter::operator()(std::vector<float>& y, const std::vector<float>& x
+                            , const ExampleFilter::PushParams& p)-> void
+{
+	assert(y.size() >= size_t(p.width)*p.height && x.size() >= size_t(p.width)*p.height);
+	(*this)(y.data(), x.data(), p);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "cpu_filter.h"
+#include "example_filter.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/// Saxpy filter running on the Vulkan device when there is one and on the CPU otherwise.
+/// Frames are host arrays, on the Vulkan backend they are streamed through the device.
+class AutoFilter {
+public:
+	/// Backend choice
+	enum class Backend {
+		Auto,    ///< Vulkan if a suitable device is present, CPU otherwise
+		Vulkan,  ///< Vulkan device only, throws if there is none
+		Cpu      ///< CPU only, no Vulkan objects are created
+	};
+
+	static constexpr const char* BackendEnv = "VULKAN_COMPUTE_EXAMPLE_BACKEND"; ///< "cpu" or "vulkan" overrides Backend::Auto
+
+	explicit AutoFilter(const std::string& shaderPath = {}, Backend backend = Backend::Auto);
+
+	auto operator()(float* y, const float* x, const ExampleFilter::PushParams& p)-> void;
+	auto operator()(std::vector<float>& y, const std::vector<float>& x
+	                , const ExampleFilter::PushParams& p)-> void;
+
+	auto backend() const-> Backend { return _gpu ? Backend::Vulkan : Backend::Cpu; }
+	/// @return why the backend was chosen
+	auto reason() const-> const std::string& { return _reason; }
+private: // data
+	std::unique_ptr<ExampleFilter> _gpu;  ///< null when running on the CPU
+	std::unique_ptr<CpuFilter> _cpu;      ///< null when running on the Vulkan device
+	std::string _reason;
+}; // class AutoFilter
@@ -0,0 +1,122 @@
+#include "completion.h"
+
+#include <map>
+#include <memory>
+
+namespace vuh {
+
+namespace {
+	std::mutex queueRegistryMutex;
+	std::map<VkQueue, std::unique_ptr<std::mutex>> queueMutexes;
+} // namespace
+
+/// Constructor
+FencePool::FencePool(const vk::Device& device): _device(device) {}
+
+/// Destructor. All fences acquired from the pool should be released by now.
+FencePool::~FencePool() noexcept {
+	for(auto f: _free){
+		_device.destroyFence(f);
+	}
+}
+
+/// @return unsignaled fence, newly created if the pool is empty
+auto FencePool::acquire()-> vk::Fence {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(_free.empty()){
+		return _device.createFence(vk::FenceCreateInfo());
+	}
+	auto ret = _free.back();
+	_free.pop_back();
+	return ret;
+}
+
+/// Return fence to the pool. Fence should not be in use by any pending submission.
+auto FencePool::release(vk::Fence fence)-> void {
+	_device.resetFences({fence});
+	std::lock_guard<std::mutex> lock(_mutex);
+	_free.push_back(fence);
+}
+
+/// Constructor
+Completion::Completion(const vk::Device& device, vk::Fence fence, Recycle recycle)
+   : _device(device), _fence(fence), _recycle(std::move(recycle))
+{}
+
+/// Move constructor
+Completion::Completion(Completion&& other) noexcept
+   : _device(other._device), _fence(other._fence), _recycle(std::move(other._recycle))
+{
+	other._fence = nullptr;
+}
+
+/// Move assignment. Waits for the submission currently held.
+auto Completion::operator=(Completion&& other) noexcept-> Completion& {
+	if(this != &other){
+		finish();
+		_device = other._device;
+		_fence = other._fence;
+		_recycle = std::move(other._recycle);
+		other._fence = nullptr;
+	}
+	return *this;
+}
+
+/// Destructor. Blocks till the submission completes.
+Completion::~Completion() noexcept {
+	finish();
+}
+
+/// Block till the submission completes.
+auto Completion::wait()-> void {
+	wait_ns(uint64_t(-1));
+}
+
+/// @return true if submission has completed, does not block.
+auto Completion::poll()-> bool {
+	if(_fence && _device.getFenceStatus(_fence) == vk::Result::eSuccess){
+		complete();
+	}
+	return !_fence;
+}
+
+/// Wait for the fence at most timeout nanoseconds.
+auto Completion::wait_ns(uint64_t timeout)-> bool {
+	if(_fence && _device.waitForFences({_fence}, true, timeout) == vk::Result::eSuccess){
+		complete();
+	}
+	return !_fence;
+}
+
+/// Wait for the submission without throwing, for the destructor and move assignment.
+/// If the wait fails (device lost) or recycling throws, submission resources are not reused.
+auto Completion::finish() noexcept-> void {
+	try {
+		wait_ns(uint64_t(-1));
+	} catch(const std::exception&){
+		_fence = nullptr;
+	}
+}
+
+/// Recycle submission resources.
+auto Completion::complete()-> void {
+	auto fence = _fence;
+	_fence = nullptr;
+	if(_recycle){
+		_recycle(fence);
+	}
+}
+
+/// @return mutex serializing access to the queue.
+/// Queue submissions and waits need external synchronization. Filters, transfers and expression
+/// kernels may share the same queue, so they all lock the mutex registered for it here.
+auto queueMutex(const vk::Queue& queue)-> std::mutex& {
+	std::lock_guard<std::mutex> lock(queueRegistryMutex);
+	auto& m = queueMutexes[VkQueue(queue)];
+	if(!m){
+		m = std::make_unique<std::mutex>();
+	}
+	return *m;
+}
+
+} // namespace vuh
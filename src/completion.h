@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace vuh {
+
+/// Recycles fences instead of creating and destroying one per submission.
+class FencePool {
+public:
+	explicit FencePool(const vk::Device& device);
+	~FencePool() noexcept;
+	FencePool(const FencePool&) = delete;
+	auto operator=(const FencePool&)-> FencePool& = delete;
+
+	auto acquire()-> vk::Fence;
+	auto release(vk::Fence fence)-> void;
+private: // data
+	vk::Device _device;
+	std::vector<vk::Fence> _free;  ///< unsignaled fences ready for reuse
+	std::mutex _mutex;
+}; // class FencePool
+
+/// Waitable handle to the work submitted to a device queue.
+/// Resources associated with the submission are recycled once completion is observed.
+/// Destroying the handle of a submission still in flight blocks till the submission completes.
+class Completion {
+public:
+	using Recycle = std::function<void(vk::Fence)>;
+
+	Completion() = default; ///< handle to nothing, always complete
+	explicit Completion(const vk::Device& device, vk::Fence fence, Recycle recycle);
+	Completion(Completion&& other) noexcept;
+	auto operator=(Completion&& other) noexcept-> Completion&;
+	~Completion() noexcept;
+
+	auto wait()-> void;
+	auto poll()-> bool;
+
+	/// Wait for the submission to complete for at most the given time.
+	/// @return true if submission completed, false on timeout.
+	template<class Rep, class Period>
+	auto wait_for(const std::chrono::duration<Rep, Period>& timeout)-> bool {
+		return wait_ns(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count()));
+	}
+private: // helpers
+	auto wait_ns(uint64_t timeout)-> bool;
+	auto finish() noexcept-> void;
+	auto complete()-> void;
+private: // data
+	vk::Device _device;
+	vk::Fence _fence;    ///< signaled by the submission, null once completion is observed
+	Recycle _recycle;    ///< returns fence and other submission resources to their pools
+}; // class Completion
+
+auto queueMutex(const vk::Queue& queue)-> std::mutex&;
+
+} // namespace vuh
@@ -0,0 +1,103 @@
+#include "context.h"
+
+#include "element_type.h"
+#include "vulkan_helpers.h"
+
+#include <iostream>
+
+#define ARR_VIEW(x) uint32_t(x.size()), x.data()
+
+namespace vuh {
+
+namespace {
+#ifdef NDEBUG
+	constexpr bool enableValidation = false;
+#else
+	constexpr bool enableValidation = true;
+#endif
+} // namespace
+
+/// Constructor. Creates the instance, picks the physical device and creates the logical one.
+/// @param deviceRequest device override and features the device must support.
+///        By default the best ranked device is used, see vuh::selectDevice.
+Context::Context(const DeviceRequest& deviceRequest)
+   : _layers(enableValidation ? enabledLayers({"VK_LAYER_LUNARG_standard_validation"})
+                              : std::vector<const char*>{})
+{
+	auto extensions = enableValidation ? enabledExtensions({VK_EXT_DEBUG_REPORT_EXTENSION_NAME})
+	                                   : std::vector<const char*>{};
+	_instance = createInstance(_layers, extensions);
+	_debugReportCallback = enableValidation ? registerValidationReporter(_instance, debugReporter)
+	                                        : nullptr;
+	try {
+		_deviceInfo = selectDevice(_instance, deviceRequest);
+	} catch(...) { // destructor is not called for partially constructed context
+		destroyInstance();
+		throw;
+	}
+	const auto physDev = _deviceInfo.physDevice;
+	_families = {getComputeQueueFamilyId(physDev), getTransferQueueFamilyId(physDev)};
+	const auto importAlignment = hostImportAlignment(_instance, physDev);
+	auto features = deviceRequest.features;
+	features.shaderFloat64 = physDev.getFeatures().shaderFloat64; // enables the fp64 kernels where available
+	auto storage16 = VkPhysicalDevice16BitStorageFeatures{}; // enables the fp16 kernels where available
+	storage16.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES;
+	storage16.storageBuffer16BitAccess = VK_TRUE;
+	auto deviceExtensions = std::vector<const char*>{};
+	if(importAlignment){
+		deviceExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+	}
+	const auto calibratedTimestamps = calibratedTimestampsSupported(_instance, physDev);
+#ifdef VK_EXT_calibrated_timestamps
+	if(calibratedTimestamps){ // places the device trace events exactly on the host timeline
+		deviceExtensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+	}
+#endif
+	_device = createDevice(physDev, _layers, {_families.compute, _families.transfer}
+	                       , features, deviceExtensions
+	                       , storage16BitSupported(_instance, physDev) ? &storage16 : nullptr);
+	initDeviceResources(_device, physDev, _families, importAlignment, calibratedTimestamps);
+	_computeQueue = _device.getQueue(_families.compute, 0); // 0 is the queue index in the family, by default just the first one is used
+	_pipeCache = _device.createPipelineCache(vk::PipelineCacheCreateInfo());
+}
+
+/// Destructor. All filters and arrays using the device should be gone by now.
+Context::~Context() noexcept {
+	_device.destroyPipelineCache(_pipeCache);
+	releaseDeviceResources(_device);
+	_device.destroy();
+	destroyInstance();
+}
+
+/// @return resources shared by everything working with the context device
+auto Context::resources() const-> DeviceResources& {
+	return deviceResources(_device, _deviceInfo.physDevice);
+}
+
+/// Create Vulkan instance with the given layers and extensions enabled.
+auto Context::createInstance(const std::vector<const char*>& layers
+                             , const std::vector<const char*>& extensions
+                             )-> vk::Instance
+{
+	auto appInfo = vk::ApplicationInfo("Example Filter", 0, "no_engine"
+	                                   , 0, instanceApiVersion()); // The only important field here is apiVersion
+	auto createInfo = vk::InstanceCreateInfo(vk::InstanceCreateFlags(), &appInfo
+	                                         , ARR_VIEW(layers), ARR_VIEW(extensions));
+	return vk::createInstance(createInfo);
+}
+
+/// Unregister the validation reporter and destroy the instance.
+auto Context::destroyInstance() noexcept-> void {
+	if(_debugReportCallback){
+		auto destroyFn = PFN_vkDestroyDebugReportCallbackEXT(
+		            vkGetInstanceProcAddr(_instance, "vkDestroyDebugReportCallbackEXT"));
+		if(destroyFn){
+			destroyFn(_instance, _debugReportCallback, nullptr);
+		} else {
+			std::cerr << "Could not load vkDestroyDebugReportCallbackEXT\n";
+		}
+	}
+	_instance.destroy();
+}
+
+} // namespace vuh
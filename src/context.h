@@ -0,0 +1,53 @@
+#pragma once
+
+#include "device_resources.h"
+#include "device_selection.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <vector>
+
+namespace vuh {
+
+/// Vulkan instance and logical device shared by any number of filters.
+/// Owns the instance (with the validation reporter in debug builds), the device with its
+/// compute and transfer queues, the device resources (allocator, transfers, staging)
+/// and an in-memory pipeline cache. Filters hold the context through std::shared_ptr,
+/// it is destroyed together with the last of them.
+/// Device features needed by the fp64 and fp16 kernels are enabled whenever the device supports them,
+/// see vuh::elementTypeSupported.
+/// Arrays created on the context device can be used by all filters attached to it.
+class Context {
+public:
+	explicit Context(const DeviceRequest& deviceRequest = {});
+	~Context() noexcept;
+	Context(const Context&) = delete;
+	auto operator=(const Context&)-> Context& = delete;
+
+	auto instance() const-> const vk::Instance& { return _instance; }
+	auto debugReportCallback() const-> VkDebugReportCallbackEXT { return _debugReportCallback; }
+	auto deviceInfo() const-> const DeviceCandidate& { return _deviceInfo; }
+	auto physicalDevice() const-> const vk::PhysicalDevice& { return _deviceInfo.physDevice; }
+	auto device() const-> const vk::Device& { return _device; }
+	auto queueFamilies() const-> const QueueFamilies& { return _families; }
+	auto computeQueue() const-> const vk::Queue& { return _computeQueue; }
+	auto pipelineCache() const-> const vk::PipelineCache& { return _pipeCache; }
+	auto layers() const-> const std::vector<const char*>& { return _layers; }
+	auto resources() const-> DeviceResources&;
+private: // helpers
+	static auto createInstance(const std::vector<const char*>& layers
+	                           , const std::vector<const char*>& extensions
+	                           )-> vk::Instance;
+	auto destroyInstance() noexcept-> void;
+private: // data
+	std::vector<const char*> _layers;       ///< layers enabled on the instance and device
+	vk::Instance _instance;
+	VkDebugReportCallbackEXT _debugReportCallback = nullptr; ///< null if validation is off
+	DeviceCandidate _deviceInfo;            ///< physical device and why it was chosen
+	vk::Device _device;
+	QueueFamilies _families;                ///< queue families the device was created with
+	vk::Queue _computeQueue;                ///< first queue of the compute family
+	vk::PipelineCache _pipeCache;           ///< shared by the filters not persisting their own cache
+}; // class Context
+
+} // namespace vuh
@@ -0,0 +1,152 @@
+#include "cpu_filter.h"
+
+#include <cassert>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VUH_X86_DISPATCH
+#define VUH_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define VUH_X86_DISPATCH
+#ifdef __clang__
+#define VUH_TARGET(isa) __attribute__((target(isa)))
+#else
+#define VUH_TARGET(isa) // MSVC compiles any intrinsic without enabling its instruction set
+#endif
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace {
+	constexpr size_t MinParallelSize = 1u << 16; ///< frames smaller than that are processed on the calling thread
+
+	using SaxpyFn = void(*)(float* y, const float* x, float a, size_t n);
+
+	auto saxpyScalar(float* y, const float* x, float a, size_t n)-> void {
+		for(size_t i = 0; i < n; ++i){
+			y[i] += a*x[i];
+		}
+	}
+
+#ifdef VUH_X86_DISPATCH
+	VUH_TARGET("avx2,fma")
+	auto saxpyAvx2(float* y, const float* x, float a, size_t n)-> void {
+		const auto va = _mm256_set1_ps(a);
+		auto i = size_t(0);
+		for(; i + 8 <= n; i += 8){
+			const auto vy = _mm256_loadu_ps(y + i);
+			const auto vx = _mm256_loadu_ps(x + i);
+			_mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, vx, vy));
+		}
+		saxpyScalar(y + i, x + i, a, n - i);
+	}
+
+	VUH_TARGET("avx512f")
+	auto saxpyAvx512(float* y, const float* x, float a, size_t n)-> void {
+		const auto va = _mm512_set1_ps(a);
+		auto i = size_t(0);
+		for(; i + 16 <= n; i += 16){
+			const auto vy = _mm512_loadu_ps(y + i);
+			const auto vx = _mm512_loadu_ps(x + i);
+			_mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, vx, vy));
+		}
+		const auto tail = __mmask16((1u << (n - i)) - 1);
+		const auto vy = _mm512_maskz_loadu_ps(tail, y + i);
+		const auto vx = _mm512_maskz_loadu_ps(tail, x + i);
+		_mm512_mask_storeu_ps(y + i, tail, _mm512_fmadd_ps(va, vx, vy));
+	}
+#endif // VUH_X86_DISPATCH
+
+#if defined(VUH_X86_DISPATCH) && defined(_MSC_VER)
+	/// Instruction sets usable on this machine, as seen by cpuid.
+	/// Vector registers of AVX2 and AVX-512 must also be saved by the OS on context switches (xgetbv).
+	struct CpuFeatures {
+		bool avx2fma;
+		bool avx512f;
+	};
+
+	auto cpuFeatures()-> CpuFeatures {
+		int regs[4];
+		__cpuid(regs, 0);
+		const auto maxLeaf = regs[0];
+		__cpuid(regs, 1);
+		const auto fma = (regs[2] & (1 << 12)) != 0;
+		const auto osxsave = (regs[2] & (1 << 27)) != 0;
+		if(maxLeaf < 7 || !osxsave){
+			return {false, false};
+		}
+		const auto xcr0 = _xgetbv(0);
+		const auto osYmm = (xcr0 & 0x6) == 0x6;    // SSE and AVX state
+		const auto osZmm = (xcr0 & 0xe6) == 0xe6;  // and opmask, upper ZMM halves, ZMM16-31
+		__cpuidex(regs, 7, 0);
+		const auto avx2 = (regs[1] & (1 << 5)) != 0;
+		const auto avx512f = (regs[1] & (1 << 16)) != 0;
+		return {avx2 && fma && osYmm, avx512f && osZmm};
+	}
+#endif
+
+	struct Kernel {
+		SaxpyFn fn;
+		const char* isa;
+	};
+
+	/// @return the widest saxpy variant supported by the CPU
+	auto selectKernel()-> Kernel {
+#if defined(VUH_X86_DISPATCH) && defined(_MSC_VER)
+		const auto cpu = cpuFeatures();
+		if(cpu.avx512f){
+			return {saxpyAvx512, "avx512"};
+		}
+		if(cpu.avx2fma){
+			return {saxpyAvx2, "avx2"};
+		}
+#elif defined(VUH_X86_DISPATCH)
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx512f")){
+			return {saxpyAvx512, "avx512"};
+		}
+		if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+			return {saxpyAvx2, "avx2"};
+		}
+#endif
+		return {saxpyScalar, "scalar"};
+	}
+
+	auto kernel()-> const Kernel& {
+		static const auto k = selectKernel();
+		return k;
+	}
+} // namespace
+
+/// Constructor
+/// @param numThreads number of threads to spread rows over, all hardware threads when 0
+CpuFilter::CpuFilter(size_t numThreads): _pool(numThreads) {}
+
+/// Run the filter, y = y + a*x.
+/// @param y in-out array of p.width*p.height elements
+/// @param x input array of p.width*p.height elements
+auto CpuFilter::operator()(float* y, const float* x, const ExampleFilter::PushParams& p)-> void {
+	const auto fn = kernel().fn;
+	const auto width = size_t(p.width);
+	const auto a = p.a;
+	if(width*p.height < MinParallelSize){
+		fn(y, x, a, width*p.height);
+		return;
+	}
+	_pool.parallelFor(p.height, [=](size_t rowFirst, size_t rowLast){
+		fn(y + rowFirst*width, x + rowFirst*width, a, (rowLast - rowFirst)*width);
+	});
+}
+
+/// Run the filter on the frame held in std::vector-s.
+auto CpuFilter::operator()(std::vector<float>& y, const std::vector<float>& x
+                           , const ExampleFilter::PushParams& p)-> void
+{
+	assert(y.size() >= size_t(p.width)*p.height && x.size() >= size_t(p.width)*p.height);
+	(*this)(y.data(), x.data(), p);
+}
+
+/// @return name of the instruction set the saxpy kernel uses on this CPU
+auto CpuFilter::isa()-> const char* {
+	return kernel().isa;
+}
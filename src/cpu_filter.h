@@ -0,0 +1,23 @@
+#pragma once
+
+#include "example_filter.h"
+#include "thread_pool.h"
+
+#include <vector>
+
+/// Saxpy on the host CPU, for machines without a usable Vulkan device.
+/// Rows of the frame are spread over a thread pool, each thread runs the widest SIMD
+/// variant (AVX-512, AVX2 or plain scalar) the CPU supports, picked at runtime.
+class CpuFilter {
+public:
+	explicit CpuFilter(size_t numThreads = 0);
+
+	auto operator()(float* y, const float* x, const ExampleFilter::PushParams& p)-> void;
+	auto operator()(std::vector<float>& y, const std::vector<float>& x
+	                , const ExampleFilter::PushParams& p)-> void;
+
+	static auto isa()-> const char*;
+	auto threads() const-> size_t { return _pool.size(); }
+private: // data
+	vuh::ThreadPool _pool;
+}; // class CpuFilter
@@ -0,0 +1,95 @@
+#include "device_resources.h"
+
+#include "vulkan_helpers.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace vuh {
+
+namespace {
+	std::mutex registryMutex;
+	std::map<VkDevice, std::unique_ptr<DeviceResources>> registry;
+} // namespace
+
+/// Constructor
+/// @param hostImportAlignment minImportedHostPointerAlignment if the device was created
+///        with VK_EXT_external_memory_host enabled, 0 otherwise
+/// @param calibratedTimestamps device was created with VK_EXT_calibrated_timestamps enabled
+DeviceResources::DeviceResources(const vk::Device& device, const vk::PhysicalDevice& physDev
+                                 , const QueueFamilies& families, vk::DeviceSize hostImportAlignment
+                                 , bool calibratedTimestamps)
+   : queueFamilies(families)
+   , hostImportAlignment(hostImportAlignment)
+   , clock(std::make_shared<DeviceClock>(device, physDev, calibratedTimestamps))
+   , allocator(device, physDev)
+   , fences(device)
+   , transfer(device, physDev, families.transfer
+              , physDev.getQueueFamilyProperties()[families.transfer].queueFlags, clock)
+   , staging(device, physDev, allocator, transfer)
+   , expressions(device, physDev, families.compute, fences)
+{}
+
+/// Register callback to be notified before any buffer of the device is destroyed.
+/// Used to drop objects (like descriptor sets) referring to the buffer.
+/// @return listener id to be used for unregistering
+auto DeviceResources::addBufferListener(BufferListener listener)-> size_t {
+	std::lock_guard<std::mutex> lock(_listenersMutex);
+	_bufferListeners.emplace(_nextListenerId, std::move(listener));
+	return _nextListenerId++;
+}
+
+/// Unregister buffer listener.
+auto DeviceResources::removeBufferListener(size_t id)-> void {
+	std::lock_guard<std::mutex> lock(_listenersMutex);
+	_bufferListeners.erase(id);
+}
+
+/// Notify listeners that the buffer is about to be destroyed.
+auto DeviceResources::bufferDestroyed(const vk::Buffer& buf)-> void {
+	std::lock_guard<std::mutex> lock(_listenersMutex);
+	for(auto& l: _bufferListeners){
+		l.second(buf);
+	}
+}
+
+/// Create resources for the logical device created with the given queue families.
+/// Does nothing if resources for the device already exist.
+auto initDeviceResources(const vk::Device& device, const vk::PhysicalDevice& physDev
+                         , const QueueFamilies& families
+                         , vk::DeviceSize hostImportAlignment
+                         , bool calibratedTimestamps
+                         )-> DeviceResources&
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	auto& r = registry[VkDevice(device)];
+	if(!r){
+		r = std::make_unique<DeviceResources>(device, physDev, families, hostImportAlignment
+		                                      , calibratedTimestamps);
+	}
+	return *r;
+}
+
+/// @return resources associated with the logical device.
+/// If not initialized explicitly, device is assumed to have a single queue of the compute family.
+auto deviceResources(const vk::Device& device, const vk::PhysicalDevice& physDev)-> DeviceResources& {
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		auto it = registry.find(VkDevice(device));
+		if(it != registry.end()){
+			return *it->second;
+		}
+	}
+	const auto computeId = getComputeQueueFamilyId(physDev);
+	return initDeviceResources(device, physDev, {computeId, computeId});
+}
+
+/// Release resources associated with the logical device.
+/// Should be called before the device is destroyed.
+auto releaseDeviceResources(const vk::Device& device)-> void {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	registry.erase(VkDevice(device));
+}
+
+} // namespace vuh
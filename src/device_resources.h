@@ -0,0 +1,63 @@
+#pragma once
+
+#include "allocator.h"
+#include "expression_kernels.h"
+#include "profiler.h"
+#include "staging_ring.h"
+#include "transfer.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vuh {
+
+/// Queue families the logical device was created with.
+struct QueueFamilies {
+	uint32_t compute;   ///< family of the queue compute work is submitted to
+	uint32_t transfer;  ///< family of the queue host-device transfers are submitted to, may be the same as compute
+};
+
+/// Resources shared by everything working with the same logical device.
+struct DeviceResources {
+	explicit DeviceResources(const vk::Device& device, const vk::PhysicalDevice& physDev
+	                         , const QueueFamilies& families, vk::DeviceSize hostImportAlignment = 0
+	                         , bool calibratedTimestamps = false);
+
+	/// @return queue families buffers used on both compute and transfer queues should be shared between
+	auto sharingFamilies() const-> std::vector<uint32_t> {
+		return {queueFamilies.compute, queueFamilies.transfer};
+	}
+
+	using BufferListener = std::function<void(const vk::Buffer&)>;
+
+	auto addBufferListener(BufferListener listener)-> size_t;
+	auto removeBufferListener(size_t id)-> void;
+	auto bufferDestroyed(const vk::Buffer& buf)-> void;
+
+	const QueueFamilies queueFamilies;  ///< queue families the device was created with
+	const vk::DeviceSize hostImportAlignment; ///< alignment of importable host pointers, 0 if import is not enabled
+	const std::shared_ptr<DeviceClock> clock; ///< maps timestamps of all queues to the host clock, shared by the profilers
+	Allocator allocator;                ///< device memory sub-allocator
+	FencePool fences;                   ///< fences for compute submissions
+	Transfer transfer;                  ///< asynchronous buffer copies on the transfer queue
+	StagingRing staging;                ///< staging buffer for transfers to and from memory that is not host-visible
+	ExpressionKernels expressions;      ///< kernels evaluating elementwise array expressions
+private:
+	std::map<size_t, BufferListener> _bufferListeners; ///< notified before a buffer is destroyed
+	size_t _nextListenerId = 0;
+	std::mutex _listenersMutex;
+}; // struct DeviceResources
+
+auto initDeviceResources(const vk::Device& device, const vk::PhysicalDevice& physDev
+                         , const QueueFamilies& families
+                         , vk::DeviceSize hostImportAlignment = 0
+                         , bool calibratedTimestamps = false)-> DeviceResources&;
+auto deviceResources(const vk::Device& device, const vk::PhysicalDevice& physDev)-> DeviceResources&;
+auto releaseDeviceResources(const vk::Device& device)-> void;
+
+} // namespace vuh
@@ -0,0 +1,211 @@
+#include "device_selection.h"
+
+#include "vulkan_helpers.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+namespace vuh {
+
+namespace {
+	/// @return preference of the device type, higher is better
+	auto typeRank(vk::PhysicalDeviceType type)-> int {
+		switch(type){
+			case vk::PhysicalDeviceType::eDiscreteGpu:   return 4;
+			case vk::PhysicalDeviceType::eIntegratedGpu: return 3;
+			case vk::PhysicalDeviceType::eVirtualGpu:    return 2;
+			case vk::PhysicalDeviceType::eCpu:           return 1;
+			default:                                     return 0;
+		}
+	}
+
+	auto typeName(vk::PhysicalDeviceType type)-> const char* {
+		switch(type){
+			case vk::PhysicalDeviceType::eDiscreteGpu:   return "discrete GPU";
+			case vk::PhysicalDeviceType::eIntegratedGpu: return "integrated GPU";
+			case vk::PhysicalDeviceType::eVirtualGpu:    return "virtual GPU";
+			case vk::PhysicalDeviceType::eCpu:           return "CPU";
+			default:                                     return "other device type";
+		}
+	}
+
+	/// Device UUID is only reported by devices and instances supporting Vulkan 1.1.
+	auto deviceUUID(const vk::Instance& instance, const vk::PhysicalDevice& physDev
+	                )-> std::array<uint8_t, VK_UUID_SIZE>
+	{
+		auto ret = std::array<uint8_t, VK_UUID_SIZE>{};
+		if(usableApiVersion(physDev) < VK_API_VERSION_1_1){
+			return ret;
+		}
+		auto getProperties2 = PFN_vkGetPhysicalDeviceProperties2(
+		                       vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2"));
+		if(!getProperties2){
+			return ret;
+		}
+		auto idProps = VkPhysicalDeviceIDProperties{};
+		idProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+		auto props = VkPhysicalDeviceProperties2{};
+		props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		props.pNext = &idProps;
+		getProperties2(VkPhysicalDevice(physDev), &props);
+		std::copy(std::begin(idProps.deviceUUID), std::end(idProps.deviceUUID), ret.data());
+		return ret;
+	}
+
+	/// @return indices of the required features not supported by the device
+	auto missingFeatures(const vk::PhysicalDevice& physDev, const vk::PhysicalDeviceFeatures& required
+	                     )-> std::vector<size_t>
+	{
+		// VkPhysicalDeviceFeatures is a plain sequence of VkBool32 flags
+		constexpr auto numFeatures = sizeof(VkPhysicalDeviceFeatures)/sizeof(VkBool32);
+		const auto supported = physDev.getFeatures();
+		auto req = reinterpret_cast<const VkBool32*>(&required);
+		auto sup = reinterpret_cast<const VkBool32*>(&supported);
+		auto ret = std::vector<size_t>{};
+		for(size_t i = 0; i < numFeatures; ++i){
+			if(req[i] && !sup[i]){
+				ret.push_back(i);
+			}
+		}
+		return ret;
+	}
+
+	auto lowercase(std::string s)-> std::string {
+		std::transform(begin(s), end(s), begin(s), [](unsigned char c){ return char(std::tolower(c)); });
+		return s;
+	}
+
+	/// @return override string with dashes removed if it looks like a UUID, empty string otherwise
+	auto asUUID(const std::string& s)-> std::string {
+		auto ret = std::string{};
+		for(auto c: s){
+			if(c == '-'){
+				continue;
+			}
+			if(!std::isxdigit(static_cast<unsigned char>(c))){
+				return {};
+			}
+			ret.push_back(char(std::tolower(static_cast<unsigned char>(c))));
+		}
+		return ret.size() == 2*VK_UUID_SIZE ? ret : std::string{};
+	}
+
+	auto isIndex(const std::string& s)-> bool {
+		return !s.empty() && std::all_of(begin(s), end(s)
+		                                 , [](unsigned char c){ return std::isdigit(c); });
+	}
+} // namespace
+
+/// @return UUID as a string of hex digits
+auto uuidString(const std::array<uint8_t, VK_UUID_SIZE>& uuid)-> std::string {
+	static const char digits[] = "0123456789abcdef";
+	auto ret = std::string{};
+	for(auto b: uuid){
+		ret.push_back(digits[b >> 4]);
+		ret.push_back(digits[b & 0xf]);
+	}
+	return ret;
+}
+
+/// Rank the physical devices of the instance.
+/// Devices are ordered by suitability, then device type (discrete, integrated, virtual GPU, CPU),
+/// then size of the device-local heap, then number of compute queues. Ties keep the instance order.
+/// @return all devices of the instance, best first
+auto rankDevices(const vk::Instance& instance, const vk::PhysicalDeviceFeatures& required
+                 )-> std::vector<DeviceCandidate>
+{
+	auto ret = std::vector<DeviceCandidate>{};
+	const auto physDevs = instance.enumeratePhysicalDevices();
+	for(uint32_t i = 0; i < physDevs.size(); ++i){
+		const auto& pd = physDevs[i];
+		const auto props = pd.getProperties();
+		auto c = DeviceCandidate{i, pd, props.deviceName, props.deviceType, deviceUUID(instance, pd)
+		                         , 0, 0, true, {}};
+
+		const auto memProps = pd.getMemoryProperties();
+		for(uint32_t h = 0; h < memProps.memoryHeapCount; ++h){
+			if(memProps.memoryHeaps[h].flags & vk::MemoryHeapFlagBits::eDeviceLocal){
+				c.localHeapSize = std::max(c.localHeapSize, memProps.memoryHeaps[h].size);
+			}
+		}
+
+		auto reason = std::ostringstream{};
+		reason << typeName(c.type) << ", " << (c.localHeapSize >> 20) << " MiB device-local";
+		try {
+			c.computeQueues = pd.getQueueFamilyProperties()[getComputeQueueFamilyId(pd)].queueCount;
+			reason << ", " << c.computeQueues << " compute queue(s)";
+		} catch(std::runtime_error&) {
+			c.suitable = false;
+			reason << ", no compute queues";
+		}
+		const auto missing = missingFeatures(pd, required);
+		if(!missing.empty()){
+			c.suitable = false;
+			reason << ", " << missing.size() << " required feature(s) missing";
+		}
+		c.reason = reason.str();
+		ret.push_back(std::move(c));
+	}
+	std::stable_sort(begin(ret), end(ret), [](const DeviceCandidate& a, const DeviceCandidate& b){
+		return std::make_tuple(a.suitable, typeRank(a.type), a.localHeapSize, a.computeQueues)
+		     > std::make_tuple(b.suitable, typeRank(b.type), b.localHeapSize, b.computeQueues);
+	});
+	return ret;
+}
+
+/// Select physical device to run on.
+/// Explicit override from the request takes precedence over the environment variable,
+/// which takes precedence over ranking. When override matches several devices by name
+/// the best ranked of them is taken.
+/// @return chosen device, its reason field tells why it was chosen
+/// @throw std::runtime_error if no suitable device is found or the override does not match
+///        a suitable device
+auto selectDevice(const vk::Instance& instance, const DeviceRequest& request)-> DeviceCandidate {
+	const auto ranked = rankDevices(instance, request.features);
+	if(ranked.empty()){
+		throw std::runtime_error("no Vulkan device found");
+	}
+	auto spec = request.override;
+	auto source = std::string("API");
+	if(spec.empty()){
+		auto env = std::getenv(DeviceOverrideEnv);
+		spec = env ? env : "";
+		source = DeviceOverrideEnv;
+	}
+
+	auto chosen = ranked.end();
+	auto how = std::string{};
+	if(spec.empty()){
+		chosen = ranked.begin();
+		how = "best ranked of " + std::to_string(ranked.size()) + " device(s)";
+	} else if(isIndex(spec)){
+		chosen = std::find_if(begin(ranked), end(ranked), [&](const DeviceCandidate& c){
+			return c.index == std::strtoul(spec.c_str(), nullptr, 10); });
+		how = "index " + spec + " set by " + source;
+	} else if(!asUUID(spec).empty()){
+		chosen = std::find_if(begin(ranked), end(ranked), [&](const DeviceCandidate& c){
+			return uuidString(c.uuid) == asUUID(spec); });
+		how = "UUID " + spec + " set by " + source;
+	} else {
+		chosen = std::find_if(begin(ranked), end(ranked), [&](const DeviceCandidate& c){
+			return lowercase(c.name).find(lowercase(spec)) != std::string::npos; });
+		how = "name '" + spec + "' set by " + source;
+	}
+
+	if(chosen == ranked.end()){
+		throw std::runtime_error("no device matches " + how);
+	}
+	if(!chosen->suitable){
+		throw std::runtime_error("device " + std::to_string(chosen->index) + " (" + chosen->name
+		                         + ") is not suitable: " + chosen->reason);
+	}
+	auto ret = *chosen;
+	ret.reason = "selected by " + how + ": " + ret.reason;
+	return ret;
+}
+
+} // namespace vuh
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace vuh {
+
+/// Name of the environment variable overriding the device choice.
+/// Takes the same values as DeviceRequest::override.
+constexpr auto DeviceOverrideEnv = "VULKAN_COMPUTE_EXAMPLE_DEVICE";
+
+/// What the caller wants from the physical device
+struct DeviceRequest {
+	/// Device to use instead of the best ranked one: index in the instance device list,
+	/// UUID (32 hex digits, dashes ignored) or case-insensitive part of the device name.
+	/// When empty the DeviceOverrideEnv environment variable is checked.
+	std::string override;
+	vk::PhysicalDeviceFeatures features;  ///< features the device must support
+};
+
+/// Physical device considered for running the filter
+struct DeviceCandidate {
+	uint32_t index;                          ///< index in the instance device list
+	vk::PhysicalDevice physDev;
+	std::string name;
+	vk::PhysicalDeviceType type;
+	std::array<uint8_t, VK_UUID_SIZE> uuid;  ///< device UUID, all zeros if device does not report one
+	vk::DeviceSize localHeapSize;            ///< size of the largest device-local heap, bytes
+	uint32_t computeQueues;                  ///< number of queues in the compute family
+	bool suitable;                           ///< device has compute queues and all requested features
+	std::string reason;                      ///< human-readable account of the ranking or the choice
+};
+
+auto rankDevices(const vk::Instance& instance
+                 , const vk::PhysicalDeviceFeatures& required = vk::PhysicalDeviceFeatures()
+                 )-> std::vector<DeviceCandidate>;
+
+auto selectDevice(const vk::Instance& instance, const DeviceRequest& request = {})-> DeviceCandidate;
+
+auto uuidString(const std::array<uint8_t, VK_UUID_SIZE>& uuid)-> std::string;
+
+} // namespace vuh
@@ -0,0 +1,133 @@
+#include "element_type.h"
+
+#include "vulkan_helpers.h"
+
+#include <cstring>
+
+namespace vuh {
+
+/// Convert float to half, rounding to nearest even.
+/// Values out of the half range turn to infinity, NaN stays NaN.
+half::half(float f) {
+	auto x = uint32_t(0);
+	std::memcpy(&x, &f, sizeof(x));
+	const auto sign = uint32_t((x >> 16) & 0x8000u);
+	const auto exp = int((x >> 23) & 0xffu);
+	auto mant = x & 0x7fffffu;
+	if(exp == 0xff){ // inf or NaN
+		bits = uint16_t(sign | 0x7c00u | (mant ? 0x200u : 0u));
+		return;
+	}
+	const auto e = exp - 127 + 15; // rebiased exponent
+	if(e >= 0x1f){ // overflow
+		bits = uint16_t(sign | 0x7c00u);
+		return;
+	}
+	if(e <= 0){ // half subnormal or zero
+		if(e < -10){
+			bits = uint16_t(sign);
+			return;
+		}
+		mant |= 0x800000u; // implicit leading bit
+		const auto shift = uint32_t(14 - e);
+		auto h = mant >> shift;
+		const auto rem = mant & ((1u << shift) - 1u);
+		const auto halfway = 1u << (shift - 1u);
+		if(rem > halfway || (rem == halfway && (h & 1u))){
+			++h;
+		}
+		bits = uint16_t(sign | h);
+		return;
+	}
+	auto h = (uint32_t(e) << 10) | (mant >> 13);
+	const auto rem = mant & 0x1fffu;
+	if(rem > 0x1000u || (rem == 0x1000u && (h & 1u))){
+		++h; // carry into the exponent is right, up to infinity
+	}
+	bits = uint16_t(sign | h);
+}
+
+/// Convert half to float, exact.
+half::operator float() const {
+	const auto sign = uint32_t(bits & 0x8000u) << 16;
+	const auto exp = uint32_t(bits >> 10) & 0x1fu;
+	auto mant = uint32_t(bits & 0x3ffu);
+	auto x = uint32_t(0);
+	if(exp == 0x1f){ // inf or NaN
+		x = sign | 0x7f800000u | (mant << 13);
+	} else if(exp == 0){
+		if(mant == 0){
+			x = sign;
+		} else { // subnormal, normalized in float
+			auto shifts = uint32_t(0);
+			while(!(mant & 0x400u)){
+				mant <<= 1;
+				++shifts;
+			}
+			x = sign | ((113u - shifts) << 23) | ((mant & 0x3ffu) << 13);
+		}
+	} else {
+		x = sign | ((exp + 112u) << 23) | (mant << 13);
+	}
+	auto ret = 0.f;
+	std::memcpy(&ret, &x, sizeof(ret));
+	return ret;
+}
+
+/// @return short name of the element type as used in the shader file names
+auto elementTypeName(ElementType type)-> const char* {
+	switch(type){
+		case ElementType::Float16: return "f16";
+		case ElementType::Float32: return "f32";
+		case ElementType::Float64: return "f64";
+		case ElementType::Int32:   return "i32";
+		case ElementType::Uint32:  return "u32";
+	}
+	return "unknown";
+}
+
+/// @return true if device supports storage buffers of 16-bit elements (Vulkan 1.1 storageBuffer16BitAccess).
+/// vkGetPhysicalDeviceFeatures2 is looked up on the instance, so that linking to a 1.0 loader works.
+auto storage16BitSupported(const vk::Instance& instance, const vk::PhysicalDevice& physDev)-> bool {
+	if(usableApiVersion(physDev) < VK_API_VERSION_1_1){
+		return false;
+	}
+	auto getFeatures2 = PFN_vkGetPhysicalDeviceFeatures2(
+	                     vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2"));
+	if(!getFeatures2){
+		return false;
+	}
+	auto storage16 = VkPhysicalDevice16BitStorageFeatures{};
+	storage16.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES;
+	auto features = VkPhysicalDeviceFeatures2{};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &storage16;
+	getFeatures2(VkPhysicalDevice(physDev), &features);
+	return storage16.storageBuffer16BitAccess == VK_TRUE;
+}
+
+/// @return true if filter kernels of the given element type can run on the device.
+/// 32-bit types are always supported, fp64 needs shaderFloat64 and fp16 needs 16-bit storage buffers.
+/// vuh::Context enables these features whenever the device has them.
+auto elementTypeSupported(const vk::Instance& instance, const vk::PhysicalDevice& physDev
+                          , ElementType type)-> bool
+{
+	switch(type){
+		case ElementType::Float32:
+		case ElementType::Int32:
+		case ElementType::Uint32:  return true;
+		case ElementType::Float64: return physDev.getFeatures().shaderFloat64 == VK_TRUE;
+		case ElementType::Float16: return storage16BitSupported(instance, physDev);
+	}
+	return false;
+}
+
+/// @return wanted element type if device supports it, otherwise fp32 which is supported everywhere.
+/// For callers choosing the filter instantiation at runtime, i.e. fp16 or fp64 falling back to fp32.
+auto supportedElementType(const vk::Instance& instance, const vk::PhysicalDevice& physDev
+                          , ElementType wanted)-> ElementType
+{
+	return elementTypeSupported(instance, physDev, wanted) ? wanted : ElementType::Float32;
+}
+
+} // namespace vuh
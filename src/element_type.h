@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+
+namespace vuh {
+
+/// IEEE 754 half precision number, host-side storage type of the fp16 arrays.
+/// Arithmetic is not provided, values are converted to float and back.
+struct half {
+	uint16_t bits;   ///< raw binary16 representation
+
+	half() = default;
+	explicit half(float f);
+	explicit operator float() const;
+};
+
+inline auto operator==(half a, half b)-> bool { return a.bits == b.bits; }
+inline auto operator!=(half a, half b)-> bool { return a.bits != b.bits; }
+
+/// Element types the filter kernels are provided for
+enum class ElementType { Float16, Float32, Float64, Int32, Uint32 };
+
+/// Compile-time description of the array element type.
+/// Scalar is the type of the saxpy factor in the push constants, shaderSuffix tells the shader
+/// variant apart from the float one: saxpy.spv -> saxpy_f64.spv.
+template<class T> struct ElementTraits;
+
+template<> struct ElementTraits<float> {
+	using Scalar = float;
+	static constexpr auto type = ElementType::Float32;
+	static constexpr auto shaderSuffix = "";
+};
+
+template<> struct ElementTraits<double> {
+	using Scalar = double;
+	static constexpr auto type = ElementType::Float64;
+	static constexpr auto shaderSuffix = "_f64";
+};
+
+template<> struct ElementTraits<half> {
+	using Scalar = float;   ///< fp16 arrays are only stored in 16 bits, computed in fp32
+	static constexpr auto type = ElementType::Float16;
+	static constexpr auto shaderSuffix = "_f16";
+};
+
+template<> struct ElementTraits<int32_t> {
+	using Scalar = int32_t;
+	static constexpr auto type = ElementType::Int32;
+	static constexpr auto shaderSuffix = "_i32";
+};
+
+template<> struct ElementTraits<uint32_t> {
+	using Scalar = uint32_t;
+	static constexpr auto type = ElementType::Uint32;
+	static constexpr auto shaderSuffix = "_u32";
+};
+
+auto elementTypeName(ElementType type)-> const char*;
+auto elementTypeSupported(const vk::Instance& instance, const vk::PhysicalDevice& physDev, ElementType type)-> bool;
+auto supportedElementType(const vk::Instance& instance, const vk::PhysicalDevice& physDev
+                          , ElementType wanted)-> ElementType;
+
+auto storage16BitSupported(const vk::Instance& instance, const vk::PhysicalDevice& physDev)-> bool;
+
+} // namespace vuh
@@ -0,0 +1,58 @@
+#include "embedded_shaders.h"
+
+namespace vuh {
+
+namespace {
+	// SPIR-V words are generated at build time by compile_shader(... EMBED), see config/CompileShader.cmake.
+	// Word arrays satisfy the 4-byte alignment vkCreateShaderModule requires of the code.
+	constexpr uint32_t saxpy[] = {
+#include "shaders/saxpy.spv.inc"
+	};
+	constexpr uint32_t saxpy_vec2[] = {
+#include "shaders/saxpy_vec2.spv.inc"
+	};
+	constexpr uint32_t saxpy_vec4[] = {
+#include "shaders/saxpy_vec4.spv.inc"
+	};
+	constexpr uint32_t saxpy_f16[] = {
+#include "shaders/saxpy_f16.spv.inc"
+	};
+	constexpr uint32_t saxpy_f64[] = {
+#include "shaders/saxpy_f64.spv.inc"
+	};
+	constexpr uint32_t saxpy_i32[] = {
+#include "shaders/saxpy_i32.spv.inc"
+	};
+	constexpr uint32_t saxpy_u32[] = {
+#include "shaders/saxpy_u32.spv.inc"
+	};
+
+	/// Embedded shader under the file name it is compiled to
+	struct EmbeddedShader {
+		const char* name;
+		ShaderCode code;
+	};
+
+	constexpr EmbeddedShader embeddedShaders[] = {
+	    {"saxpy.spv",      {saxpy,      sizeof(saxpy)}}
+	   ,{"saxpy_vec2.spv", {saxpy_vec2, sizeof(saxpy_vec2)}}
+	   ,{"saxpy_vec4.spv", {saxpy_vec4, sizeof(saxpy_vec4)}}
+	   ,{"saxpy_f16.spv",  {saxpy_f16,  sizeof(saxpy_f16)}}
+	   ,{"saxpy_f64.spv",  {saxpy_f64,  sizeof(saxpy_f64)}}
+	   ,{"saxpy_i32.spv",  {saxpy_i32,  sizeof(saxpy_i32)}}
+	   ,{"saxpy_u32.spv",  {saxpy_u32,  sizeof(saxpy_u32)}}
+	};
+} // namespace
+
+/// @return code of the shader compiled into the binary by its file name (i.e. saxpy_vec4.spv),
+///         null data and zero size if there is no such shader
+auto embeddedShader(const std::string& name)-> ShaderCode {
+	for(const auto& s: embeddedShaders){
+		if(name == s.name){
+			return s.code;
+		}
+	}
+	return {nullptr, 0};
+}
+
+} // namespace vuh
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace vuh {
+
+/// SPIR-V code of a shader compiled into the binary
+struct ShaderCode {
+	const uint32_t* data;  ///< first word of the code, null if there is no such shader
+	size_t size;           ///< code size, bytes
+};
+
+auto embeddedShader(const std::string& name)-> ShaderCode;
+
+} // namespace vuh
@@ -1,128 +1,1049 @@
 #include "example_filter.h"
 
+#include "embedded_shaders.h"
+#include "trace.h"
 #include "vulkan_helpers.hpp"
 
 #include <vulkan/vulkan.hpp>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <limits>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
 #define ARR_VIEW(x) uint32_t(x.size()), x.data()
 #define ST_VIEW(s)  uint32_t(sizeof(s)), &s
 
 using namespace vuh;
 namespace {
-	constexpr uint32_t WORKGROUP_SIZE = 16; ///< compute shader workgroup dimension is WORKGROUP_SIZE x WORKGROUP_SIZE
+	constexpr uint32_t NumStreamSlots = 3;  ///< tiles in flight when streaming: upload, dispatch and download
+	constexpr uint32_t MaxGroupCountX = 65535; ///< minimal value of maxComputeWorkGroupCount guaranteed by the spec
+	constexpr auto EmbeddedShaderName = "saxpy.spv"; ///< shader used when no shader file is given
+
+	/// @return path with the suffix inserted before the extension, shader.spv -> shader_vec4.spv
+	auto variantPath(const std::string& path, const std::string& suffix)-> std::string {
+		const auto dot = path.rfind('.');
+		return path.substr(0, dot) + suffix + (dot == std::string::npos ? "" : path.substr(dot));
+	}
+
+	/// SPIR-V code of a shader, compiled into the binary or read from a file
+	struct SpirvCode {
+		const uint32_t* data = nullptr;  ///< first word of the code, null if there is no such shader
+		size_t size = 0;                 ///< code size, bytes
+		std::vector<char> file;          ///< code read from the file, empty for the embedded shaders
+	};
+
+	/// @return SPIR-V code of the shader compiled into the binary or read from the file, empty if there is no such shader.
+	///         Embedded code is referred to, not copied.
+	auto spirvCode(const std::string& name, bool embedded)-> SpirvCode {
+		auto ret = SpirvCode{};
+		if(embedded){
+			const auto code = embeddedShader(name);
+			ret.data = code.data;
+			ret.size = code.size;
+		} else if(std::ifstream(name).good()){
+			ret.file = readShaderSrc(name.c_str());
+			ret.data = reinterpret_cast<const uint32_t*>(ret.file.data());
+			ret.size = ret.file.size();
+		}
+		return ret;
+	}
+} // namespace
+
+namespace vuh {
+	/// Fence of a run of a cached binding, shared by the run completion and the binding.
+	/// Binding waits on it before releasing its command buffer, completion clears it
+	/// before returning the fence to the pool.
+	struct PendingRun {
+		/// @return true if the completion of the run was observed
+		auto done()-> bool {
+			std::lock_guard<std::mutex> lock(mutex);
+			return !fence;
+		}
+
+		/// Block till the run completes, unless its completion was observed already.
+		auto wait(const vk::Device& device)-> void {
+			std::lock_guard<std::mutex> lock(mutex);
+			if(fence){
+				device.waitForFences({fence}, true, uint64_t(-1));
+			}
+		}
+
+		vk::Fence fence;  ///< null once the completion is observed
+		std::mutex mutex;
+	};
+
+	/// Pools of a single thread calling the filter.
+	/// Released when the thread exits or the filter is destroyed, whichever comes first,
+	/// and no batch recorded to them is still in flight. Batches may outlive the filter,
+	/// so the pools keep the context their device belongs to.
+	struct CallerPools {
+		CallerPools(std::shared_ptr<Context> context, vk::CommandPool cmdPool, vk::DescriptorPool dscPool)
+		   : context(std::move(context)), device(this->context->device()), cmdPool(cmdPool), dscPool(dscPool)
+		{}
+		~CallerPools() noexcept {
+			device.destroyCommandPool(cmdPool);
+			device.destroyDescriptorPool(dscPool);
+		}
+		CallerPools(const CallerPools&) = delete;
+		auto operator=(const CallerPools&)-> CallerPools& = delete;
+
+		/// Release the bound parameters. Should be called with the mutex locked.
+		auto unbind()-> void {
+			if(cmdBuffer){
+				device.freeCommandBuffers(cmdPool, {cmdBuffer});
+				cmdBuffer = nullptr;
+				device.resetDescriptorPool(dscPool);
+			}
+		}
+
+		std::shared_ptr<Context> context; ///< destroyed after the pools
+		vk::Device device;
+		vk::CommandPool cmdPool;      ///< bound parameters and batches command buffers
+		vk::DescriptorPool dscPool;   ///< descriptor set of the bound parameters
+		vk::CommandBuffer cmdBuffer;  ///< commands for the bound parameters, null if nothing is bound
+		std::mutex mutex;             ///< command buffers of the completed batches are freed from other threads
+	};
+
+	/// Pools of the threads calling the filter.
+	/// Each calling thread holds a weak reference to it and drops its pools on exit,
+	/// so that ids of the exited threads reused by new ones never see stale bindings.
+	struct CallerRegistry {
+		std::map<std::thread::id, std::shared_ptr<CallerPools>> pools;
+		std::mutex mutex;
+	};
+} // namespace vuh
+
+namespace {
+	/// Filters the current thread has pools in, its pools are dropped from them on thread exit
+	struct ThreadCallers {
+		~ThreadCallers() noexcept {
+			const auto id = std::this_thread::get_id();
+			for(auto& r: registries){
+				if(auto registry = r.lock()){ // filter is still alive
+					std::lock_guard<std::mutex> lock(registry->mutex);
+					registry->pools.erase(id);
+				}
+			}
+		}
+
+		/// Remember the registry, forgetting the ones of destroyed filters.
+		auto add(const std::shared_ptr<CallerRegistry>& registry)-> void {
+			registries.erase(std::remove_if(begin(registries), end(registries)
+			                                , [](const std::weak_ptr<CallerRegistry>& r){ return r.expired(); })
+			                 , end(registries));
+			registries.push_back(registry);
+		}
 
-#ifdef NDEBUG
-	constexpr bool enableValidation = false;
-#else
-	constexpr bool enableValidation = true;
-#endif
+		std::vector<std::weak_ptr<CallerRegistry>> registries;
+	};
+
+	thread_local ThreadCallers threadCallers;
 } // namespace
 
+template<class T> constexpr uint32_t BasicFilter<T>::NumDescriptors;
+template<class T> constexpr uint32_t BasicFilter<T>::BindingCacheSize;
+template<class T> constexpr vk::DeviceSize BasicFilter<T>::DefaultStreamBudget;
+
+/// Constructor. Creates the filter on its own context.
+/// @param shaderPath SPIR-V file to load the shader from instead of the one compiled into the binary.
+///        Variants for other element types and vector widths are looked up next to it.
+/// @param pipeCachePath file to load the pipeline cache from and save it back to on destruction.
+///        When empty the pipeline cache only lives as long as the filter.
+///        Tuned workgroup sizes are persisted next to it, in pipeCachePath + ".workgroups".
+/// @param deviceRequest device override and features the device must support.
+///        By default the best ranked device is used, see vuh::selectDevice.
+template<class T>
+BasicFilter<T>::BasicFilter(const std::string& shaderPath, const std::string& pipeCachePath
+                            , const DeviceRequest& deviceRequest)
+   : BasicFilter(std::make_shared<Context>(deviceRequest), shaderPath, pipeCachePath)
+{}
 
-/// Constructor
-ExampleFilter::ExampleFilter(const std::string& shaderPath){
-	auto layers = enableValidation ? enabledLayers({"VK_LAYER_LUNARG_standard_validation"})
-											 : std::vector<const char*>{};
-	auto extensions = enableValidation ? enabledExtensions({VK_EXT_DEBUG_REPORT_EXTENSION_NAME})
-												  : std::vector<const char*>{};
-	instance = createInstance(layers, extensions);
-	debugReportCallback = enableValidation ? registerValidationReporter(instance, debugReporter)
-														: nullptr;
-	physDevice = instance.enumeratePhysicalDevices()[0]; // just use the first device
-	compute_queue_familly_id = getComputeQueueFamilyId(physDevice);
-	device = createDevice(physDevice, layers, compute_queue_familly_id); // TODO: when physical device is a discrete gpu, transfer queue needs to be included
-	shader = loadShader(device, shaderPath.c_str());
+/// Constructor. Attaches the filter to the existing context, only the shader modules,
+/// layouts, pipelines and pools of the filter itself are created.
+/// @param shaderPath SPIR-V file overriding the shader compiled into the binary, empty to use the latter
+/// @param pipeCachePath file to load the pipeline cache from and save it back to on destruction.
+///        When empty the in-memory pipeline cache of the context is used.
+template<class T>
+BasicFilter<T>::BasicFilter(std::shared_ptr<Context> context, const std::string& shaderPath
+                            , const std::string& pipeCachePath)
+   : context(std::move(context))
+   , pipeCachePath(pipeCachePath)
+   , callerPools(std::make_shared<CallerRegistry>())
+{
+	instance = this->context->instance();
+	debugReportCallback = this->context->debugReportCallback();
+	deviceInfo = this->context->deviceInfo();
+	physDevice = deviceInfo.physDevice;
+	device = this->context->device();
+	compute_queue_familly_id = this->context->queueFamilies().compute;
+	transfer_queue_familly_id = this->context->queueFamilies().transfer;
+	queue = this->context->computeQueue();
+	submitMutex = &queueMutex(queue);
+	if(!elementTypeSupported(instance, physDevice, ElementTraits<T>::type)){
+		throw std::runtime_error(std::string("device does not support ")
+		                         + elementTypeName(ElementTraits<T>::type) + " arrays");
+	}
+	const auto embedded = shaderPath.empty();
+	const auto typedPath = variantPath(embedded ? std::string(EmbeddedShaderName) : shaderPath
+	                                   , ElementTraits<T>::shaderSuffix); // shader.spv -> shader_f64.spv
+	const auto shaderCode = spirvCode(typedPath, embedded);
+	if(!shaderCode.data){
+		throw std::runtime_error("could not load shader " + typedPath);
+	}
+	shader = loadShader(device, shaderCode.data, shaderCode.size);
+	auto shaderHash = hashBytes(shaderCode.data, shaderCode.size);
+	for(auto vecWidth: {2u, 4u}){ // vectorized variants are optional, shader.spv -> shader_vec4.spv
+		const auto code = spirvCode(variantPath(typedPath, "_vec" + std::to_string(vecWidth)), embedded);
+		if(code.data){
+			vectorShaders[vecWidth] = loadShader(device, code.data, code.size);
+			const uint64_t hashes[] = {shaderHash, vecWidth, hashBytes(code.data, code.size)};
+			shaderHash = hashBytes(hashes, sizeof(hashes)); // pipeline cache key covers all variants
+		}
+	}
 
 	dscLayout = createDescriptorSetLayout(device);
-	dscPool = allocDescriptorPool(device);
 	auto commandPoolCI = vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlags(), compute_queue_familly_id);
 	cmdPool = device.createCommandPool(commandPoolCI);
-	pipeCache = device.createPipelineCache(vk::PipelineCacheCreateInfo());
+	pipeCacheKey = pipelineCacheKey(physDevice, shaderHash);
+	pipeCache = pipeCachePath.empty() ? this->context->pipelineCache()
+	                                  : loadPipelineCache(device, pipeCachePath, pipeCacheKey, &pipeCacheLoaded);
 	pipeLayout = createPipelineLayout(device, dscLayout);
 
-	pipe = createComputePipeline(device, shader, pipeLayout, pipeCache);
-	cmdBuffer = vk::CommandBuffer{};
+	pipe = pipelineFor(DefaultWorkgroupSize);
+	if(!pipeCachePath.empty()){
+		workgroupsPath = pipeCachePath + ".workgroups";
+		workgroups.load(workgroupsPath, pipeCacheKey);
+	}
+
+	cacheDscPool = allocDescriptorPool(device, BindingCacheSize
+	                                   , vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
+	cacheCmdPool = device.createCommandPool({vk::CommandPoolCreateFlags(), compute_queue_familly_id});
+	bufferListenerId = deviceResources(device, physDevice).addBufferListener(
+	                                         [this](const vk::Buffer& buf){ invalidate(buf); });
 }
 
-/// Destructor
-ExampleFilter::~ExampleFilter() noexcept {
-	device.destroyPipeline(pipe);
+/// Destructor. The context is destroyed with the last filter attached to it.
+template<class T>
+BasicFilter<T>::~BasicFilter() noexcept {
+	{
+		std::lock_guard<std::mutex> lock(*submitMutex);
+		queue.waitIdle(); // submissions whose completion handles were released without waiting
+	}
+	if(!pipeCachePath.empty()){
+		try {
+			savePipelineCache(device, pipeCache, pipeCachePath, pipeCacheKey);
+		} catch(std::exception& e) { // failing to persist the cache only costs startup time next run
+			std::cerr << "[WARNING]: " << e.what() << "\n";
+		}
+	}
+	deviceResources(device, physDevice).removeBufferListener(bufferListenerId);
+	streamSlots.reset();
+	profiler.reset();
+	device.destroyCommandPool(cacheCmdPool);
+	device.destroyDescriptorPool(cacheDscPool);
+	for(auto& p: pipelines){
+		device.destroyPipeline(p.second);
+	}
 	device.destroyPipelineLayout(pipeLayout);
-	device.destroyPipelineCache(pipeCache);
+	if(!pipeCachePath.empty()){ // otherwise it belongs to the context
+		device.destroyPipelineCache(pipeCache);
+	}
 	device.destroyCommandPool(cmdPool);
-	device.destroyDescriptorPool(dscPool);
+	{
+		std::lock_guard<std::mutex> lock(callerPools->mutex); // threads may be exiting meanwhile
+		callerPools->pools.clear();
+	}
 	device.destroyDescriptorSetLayout(dscLayout);
+	for(auto& s: vectorShaders){
+		device.destroyShaderModule(s.second);
+	}
 	device.destroyShaderModule(shader);
-	device.destroy();
+}
+
+/// Bind parameters for the later run() calls from the calling thread.
+template<class T>
+auto BasicFilter<T>::bindParameters(vk::Buffer& out, const vk::Buffer& in
+                                    , const PushParams& p
+                                   ) const-> void
+{
+	TraceScope scope("bindParameters");
+	const auto wg = workgroupFor(p);
+	const auto vecWidth = vectorWidthFor(p);
+	const auto pipeline = pipelineFor(wg, vecWidth);
+	const auto pools = poolsOfCaller();
+	std::lock_guard<std::mutex> lock(pools->mutex);
+	pools->unbind(); // parameters bound before are replaced
+	auto dscSet = createDescriptorSet(device, pools->dscPool, dscLayout, out, in, vk::DeviceSize(p.width)*p.height);
+	pools->cmdBuffer = createCommandBuffer(device, pools->cmdPool, pipeline, pipeLayout, dscSet, p, wg, vecWidth);
+}
+
+/// Release parameters bound by the calling thread.
+/// Runs on them should be complete by now.
+template<class T>
+auto BasicFilter<T>::unbindParameters() const-> void
+{
+	const auto pools = poolsOfCaller();
+	std::lock_guard<std::mutex> lock(pools->mutex);
+	pools->unbind();
+}
+
+/// run (sync) the filter on previously bound parameters
+template<class T>
+auto BasicFilter<T>::run() const-> void {
+	TraceScope scope("run");
+	run_async().wait();
+}
+
+/// run (async) the filter on parameters previously bound by the calling thread.
+/// @return handle to wait for the run to complete
+template<class T>
+auto BasicFilter<T>::run_async() const-> Completion {
+	const auto pools = poolsOfCaller();
+	auto cmdBuf = vk::CommandBuffer{};
+	{
+		std::lock_guard<std::mutex> lock(pools->mutex);
+		cmdBuf = pools->cmdBuffer;
+	}
+	assert(cmdBuf != vk::CommandBuffer{}); // TODO: this should be a check for a valid command buffer
+	return submit(cmdBuf, [pools]{}); // pools outlive the run even if the thread exits meanwhile
+}
+
+/// run (sync) the filter.
+/// Descriptor set and command buffer recorded for the given parameters are cached
+/// and resubmitted directly when the filter is called again with the same parameters.
+template<class T>
+auto BasicFilter<T>::operator()(vk::Buffer& out, const vk::Buffer& in
+                                , const PushParams& p
+                               ) const-> void
+{
+	TraceScope scope("filter");
+	async(out, in, p).wait();
+}
+
+/// run (sync) the batch of jobs.
+/// All jobs are recorded to a single command buffer and submitted at once.
+/// Jobs are executed in order, pipeline barriers are only inserted between jobs accessing
+/// buffers written by earlier jobs of the batch (or writing buffers read by them).
+template<class T>
+auto BasicFilter<T>::operator()(const std::vector<Job>& jobs) const-> void {
+	TraceScope scope("batch");
+	async(jobs).wait();
+}
+
+/// run (async) the filter.
+/// Several runs may be in flight at the same time, runs accessing the same buffers
+/// are not ordered with respect to each other.
+/// @return handle to wait for the run to complete
+template<class T>
+auto BasicFilter<T>::async(vk::Buffer& out, const vk::Buffer& in
+                           , const PushParams& p
+                           ) const-> Completion
+{
+	std::lock_guard<std::mutex> lock(bindingsMutex); // binding can not be evicted till submitted
+	auto& binding = cachedBinding(out, in, p);
+	binding.pending.erase(std::remove_if(begin(binding.pending), end(binding.pending)
+	                                     , [](const std::shared_ptr<PendingRun>& r){ return r->done(); })
+	                      , end(binding.pending));
+	auto pending = std::make_shared<PendingRun>();
+	binding.pending.push_back(pending);
+	return submit(binding.cmdBuffer, {}, std::move(pending));
+}
 
-	if(debugReportCallback){
-		// unregister callback.
-		auto destroyFn = PFN_vkDestroyDebugReportCallbackEXT(
-					vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT"));
-		if(destroyFn){
-			destroyFn(instance, debugReportCallback, nullptr);
-		} else {
-			std::cerr << "Could not load vkDestroyDebugReportCallbackEXT\n";
+/// run (async) the batch of jobs.
+/// @return handle to wait for the batch to complete
+template<class T>
+auto BasicFilter<T>::async(const std::vector<Job>& jobs) const-> Completion {
+	if(jobs.empty()){
+		return Completion();
+	}
+	const auto pools = poolsOfCaller();
+	auto pool = allocDescriptorPool(device, uint32_t(jobs.size()));
+	auto cmdBuf = vk::CommandBuffer{};
+	{
+		std::lock_guard<std::mutex> lock(pools->mutex);
+		cmdBuf = device.allocateCommandBuffers({pools->cmdPool, vk::CommandBufferLevel::ePrimary, 1})[0];
+		recordBatch(cmdBuf, pool, jobs);
+	}
+	return submit(cmdBuf, [pools, cmdBuf, pool]{ // may run after the filter is gone, pools keep the device
+		std::lock_guard<std::mutex> lock(pools->mutex);
+		pools->device.freeCommandBuffers(pools->cmdPool, {cmdBuf});
+		pools->device.destroyDescriptorPool(pool);
+	});
+}
+
+/// Record the batch of jobs to the command buffer.
+/// Descriptor sets for the jobs are allocated from the given pool.
+template<class T>
+auto BasicFilter<T>::recordBatch(const vk::CommandBuffer& cmdBuf, const vk::DescriptorPool& pool
+                                 , const std::vector<Job>& jobs
+                                 ) const-> void
+{
+	cmdBuf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+	auto written = std::vector<vk::Buffer>{}; // buffers written since the last barrier
+	auto read = std::vector<vk::Buffer>{};    // buffers read since the last barrier
+	auto contains = [](const std::vector<vk::Buffer>& v, const vk::Buffer& b){
+		return std::find(begin(v), end(v), b) != end(v);
+	};
+	for(auto job: jobs){
+		if(contains(written, job.out) || contains(written, job.in) || contains(read, job.out)){
+			auto barrier = vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead
+			                                 , vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+			cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader
+			                       , vk::PipelineStageFlagBits::eComputeShader
+			                       , vk::DependencyFlags(), {barrier}, {}, {});
+			written.clear();
+			read.clear();
 		}
+		auto dscSet = createDescriptorSet(device, pool, dscLayout, job.out, job.in
+		                                  , vk::DeviceSize(job.p.width)*job.p.height);
+		recordDispatch(cmdBuf, dscSet, job.p);
+		written.push_back(job.out);
+		read.push_back(job.in);
 	}
+	cmdBuf.end();
+}
 
-	instance.destroy();
+/// Drop all cached bindings referring to the buffer.
+/// Called automatically before any vuh::Array of the filter device is destroyed,
+/// buffers managed otherwise should be invalidated explicitly before destruction.
+/// Buffers may be destroyed on any thread, so the cache is locked like for the filter runs.
+template<class T>
+auto BasicFilter<T>::invalidate(const vk::Buffer& buf) const-> void {
+	std::lock_guard<std::mutex> lock(bindingsMutex);
+	for(auto it = begin(bindings); it != end(bindings);){
+		auto next = std::next(it);
+		if(it->out == buf || it->in == buf){
+			dropBinding(it);
+		}
+		it = next;
+	}
 }
 
-///
-auto ExampleFilter::bindParameters(vk::Buffer& out, const vk::Buffer& in
-                                   , const ExampleFilter::PushParams& p
-                                  ) const-> void
+/// @return cached binding for the given parameters, created if not in cache.
+/// Least recently used binding is evicted when cache is full.
+/// Push parameters, the saxpy factor included, are recorded to the command buffer and so are part
+/// of the key: calls sweeping over many values of the factor keep evicting bindings and recording
+/// new ones, bound parameters or batches suit them better.
+/// Should be called with the bindingsMutex locked.
+template<class T>
+auto BasicFilter<T>::cachedBinding(vk::Buffer& out, const vk::Buffer& in
+                                   , const PushParams& p
+                                   ) const-> CachedBinding&
 {
-	auto dscSet = createDescriptorSet(device, dscPool, dscLayout, out, in, p.width*p.height);
-	cmdBuffer = createCommandBuffer(device, cmdPool, pipe, pipeLayout, dscSet, p);
+	auto it = std::find_if(begin(bindings), end(bindings), [&](const CachedBinding& b){
+		return b.out == out && b.in == in
+		       && b.p.width == p.width && b.p.height == p.height && b.p.a == p.a;
+	});
+	if(it != end(bindings)){
+		bindings.splice(begin(bindings), bindings, it); // move to front
+		return bindings.front();
+	}
+
+	if(bindings.size() == BindingCacheSize){
+		dropBinding(std::prev(end(bindings)));
+	}
+	auto dscSet = createDescriptorSet(device, cacheDscPool, dscLayout, out, in, vk::DeviceSize(p.width)*p.height);
+	const auto wg = workgroupFor(p);
+	const auto vecWidth = vectorWidthFor(p);
+	auto cmdBuf = createCommandBuffer(device, cacheCmdPool, pipelineFor(wg, vecWidth), pipeLayout, dscSet, p
+	                                  , wg, vecWidth, vk::CommandBufferUsageFlagBits::eSimultaneousUse);
+	bindings.push_front({out, in, p, dscSet, cmdBuf, {}});
+	return bindings.front();
 }
 
-///
-auto ExampleFilter::unbindParameters() const-> void
+/// Release resources of the cached binding and remove it from cache.
+/// Waits for the asynchronous runs of the binding still in flight, other work on the queue is not waited for.
+/// Should be called with the bindingsMutex locked.
+template<class T>
+auto BasicFilter<T>::dropBinding(typename std::list<CachedBinding>::iterator it) const-> void {
+	for(auto& r: it->pending){
+		r->wait(device);
+	}
+	device.freeCommandBuffers(cacheCmdPool, {it->cmdBuffer});
+	device.freeDescriptorSets(cacheDscPool, {it->dscSet});
+	bindings.erase(it);
+}
+
+/// Submit command buffer to the compute queue.
+/// Fence signaling the completion comes from the device fence pool and is returned there
+/// once the completion is observed, together with any other resources released by recycle.
+/// Completion may outlive the filter, so it only refers to what it shares ownership of:
+/// the context (hence the device and its fence pool) and the profiler.
+/// @param pending gets the fence of the submission till its completion is observed, may be null
+/// @return handle to wait for the submission to complete
+template<class T>
+auto BasicFilter<T>::submit(const vk::CommandBuffer& cmdBuf, std::function<void()> recycle
+                            , std::shared_ptr<PendingRun> pending
+                            ) const-> Completion
 {
-	device.destroyDescriptorPool(dscPool);
-	device.resetCommandPool(cmdPool, vk::CommandPoolResetFlags());
-	dscPool = allocDescriptorPool(device);
+	auto& fences = deviceResources(device, physDevice).fences;
+	auto fence = fences.acquire(); // fence makes sure the control is not returned to CPU till command buffer is depleted
+	const auto traced = Trace::enabled();
+	auto prof = (profiling || traced) ? timestamps() : std::shared_ptr<Profiler>{};
+	auto probe = prof ? prof->probe(profiling, traced ? "dispatch" : nullptr) : vuh::Profiler::Probe{};
+	auto cmdBufs = probe ? std::vector<vk::CommandBuffer>{probe.begin, cmdBuf, probe.end} // bracket with timestamps
+	                     : std::vector<vk::CommandBuffer>{cmdBuf};
+	auto submitInfo = vk::SubmitInfo(0, nullptr, nullptr, ARR_VIEW(cmdBufs));
+	{
+		std::lock_guard<std::mutex> lock(*submitMutex);
+		queue.submit({submitInfo}, fence);
+	}
+	if(pending){
+		pending->fence = fence;
+	}
+	return Completion(device, fence, [context = this->context, &fences, recycle, prof, probe
+	                                  , pending](vk::Fence f){
+		if(pending){ // the binding no longer waits on the fence
+			std::lock_guard<std::mutex> lock(pending->mutex);
+			pending->fence = nullptr;
+		}
+		fences.release(f);
+		if(recycle){
+			recycle();
+		}
+		if(prof){
+			prof->complete(probe);
+		}
+	});
 }
 
-/// run (sync) the filter on previously bound parameters
-auto ExampleFilter::run() const-> void {
-	assert(cmdBuffer != vk::CommandBuffer{}); // TODO: this should be a check for a valid command buffer
-	auto submitInfo = vk::SubmitInfo(0, nullptr, nullptr, 1, &cmdBuffer); // submit a single command buffer
+/// Enable or disable timestamps around the filter runs and the device transfers submitted from now on.
+/// Timestamps bracket the whole submission, so device time covers the dispatch (or the batch of them)
+/// and host time adds submission and fence overhead on top of it.
+/// @return true if profiling is enabled, false if it is off or the compute queue does not support timestamps
+template<class T>
+auto BasicFilter<T>::enableProfiling(bool on)-> bool {
+	profiling = on && timestamps();
+	deviceResources(device, physDevice).transfer.enableProfiling(on);
+	return profiling;
+}
+
+/// @return profiler of the compute queue, created on first use and kept since then.
+///         Completions in flight share it and the context it is destroyed on.
+///         Null if the queue does not support timestamps.
+template<class T>
+auto BasicFilter<T>::timestamps() const-> std::shared_ptr<Profiler> {
+	std::call_once(profilerOnce, [this]{
+		if(Profiler::supported(physDevice, compute_queue_familly_id)){
+			profiler = std::shared_ptr<Profiler>(
+			              new Profiler(device, physDevice, compute_queue_familly_id
+			                           , deviceResources(device, physDevice).clock)
+			              , [context = this->context](Profiler* p){ delete p; }); // device outlives the profiler
+		}
+	});
+	return profiler;
+}
+
+/// @return command and descriptor pools of the calling thread, created on its first call
+///         and dropped when the thread exits.
+template<class T>
+auto BasicFilter<T>::poolsOfCaller() const-> std::shared_ptr<CallerPools> {
+	std::lock_guard<std::mutex> lock(callerPools->mutex);
+	auto& pools = callerPools->pools[std::this_thread::get_id()];
+	if(!pools){
+		auto cmdPool = vk::CommandPool{};
+		auto dscPool = vk::DescriptorPool{};
+		try {
+			cmdPool = device.createCommandPool({vk::CommandPoolCreateFlags(), compute_queue_familly_id});
+			dscPool = allocDescriptorPool(device);
+			pools = std::make_shared<CallerPools>(context, cmdPool, dscPool);
+		} catch(...) {
+			device.destroyDescriptorPool(dscPool);
+			device.destroyCommandPool(cmdPool);
+			callerPools->pools.erase(std::this_thread::get_id());
+			throw;
+		}
+		threadCallers.add(callerPools);
+	}
+	return pools;
+}
+
+/// @return device and host times of the filter runs completed since the last call, oldest first.
+/// Timings of the device transfers are taken from deviceResources(device, physDevice).transfer.
+template<class T>
+auto BasicFilter<T>::takeTimings() const-> std::vector<RunTiming> {
+	return profiler ? profiler->takeTimings() : std::vector<RunTiming>{};
+}
+
+/// Find the fastest workgroup size for the size bucket of each of the given frames.
+/// Every candidate shape within the device limits is timed on a frame of that size.
+/// Winners are used by all later runs of the filter and saved to workgroupsPath
+/// (if set), so that filters created later for the same device and shader pick them up.
+/// Parameters bound before tuning keep the workgroup size they were recorded with.
+/// @param frames representative frame sizes, one per bucket from 128x128 to 2048x2048 by default
+/// @param repeats number of dispatches timed per candidate
+template<class T>
+auto BasicFilter<T>::autotune(const std::vector<PushParams>& frames, uint32_t repeats)-> void {
+	using clock = std::chrono::steady_clock;
+	const auto sizes = frames.empty() ? std::vector<PushParams>{{128, 128, Scalar(1)}, {512, 512, Scalar(1)}
+	                                                            , {2048, 2048, Scalar(1)}}
+	                                  : frames;
+	const auto limits = physDevice.getProperties().limits;
+	const auto candidates = workgroupCandidates(limits);
+	for(const auto& p: sizes){
+		// timed on real data, uninitialized memory may hold NaNs and denormals slowing the shader down
+		auto d_y = Array<T>::fromHost(std::vector<T>(p.width*p.height, T(0)), device, physDevice);
+		auto d_x = Array<T>::fromHost(std::vector<T>(p.width*p.height, T(1)), device, physDevice);
+		auto pool = allocDescriptorPool(device);
+		auto dscSet = createDescriptorSet(device, pool, dscLayout, d_y, d_x, vk::DeviceSize(p.width)*p.height);
 
-	// submit the command buffer to the queue and set up a fence.
-	auto queue = device.getQueue(compute_queue_familly_id, 0); // 0 is the queue index in the family, by default just the first one is used
-	auto fence = device.createFence(vk::FenceCreateInfo()); // fence makes sure the control is not returned to CPU till command buffer is depleted
-	queue.submit({submitInfo}, fence);
-	device.waitForFences({fence}, true, uint64_t(-1));      // wait for the fence indefinitely
-	device.destroyFence(fence);
+		const auto vecWidth = vectorWidthFor(p);
+		auto best = DefaultWorkgroupSize;
+		auto bestTime = std::numeric_limits<double>::max();
+		for(const auto& wg: candidates){
+			if(vecWidth == 1 && !coversFrame(wg, p.width, p.height, limits)){
+				continue; // too many workgroups along y to dispatch
+			}
+			auto cmdBuf = device.allocateCommandBuffers({cmdPool, vk::CommandBufferLevel::ePrimary, 1})[0];
+			cmdBuf.begin({});
+			for(uint32_t r = 0; r < repeats; ++r){
+				if(r > 0){
+					auto barrier = vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite
+					                                 , vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+					cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader
+					                       , vk::PipelineStageFlagBits::eComputeShader
+					                       , vk::DependencyFlags(), {barrier}, {}, {});
+				}
+				recordDispatch(cmdBuf, pipelineFor(wg, vecWidth), pipeLayout, dscSet, p, wg, vecWidth);
+			}
+			cmdBuf.end();
+			submit(cmdBuf).wait(); // warm-up, excludes first-use costs from timing
+			const auto start = clock::now();
+			submit(cmdBuf).wait();
+			const auto time = std::chrono::duration<double>(clock::now() - start).count();
+			device.freeCommandBuffers(cmdPool, {cmdBuf});
+			if(time < bestTime){
+				bestTime = time;
+				best = wg;
+			}
+		}
+		device.destroyDescriptorPool(pool);
+		workgroups.set(sizeBucket(p.width, p.height), best);
+	}
+	if(!workgroupsPath.empty()){
+		workgroups.save(workgroupsPath, pipeCacheKey);
+	}
+}
+
+/// Scalar shader is dispatched as a 2D grid of workgroups, so the size tuned for the bucket is
+/// reshaped if it would need more workgroups along y than the device can dispatch.
+/// @return workgroup size to process the frame of given dimensions with
+/// @throw std::runtime_error if no workgroup shape covers the frame in a single dispatch,
+///        see streamGrid() for such frames
+template<class T>
+auto BasicFilter<T>::workgroupFor(const PushParams& p) const-> WorkgroupSize {
+	const auto wg = workgroups.lookup(sizeBucket(p.width, p.height));
+	if(vectorWidthFor(p) > 1 // vectorized variants wrap workgroups in rows
+	   || (div_up(p.width, wg.x) <= MaxGroupCountX && div_up(p.height, wg.y) <= MaxGroupCountX))
+	{
+		return wg;
+	}
+	const auto limits = physDevice.getProperties().limits;
+	const auto fit = fitWorkgroup(wg, p.width, p.height, limits);
+	if(!coversFrame(fit, p.width, p.height, limits)){
+		throw std::runtime_error("frame of " + std::to_string(p.width) + "x" + std::to_string(p.height)
+		                         + " exceeds maxComputeWorkGroupCount");
+	}
+	return fit;
+}
+
+/// Vectorized shader variants process the frame with vec4 (vec2) loads and stores.
+/// These are used for frames which width is a multiple of the vector width, so that every row
+/// starts at a vector boundary.
+/// @return vector width of the shader variant to process the frame of given dimensions with
+template<class T>
+auto BasicFilter<T>::vectorWidthFor(const PushParams& p) const-> uint32_t {
+	for(auto vecWidth: {4u, 2u}){
+		if(vecWidth <= maxVectorWidth && p.width % vecWidth == 0 && vectorShaders.count(vecWidth)){
+			return vecWidth;
+		}
+	}
+	return 1;
 }
 
-/// run (sync) the filter
-auto ExampleFilter::operator()(vk::Buffer& out, const vk::Buffer& in
-                               , const ExampleFilter::PushParams& p
-                              ) const-> void
+/// @return pipeline specialized for the workgroup size, created if not there yet.
+/// Pipelines live as long as the filter, since recorded command buffers may refer to them.
+/// @param vecWidth vector width of the shader variant, 1 for the scalar shader
+template<class T>
+auto BasicFilter<T>::pipelineFor(const WorkgroupSize& wg, uint32_t vecWidth) const-> vk::Pipeline {
+	const auto key = std::make_pair(wg, vecWidth);
+	std::lock_guard<std::mutex> lock(pipelinesMutex);
+	auto it = pipelines.find(key);
+	if(it == pipelines.end()){
+		const auto& module = vecWidth == 1 ? shader : vectorShaders.at(vecWidth);
+		it = pipelines.emplace(key, createComputePipeline(device, module, pipeLayout, pipeCache, wg)).first;
+	}
+	return it->second;
+}
+
+/// Record dispatch of the frame with the workgroup size tuned for its dimensions
+/// and the widest shader variant the frame width allows.
+template<class T>
+auto BasicFilter<T>::recordDispatch(const vk::CommandBuffer& cmdBuf, const vk::DescriptorSet& dscSet
+                                    , const PushParams& p
+                                    ) const-> void
 {
-	bindParameters(out, in, p);
-	run();
-	unbindParameters();
+	const auto wg = workgroupFor(p);
+	const auto vecWidth = vectorWidthFor(p);
+	recordDispatch(cmdBuf, pipelineFor(wg, vecWidth), pipeLayout, dscSet, p, wg, vecWidth);
 }
 
-/// Create vulkan Instance with app specific parameters.
-auto ExampleFilter::createInstance(const std::vector<const char*> layers
-                                  , const std::vector<const char*> extensions
-                                  )-> vk::Instance
+/// Process host frames, y = y + a*x for each frame.
+/// Frames are streamed through the device in a three-stage pipeline: upload of frame N+1,
+/// dispatch of frame N and readback of frame N-1 are in flight at the same time.
+/// When device has a dedicated transfer queue family uploads and readbacks run on it,
+/// concurrently with the dispatches on the compute queue.
+/// @throw std::runtime_error if frame is bigger than a storage buffer may be, see streamGrid() for these
+template<class T>
+auto BasicFilter<T>::stream(const std::vector<Frame>& frames, const PushParams& p) const-> void {
+	TraceScope scope("stream");
+	const auto frameBytes = vk::DeviceSize(p.width)*p.height*sizeof(T);
+	if(frameBytes > physDevice.getProperties().limits.maxStorageBufferRange){
+		throw std::runtime_error("frame of " + std::to_string(frameBytes)
+		                         + " bytes exceeds maxStorageBufferRange");
+	}
+	auto tiles = std::vector<Tile>{};
+	for(const auto& f: frames){
+		tiles.push_back({f.y, f.x, p});
+	}
+	streamTiles(tiles, frameBytes);
+}
+
+/// Process host grid of arbitrary size, y = y + a*x.
+/// The grid is cut into tiles of whole rows, or row segments when a single row does not fit,
+/// which are streamed through the same three-stage pipeline as the frames in stream().
+/// @param budget device-local memory to use for the tiles in flight, bytes.
+///        Same amount of host-visible staging memory is used on top of that.
+/// @throw std::runtime_error if budget is too small to hold a single element per tile
+template<class T>
+auto BasicFilter<T>::streamGrid(T* y, const T* x, const Grid& g, vk::DeviceSize budget
+                                ) const-> void
 {
-	auto appInfo = vk::ApplicationInfo("Example Filter", 0, "no_engine"
-	                                   , 0, VK_API_VERSION_1_0); // The only important field here is apiVersion
-	auto createInfo = vk::InstanceCreateInfo(vk::InstanceCreateFlags(), &appInfo
-	                                         , ARR_VIEW(layers), ARR_VIEW(extensions));
-	return vk::createInstance(createInfo);
+	TraceScope scope("streamGrid");
+	const auto limits = physDevice.getProperties().limits;
+	const auto numElements = g.width*g.height;
+	const auto tileElements = std::min(std::min(budget/(2*NumStreamSlots) // y and x tile per slot
+	                                            , vk::DeviceSize(limits.maxStorageBufferRange))/sizeof(T)
+	                                   , vk::DeviceSize(numElements));
+	if(numElements == 0){
+		return;
+	}
+	if(tileElements == 0){
+		throw std::runtime_error("stream budget of " + std::to_string(budget) + " bytes is too small");
+	}
+
+	// each workgroup covers at least one column and one row, so that limits the tile dimensions
+	const auto maxWidth = vk::DeviceSize(limits.maxComputeWorkGroupCount[0]);
+	const auto maxRows = vk::DeviceSize(limits.maxComputeWorkGroupCount[1]);
+	auto tiles = std::vector<Tile>{};
+	if(g.width <= std::min(maxWidth, tileElements)){ // tiles of whole rows
+		const auto tileRows = std::min(tileElements/g.width, maxRows);
+		for(uint64_t row = 0; row < g.height; row += tileRows){
+			const auto offset = row*g.width;
+			const auto rows = std::min(tileRows, g.height - row);
+			tiles.push_back({y + offset, x + offset, {uint32_t(g.width), uint32_t(rows), g.a}});
+		}
+	} else { // tiles of row segments
+		const auto segment = std::min(tileElements, maxWidth);
+		for(uint64_t row = 0; row < g.height; ++row){
+			for(uint64_t col = 0; col < g.width; col += segment){
+				const auto offset = row*g.width + col;
+				const auto width = std::min(segment, g.width - col);
+				tiles.push_back({y + offset, x + offset, {uint32_t(width), 1u, g.a}});
+			}
+		}
+	}
+	streamTiles(tiles, tileElements*sizeof(T));
+}
+
+namespace vuh {
+	/// Resources of a single tile in flight through the streaming pipeline.
+	struct StreamSlot {
+		vk::Buffer d_y;                ///< device-local in-out tile array
+		vk::Buffer d_x;                ///< device-local input tile array
+		vk::Buffer stage;              ///< host-visible staging buffer, y tile followed by x tile
+		Allocation d_yMem;
+		Allocation d_xMem;
+		Allocation stageMem;
+		vk::DescriptorSet dscSet;      ///< binds d_y and d_x to the shader
+		vk::CommandBuffer upCmd;       ///< host to device copies, transfer queue
+		vk::CommandBuffer computeCmd;  ///< dispatch, compute queue
+		vk::CommandBuffer downCmd;     ///< device to host copy, transfer queue
+		vk::Semaphore uploaded;        ///< orders dispatch after upload
+		vk::Semaphore computed;        ///< orders download after dispatch
+		vk::Fence done;                ///< signaled when download is complete
+		void* y;                       ///< host destination of the tile in flight, nullptr when idle
+		vk::DeviceSize bytes;          ///< size of the tile in flight, bytes
+	};
+
+	/// Buffers, command buffers and sync primitives of the streaming pipeline.
+	/// Kept by the filter between the stream() calls, recreated when a bigger tile is needed.
+	class StreamSlots {
+	public:
+		/// Constructor
+		/// @param tileBytes max size of the single tile array, bytes
+		StreamSlots(const vk::Device& device, const vk::PhysicalDevice& physDev
+		            , const QueueFamilies& families, vk::DeviceSize tileBytes)
+		   : tileBytes(tileBytes)
+		   , computeQueue(device.getQueue(families.compute, 0))
+		   , transferQueue(device.getQueue(families.transfer, 0))
+		   , _device(device)
+		   , _allocator(deviceResources(device, physDev).allocator)
+		{
+			try {
+				init(physDev, families);
+			} catch(...) {
+				release();
+				throw;
+			}
+		}
+
+		StreamSlots(const StreamSlots&) = delete;
+		auto operator=(const StreamSlots&)-> StreamSlots& = delete;
+
+		/// Destructor. Waits for the tiles still in flight, their results are discarded.
+		~StreamSlots() noexcept {
+			for(auto& s: slots){
+				if(s.y){
+					auto fence = VkFence(s.done);
+					vkWaitForFences(_device, 1, &fence, VK_TRUE, uint64_t(-1));
+				}
+			}
+			release();
+		}
+
+		/// Wait for the tile in flight through the slot and copy its result to the host.
+		auto retire(StreamSlot& s)-> void {
+			if(s.y){
+				_device.waitForFences({s.done}, true, uint64_t(-1));
+				_device.resetFences({s.done});
+				_allocator.invalidate(s.stageMem, 0, s.bytes);
+				std::memcpy(s.y, s.stageMem.mapped, size_t(s.bytes));
+				s.y = nullptr;
+			}
+		}
+
+		/// Make the tile written to the slot staging buffer visible to the device.
+		auto flush(StreamSlot& s)-> void {
+			_allocator.flush(s.stageMem, 0, s.bytes);
+			_allocator.flush(s.stageMem, tileBytes, s.bytes);
+		}
+
+		const vk::DeviceSize tileBytes;   ///< max size of the single tile array, bytes
+		std::array<StreamSlot, NumStreamSlots> slots{};
+		vk::DescriptorPool dscPool;   ///< pool of the slots descriptor sets
+		vk::Queue computeQueue;
+		vk::Queue transferQueue;
+	private: // helpers
+		/// Create the slots resources. Whatever was created before a failure is left to release().
+		auto init(const vk::PhysicalDevice& physDev, const QueueFamilies& families)-> void {
+			using Usage = vk::BufferUsageFlagBits;
+			using Props = vk::MemoryPropertyFlagBits;
+			_computePool = _device.createCommandPool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer
+			                                          , families.compute});
+			_transferPool = _device.createCommandPool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer
+			                                           , families.transfer});
+			auto computeCmds = _device.allocateCommandBuffers({_computePool, vk::CommandBufferLevel::ePrimary
+			                                                   , NumStreamSlots});
+			auto transferCmds = _device.allocateCommandBuffers({_transferPool, vk::CommandBufferLevel::ePrimary
+			                                                    , 2*NumStreamSlots});
+			for(uint32_t i = 0; i < NumStreamSlots; ++i){
+				auto& s = slots[i];
+				s.computeCmd = computeCmds[i];
+				s.upCmd = transferCmds[2*i];
+				s.downCmd = transferCmds[2*i + 1];
+				s.d_y = createBuffer(_device, tileBytes
+				                     , Usage::eStorageBuffer | Usage::eTransferSrc | Usage::eTransferDst);
+				s.d_yMem = bind(physDev, s.d_y, Props::eDeviceLocal);
+				s.d_x = createBuffer(_device, tileBytes, Usage::eStorageBuffer | Usage::eTransferDst);
+				s.d_xMem = bind(physDev, s.d_x, Props::eDeviceLocal);
+				s.stage = createBuffer(_device, 2*tileBytes, Usage::eTransferSrc | Usage::eTransferDst);
+				s.stageMem = bind(physDev, s.stage, Props::eHostVisible, Props::eHostCached); // results are read back through it
+				s.uploaded = _device.createSemaphore(vk::SemaphoreCreateInfo());
+				s.computed = _device.createSemaphore(vk::SemaphoreCreateInfo());
+				s.done = _device.createFence(vk::FenceCreateInfo());
+			}
+		}
+
+		/// Destroy whatever resources were created. Slots should not be in flight.
+		auto release() noexcept-> void {
+			for(auto& s: slots){
+				_device.destroyFence(s.done);
+				_device.destroySemaphore(s.computed);
+				_device.destroySemaphore(s.uploaded);
+				_device.destroyBuffer(s.stage);
+				_device.destroyBuffer(s.d_x);
+				_device.destroyBuffer(s.d_y);
+				for(auto m: {&s.stageMem, &s.d_xMem, &s.d_yMem}){
+					if(m->memory){
+						_allocator.free(*m);
+					}
+				}
+			}
+			_device.destroyDescriptorPool(dscPool);
+			_device.destroyCommandPool(_transferPool);
+			_device.destroyCommandPool(_computePool);
+		}
+
+		auto bind(const vk::PhysicalDevice& physDev, const vk::Buffer& buf, vk::MemoryPropertyFlags props
+		          , vk::MemoryPropertyFlags preferred = vk::MemoryPropertyFlags()
+		          )-> Allocation
+		{
+			auto mem = _allocator.alloc(_device.getBufferMemoryRequirements(buf)
+			                            , selectMemory(physDev, _device, buf, props, preferred));
+			try {
+				_device.bindBufferMemory(buf, mem.memory, mem.offset);
+			} catch(...) {
+				_allocator.free(mem);
+				throw;
+			}
+			return mem;
+		}
+	private: // data
+		vk::Device _device;
+		Allocator& _allocator;
+		vk::CommandPool _computePool;   ///< pool of the dispatch command buffers
+		vk::CommandPool _transferPool;  ///< pool of the upload and download command buffers
+	}; // class StreamSlots
+} // namespace vuh
+
+namespace {
+	/// Barrier transferring buffer ownership between queue families.
+	/// Turns into a plain buffer memory barrier when both families are the same.
+	auto ownershipBarrier(const vk::Buffer& buf, vk::AccessFlags srcAccess, vk::AccessFlags dstAccess
+	                      , uint32_t srcFamily, uint32_t dstFamily
+	                      )-> vk::BufferMemoryBarrier
+	{
+		if(srcFamily == dstFamily){
+			srcFamily = dstFamily = VK_QUEUE_FAMILY_IGNORED;
+		}
+		return vk::BufferMemoryBarrier(srcAccess, dstAccess, srcFamily, dstFamily, buf, 0, VK_WHOLE_SIZE);
+	}
+
+	/// Submit a single command buffer optionally waiting for and signaling a semaphore.
+	auto submitTo(const vk::Queue& queue, const vk::CommandBuffer& cmdBuf
+	              , const vk::Semaphore& wait, vk::PipelineStageFlags waitStage
+	              , const vk::Semaphore& signal, const vk::Fence& fence
+	              )-> void
+	{
+		auto submitInfo = vk::SubmitInfo(wait ? 1 : 0, &wait, &waitStage, 1, &cmdBuf
+		                                 , signal ? 1 : 0, &signal);
+		std::lock_guard<std::mutex> lock(queueMutex(queue));
+		queue.submit({submitInfo}, fence);
+	}
+} // namespace
+
+/// Stream tiles through the three-stage pipeline.
+/// @param tileBytes max size of the single tile array, bytes
+template<class T>
+auto BasicFilter<T>::streamTiles(const std::vector<Tile>& tiles, vk::DeviceSize tileBytes) const-> void {
+	const auto qfCompute = compute_queue_familly_id;
+	const auto qfTransfer = transfer_queue_familly_id;
+
+	// slots are cached for the next call, unless another thread is streaming through them right now
+	std::unique_lock<std::mutex> lock(streamMutex, std::try_to_lock);
+	auto ownSlots = std::unique_ptr<StreamSlots>{};
+	auto& slots = lock.owns_lock() ? streamSlots : ownSlots;
+	if(!slots || slots->tileBytes < tileBytes){
+		slots.reset(); // device memory of the old slots may be needed for the new ones
+		slots = std::make_unique<StreamSlots>(device, physDevice, QueueFamilies{qfCompute, qfTransfer}, tileBytes);
+		slots->dscPool = allocDescriptorPool(device, NumStreamSlots);
+		for(auto& slot: slots->slots){
+			slot.dscSet = createDescriptorSet(device, slots->dscPool, dscLayout, slot.d_y, slot.d_x
+			                                  , tileBytes/sizeof(T));
+		}
+	}
+	try {
+		streamThrough(*slots, tiles);
+	} catch(...) { // slots interrupted mid-tile are not reusable
+		slots.reset();
+		throw;
+	}
+}
+
+/// Stream tiles through the slots, retiring each slot before its reuse.
+/// Buffers are owned exclusively by one queue family at a time and handed over between
+/// transfer and compute families with release/acquire barrier pairs, stages are ordered by semaphores.
+template<class T>
+auto BasicFilter<T>::streamThrough(StreamSlots& s, const std::vector<Tile>& tiles) const-> void {
+	using Stage = vk::PipelineStageFlagBits;
+	using Access = vk::AccessFlagBits;
+	const auto qfCompute = compute_queue_familly_id;
+	const auto qfTransfer = transfer_queue_familly_id;
+	const auto tileBytes = s.tileBytes; // offset of the x tile in the staging buffer
+	for(size_t t = 0; t < tiles.size(); ++t){
+		const auto& tile = tiles[t];
+		auto& slot = s.slots[t % NumStreamSlots];
+		s.retire(slot);
+
+		slot.bytes = vk::DeviceSize(tile.p.width)*tile.p.height*sizeof(T);
+		const auto bytes = slot.bytes;
+		std::memcpy(slot.stageMem.mapped, tile.y, size_t(bytes));
+		std::memcpy(static_cast<char*>(slot.stageMem.mapped) + tileBytes, tile.x, size_t(bytes));
+		s.flush(slot);
+
+		// upload, hand over the tile arrays to compute family
+		slot.upCmd.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+		auto yRegion = vk::BufferCopy(0, 0, bytes);
+		auto xRegion = vk::BufferCopy(tileBytes, 0, bytes);
+		slot.upCmd.copyBuffer(slot.stage, slot.d_y, 1, &yRegion);
+		slot.upCmd.copyBuffer(slot.stage, slot.d_x, 1, &xRegion);
+		if(qfCompute != qfTransfer){
+			slot.upCmd.pipelineBarrier(Stage::eTransfer, Stage::eBottomOfPipe, vk::DependencyFlags(), {}
+			        , {ownershipBarrier(slot.d_y, Access::eTransferWrite, {}, qfTransfer, qfCompute)
+			           , ownershipBarrier(slot.d_x, Access::eTransferWrite, {}, qfTransfer, qfCompute)}
+			        , {});
+		}
+		slot.upCmd.end();
+		submitTo(s.transferQueue, slot.upCmd, nullptr, {}, slot.uploaded, nullptr);
+
+		// dispatch, hand over the result array back to transfer family
+		slot.computeCmd.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+		if(qfCompute != qfTransfer){
+			const auto dstAccess = Access::eShaderRead | Access::eShaderWrite;
+			slot.computeCmd.pipelineBarrier(Stage::eComputeShader, Stage::eComputeShader
+			        , vk::DependencyFlags(), {}
+			        , {ownershipBarrier(slot.d_y, {}, dstAccess, qfTransfer, qfCompute)
+			           , ownershipBarrier(slot.d_x, {}, dstAccess, qfTransfer, qfCompute)}
+			        , {});
+		}
+		recordDispatch(slot.computeCmd, slot.dscSet, tile.p);
+		if(qfCompute != qfTransfer){
+			slot.computeCmd.pipelineBarrier(Stage::eComputeShader, Stage::eBottomOfPipe
+			        , vk::DependencyFlags(), {}
+			        , {ownershipBarrier(slot.d_y, Access::eShaderWrite, {}, qfCompute, qfTransfer)}
+			        , {});
+		}
+		slot.computeCmd.end();
+		submitTo(s.computeQueue, slot.computeCmd, slot.uploaded, Stage::eComputeShader, slot.computed, nullptr);
+
+		// download to staging buffer, make it visible to the host
+		slot.downCmd.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+		if(qfCompute != qfTransfer){
+			slot.downCmd.pipelineBarrier(Stage::eTransfer, Stage::eTransfer, vk::DependencyFlags(), {}
+			        , {ownershipBarrier(slot.d_y, {}, Access::eTransferRead, qfCompute, qfTransfer)}
+			        , {});
+		}
+		slot.downCmd.copyBuffer(slot.d_y, slot.stage, 1, &yRegion);
+		slot.downCmd.pipelineBarrier(Stage::eTransfer, Stage::eHost, vk::DependencyFlags(), {}
+		        , {ownershipBarrier(slot.stage, Access::eTransferWrite, Access::eHostRead, qfTransfer, qfTransfer)}
+		        , {});
+		slot.downCmd.end();
+		submitTo(s.transferQueue, slot.downCmd, slot.computed, Stage::eTransfer, nullptr, slot.done);
+		slot.y = tile.y;
+	}
+	for(auto& slot: s.slots){
+		s.retire(slot);
+	}
 }
 
 /// Specify a descriptor set layout (number and types of descriptors).
-auto ExampleFilter::createDescriptorSetLayout(const vk::Device& device)-> vk::DescriptorSetLayout {
+template<class T>
+auto BasicFilter<T>::createDescriptorSetLayout(const vk::Device& device)-> vk::DescriptorSetLayout {
 	auto bindLayout = std::array<vk::DescriptorSetLayoutBinding, NumDescriptors>{{
 	            {0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute}
 	           ,{1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute}
@@ -133,17 +1054,23 @@ auto ExampleFilter::createDescriptorSetLayout(const vk::Device& device)-> vk::De
 }
 
 /// Allocate descriptor pool for a descriptors to all storage buffer in use
-auto ExampleFilter::allocDescriptorPool(const vk::Device& device)-> vk::DescriptorPool {
-	auto descriptorPoolSize = vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, NumDescriptors);
-	auto descriptorPoolCI = vk::DescriptorPoolCreateInfo(vk::DescriptorPoolCreateFlags(), 1
+/// @param maxSets number of descriptor sets to be allocated from the pool
+template<class T>
+auto BasicFilter<T>::allocDescriptorPool(const vk::Device& device, uint32_t maxSets
+                                         , vk::DescriptorPoolCreateFlags flags
+                                         )-> vk::DescriptorPool
+{
+	auto descriptorPoolSize = vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, maxSets*NumDescriptors);
+	auto descriptorPoolCI = vk::DescriptorPoolCreateInfo(flags, maxSets
 	                                                     , 1, &descriptorPoolSize);
 	return device.createDescriptorPool(descriptorPoolCI);
 }
 
 /// Pipeline layout defines shader interface as a set of layout bindings and push constants.
-auto ExampleFilter::createPipelineLayout(const vk::Device& device
-                                         , const vk::DescriptorSetLayout& dscLayout
-                                        )-> vk::PipelineLayout
+template<class T>
+auto BasicFilter<T>::createPipelineLayout(const vk::Device& device
+                                          , const vk::DescriptorSetLayout& dscLayout
+                                         )-> vk::PipelineLayout
 {
 	auto pushConstantsRange = vk::PushConstantRange(vk::ShaderStageFlagBits::eCompute
 	                                                , 0, sizeof(PushParams));
@@ -154,16 +1081,18 @@ auto ExampleFilter::createPipelineLayout(const vk::Device& device
 
 /// Create compute pipeline consisting of a single stage with compute shader.
 /// Specialization constants specialized here.
-auto ExampleFilter::createComputePipeline(const vk::Device& device, const vk::ShaderModule& shader
-                                         , const vk::PipelineLayout& pipeLayout
-                                         , const vk::PipelineCache& cache
-                                         )-> vk::Pipeline
+template<class T>
+auto BasicFilter<T>::createComputePipeline(const vk::Device& device, const vk::ShaderModule& shader
+                                          , const vk::PipelineLayout& pipeLayout
+                                          , const vk::PipelineCache& cache
+                                          , const WorkgroupSize& wg
+                                          )-> vk::Pipeline
 {
 	// specialize constants of the shader
 	auto specEntries = std::array<vk::SpecializationMapEntry, 2>{
 		{{0, 0, sizeof(int)}, {1, 1*sizeof(int), sizeof(int)}}
 	};
-	auto specValues = std::array<int, 2>{WORKGROUP_SIZE, WORKGROUP_SIZE};
+	auto specValues = std::array<int, 2>{int(wg.x), int(wg.y)};
 	auto specInfo = vk::SpecializationInfo(ARR_VIEW(specEntries)
 	                                       , specValues.size()*sizeof(int), specValues.data());
 
@@ -178,16 +1107,17 @@ auto ExampleFilter::createComputePipeline(const vk::Device& device, const vk::Sh
 
 /// Create descriptor set. Actually associate buffers to binding points in bindLayout.
 /// Buffer sizes are specified here as well.
-auto ExampleFilter::createDescriptorSet(const vk::Device& device, const vk::DescriptorPool& pool
-                                       , const vk::DescriptorSetLayout& layout
-                                       , vk::Buffer& out, const vk::Buffer& in, uint32_t size
-                                       )-> vk::DescriptorSet
+template<class T>
+auto BasicFilter<T>::createDescriptorSet(const vk::Device& device, const vk::DescriptorPool& pool
+                                        , const vk::DescriptorSetLayout& layout
+                                        , vk::Buffer& out, const vk::Buffer& in, vk::DeviceSize size
+                                        )-> vk::DescriptorSet
 {
 	auto descriptorSetAI = vk::DescriptorSetAllocateInfo(pool, 1, &layout);
 	auto descriptorSet = device.allocateDescriptorSets(descriptorSetAI)[0];
 
-	auto outInfo = vk::DescriptorBufferInfo(out, 0, sizeof(float)*size);
-	auto inInfo = vk::DescriptorBufferInfo(in, 0, sizeof(float)*size);
+	auto outInfo = vk::DescriptorBufferInfo(out, 0, sizeof(T)*size);
+	auto inInfo = vk::DescriptorBufferInfo(in, 0, sizeof(T)*size);
 
 	auto writeDsSets = std::array<vk::WriteDescriptorSet, NumDescriptors>{{
 	           {descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &outInfo}
@@ -201,12 +1131,15 @@ auto ExampleFilter::createDescriptorSet(const vk::Device& device, const vk::Desc
 /// Create command buffer, push the push constants, bind descriptors and define the work batch size.
 /// All command buffers allocated from given command pool must be submitted to queues of corresponding
 /// family ONLY.
-auto ExampleFilter::createCommandBuffer(const vk::Device& device, const vk::CommandPool& cmdPool
-                                       , const vk::Pipeline& pipeline
-                                       , const vk::PipelineLayout& pipeLayout
-                                       , const vk::DescriptorSet& dscSet
-                                       , const ExampleFilter::PushParams& p
-                                       )-> vk::CommandBuffer
+template<class T>
+auto BasicFilter<T>::createCommandBuffer(const vk::Device& device, const vk::CommandPool& cmdPool
+                                        , const vk::Pipeline& pipeline
+                                        , const vk::PipelineLayout& pipeLayout
+                                        , const vk::DescriptorSet& dscSet
+                                        , const PushParams& p
+                                        , const WorkgroupSize& wg, uint32_t vecWidth
+                                        , vk::CommandBufferUsageFlags usage
+                                        )-> vk::CommandBuffer
 {
 	// allocate a command buffer from the command pool.
 	auto commandBufferAI = vk::CommandBufferAllocateInfo(cmdPool, vk::CommandBufferLevel::ePrimary, 1);
@@ -214,20 +1147,44 @@ auto ExampleFilter::createCommandBuffer(const vk::Device& device, const vk::Comm
 
 	// Start recording commands into the newly allocated command buffer.
 //	auto beginInfo = vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit); // buffer is only submitted and used once
-	auto beginInfo = vk::CommandBufferBeginInfo();
+	auto beginInfo = vk::CommandBufferBeginInfo(usage);
 	commandBuffer.begin(beginInfo);
+	recordDispatch(commandBuffer, pipeline, pipeLayout, dscSet, p, wg, vecWidth);
+	commandBuffer.end(); // end recording commands
+	return commandBuffer;
+}
 
+/// Record pipeline and descriptor set binding, push constants and the dispatch of the compute work
+/// to the command buffer in recording state.
+template<class T>
+auto BasicFilter<T>::recordDispatch(const vk::CommandBuffer& cmdBuf
+                                    , const vk::Pipeline& pipeline
+                                    , const vk::PipelineLayout& pipeLayout
+                                    , const vk::DescriptorSet& dscSet
+                                    , const PushParams& p
+                                    , const WorkgroupSize& wg, uint32_t vecWidth
+                                    )-> void
+{
 	// Before dispatch bind a pipeline, AND a descriptor set.
 	// The validation layer will NOT give warnings if you forget those.
-	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
-	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeLayout
-	                                 , 0, {dscSet}, {});
+	cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+	cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeLayout, 0, {dscSet}, {});
 
-	commandBuffer.pushConstants(pipeLayout, vk::ShaderStageFlagBits::eCompute, 0, ST_VIEW(p));
+	cmdBuf.pushConstants(pipeLayout, vk::ShaderStageFlagBits::eCompute, 0, ST_VIEW(p));
 
 	// Start the compute pipeline, and execute the compute shader.
 	// The number of workgroups is specified in the arguments.
-	commandBuffer.dispatch(div_up(p.width, WORKGROUP_SIZE), div_up(p.height, WORKGROUP_SIZE), 1);
-	commandBuffer.end(); // end recording commands
-	return commandBuffer;
+	if(vecWidth == 1){
+		cmdBuf.dispatch(div_up(p.width, wg.x), div_up(p.height, wg.y), 1);
+	} else { // vectorized variants see the frame as a flat array, workgroups are wrapped in rows
+		const auto groups = div_up(div_up(p.width*p.height, vecWidth), wg.x*wg.y);
+		const auto groupsX = std::min(groups, MaxGroupCountX);
+		cmdBuf.dispatch(groupsX, div_up(groups, groupsX), 1);
+	}
 }
+
+template struct BasicFilter<float>;
+template struct BasicFilter<double>;
+template struct BasicFilter<half>;
+template struct BasicFilter<int32_t>;
+template struct BasicFilter<uint32_t>;
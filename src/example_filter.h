@@ -1,69 +1,201 @@
 #pragma once
 
+#include "context.h"
+#include "device_selection.h"
+#include "element_type.h"
+#include "profiler.h"
 #include "vulkan_helpers.h"
+#include "workgroup_tuning.h"
 
-/// doc me
-struct ExampleFilter {
-	static constexpr auto NumDescriptors = uint32_t(2); ///< number of binding descriptors (array input-output parameters)
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace vuh { class StreamSlots; struct CallerPools; struct CallerRegistry; struct PendingRun; }
+
+/// Saxpy filter on a Vulkan compute device for arrays of T.
+/// Instantiated for float, double, vuh::half, int32_t and uint32_t, each type runs its own shader
+/// variant: saxpy.spv for float, saxpy_f64.spv, saxpy_f16.spv, saxpy_i32.spv and saxpy_u32.spv for the rest.
+/// Shaders are compiled into the binary, a shader file given to the constructor overrides them.
+/// Filter is safe to share between threads. Parameters bound with bindParameters() are per calling
+/// thread, each thread records to its own command and descriptor pools (released when the thread
+/// exits), submissions to the compute queue are serialized.
+template<class T>
+struct BasicFilter {
+	using value_type = T;
+	using Scalar = typename vuh::ElementTraits<T>::Scalar; ///< type of the saxpy factor
+	static constexpr uint32_t NumDescriptors = 2; ///< number of binding descriptors (array input-output parameters)
+	static constexpr uint32_t BindingCacheSize = 64; ///< max number of cached parameter bindings
 	
 	/// C++ mirror of the shader push constants interface
 	struct PushParams {
 		uint32_t width;  ///< frame width
 		uint32_t height; ///< frame height
-		float a;         ///< saxpy (\$ y = y + ax \$) scaling factor
+		Scalar a;        ///< saxpy (\$ y = y + ax \$) scaling factor
 	};
-	
+
+	/// Host-side frame to be streamed through the filter
+	struct Frame {
+		T* y;            ///< in-out array of width*height elements
+		const T* x;      ///< input array of width*height elements
+	};
+
+	/// Host-side frame too big for the device, streamed through it in tiles
+	struct Grid {
+		uint64_t width;  ///< grid width
+		uint64_t height; ///< grid height
+		Scalar a;        ///< saxpy scaling factor
+	};
+
+	static constexpr vk::DeviceSize DefaultStreamBudget = 256u << 20; ///< device memory used by streamGrid, bytes
+
+	/// Single filter invocation within a batch
+	struct Job {
+		vk::Buffer out;  ///< in-out array
+		vk::Buffer in;   ///< input array
+		PushParams p;
+	};
+
+	/// Descriptor set and recorded command buffer for a particular set of filter parameters
+	struct CachedBinding {
+		vk::Buffer out;
+		vk::Buffer in;
+		PushParams p;
+		vk::DescriptorSet dscSet;
+		vk::CommandBuffer cmdBuffer;
+		std::vector<std::shared_ptr<vuh::PendingRun>> pending; ///< asynchronous runs possibly still in flight
+	};
+
 public: // data
-	vk::Instance instance;              ///< Vulkan instance
+	std::shared_ptr<vuh::Context> context; ///< instance and device the filter runs on, may be shared with other filters
+	vk::Instance instance;              ///< Vulkan instance, owned by the context
 	VkDebugReportCallbackEXT debugReportCallback; //
 	vk::PhysicalDevice physDevice;      ///< physical device
-	vk::Device device;                  ///< logical device providing access to a physical one
+	vuh::DeviceCandidate deviceInfo;    ///< description of the physical device and why it was chosen
+	vk::Device device;                  ///< logical device providing access to a physical one, owned by the context
+	vk::Queue queue;                    ///< compute queue the filter work is submitted to
 	vk::ShaderModule shader;            ///< compute shader
+	std::map<uint32_t, vk::ShaderModule> vectorShaders; ///< vectorized variants of the shader by vector width
+	uint32_t maxVectorWidth = 4;        ///< widest vectorized variant to use, 1 to always use the scalar shader
 	vk::DescriptorSetLayout dscLayout;  ///< c++ definition of the shader binding interface
-	mutable vk::DescriptorPool dscPool; ///< descriptors pool
-	vk::CommandPool cmdPool;            ///< used to allocate command buffers
-	vk::PipelineCache pipeCache;        ///< pipeline cache
+	vk::CommandPool cmdPool;            ///< command buffers of the autotune runs
+	vk::PipelineCache pipeCache;        ///< pipeline cache, the context one unless persisted to pipeCachePath
 	vk::PipelineLayout pipeLayout;      ///< defines shader interface as a set of layout bindings and push constants
 	
-	vk::Pipeline pipe;                   ///< pipeline to submit compute commands
-	mutable vk::CommandBuffer cmdBuffer; ///< commands recorded here, once command buffer is submitted to a queue those commands get executed
+	vk::Pipeline pipe;                   ///< pipeline with the default workgroup size
+	mutable std::map<std::pair<vuh::WorkgroupSize, uint32_t>, vk::Pipeline> pipelines; ///< pipelines by workgroup size and vector width, created on first use
 	
 	uint32_t compute_queue_familly_id;   ///< index of the queue family supporting compute loads
+	uint32_t transfer_queue_familly_id;  ///< index of the queue family used for transfers, same as compute if device has no transfer-only family
+	std::string pipeCachePath;           ///< file the pipeline cache is persisted to, empty if not persisted
+	vuh::PipelineCacheKey pipeCacheKey;  ///< identifies device, driver and shader the cache data belongs to
+	bool pipeCacheLoaded = false;        ///< pipeline cache was initialized with the data saved to pipeCachePath
+	std::string workgroupsPath;          ///< file the tuned workgroup sizes are persisted to, empty if not persisted
+	vuh::WorkgroupTable workgroups;      ///< tuned workgroup sizes by frame size bucket
+
+	vk::DescriptorPool cacheDscPool;     ///< descriptor sets of the cached bindings
+	vk::CommandPool cacheCmdPool;        ///< command buffers of the cached bindings
+	mutable std::list<CachedBinding> bindings; ///< cached bindings, most recently used first
+	mutable std::mutex bindingsMutex;    ///< guards the cached bindings and their pools
+	std::shared_ptr<vuh::CallerRegistry> callerPools; ///< pools by calling thread, dropped when the thread exits
+	mutable std::mutex pipelinesMutex;
+	mutable std::unique_ptr<vuh::StreamSlots> streamSlots; ///< buffers of the streaming pipeline, kept for the next stream() call
+	mutable std::mutex streamMutex;      ///< guards streamSlots
+	std::mutex* submitMutex;             ///< serializes access to the compute queue, see vuh::queueMutex
+	size_t bufferListenerId;             ///< id of the listener dropping bindings of destroyed buffers
+	mutable std::shared_ptr<vuh::Profiler> profiler; ///< timestamps around the filter runs, created when profiling or tracing is first used
+	mutable std::once_flag profilerOnce;
+	std::atomic<bool> profiling{false};  ///< profile runs submitted from now on
 public:
-	explicit ExampleFilter(const std::string& shaderPath);
-	~ExampleFilter() noexcept;
+	explicit BasicFilter(const std::string& shaderPath = {}, const std::string& pipeCachePath = {}
+	                     , const vuh::DeviceRequest& deviceRequest = {});
+	explicit BasicFilter(std::shared_ptr<vuh::Context> context, const std::string& shaderPath = {}
+	                     , const std::string& pipeCachePath = {});
+	~BasicFilter() noexcept;
 	
 	auto bindParameters(vk::Buffer& out, const vk::Buffer& in, const PushParams& p) const-> void;
 	auto unbindParameters() const-> void;
 	auto run() const-> void;
+	auto run_async() const-> vuh::Completion;
 	auto operator()(vk::Buffer& out, const vk::Buffer& in, const PushParams& p ) const-> void;
-private: // helpers		
-	static auto createInstance(const std::vector<const char*> layers
-	                           , const std::vector<const char*> extensions
-	                           )-> vk::Instance;
-	
+	auto operator()(const std::vector<Job>& jobs) const-> void;
+	auto async(vk::Buffer& out, const vk::Buffer& in, const PushParams& p) const-> vuh::Completion;
+	auto async(const std::vector<Job>& jobs) const-> vuh::Completion;
+	auto invalidate(const vk::Buffer& buf) const-> void;
+	auto stream(const std::vector<Frame>& frames, const PushParams& p) const-> void;
+	auto streamGrid(T* y, const T* x, const Grid& g, vk::DeviceSize budget = DefaultStreamBudget) const-> void;
+	auto autotune(const std::vector<PushParams>& frames = {}, uint32_t repeats = 8)-> void;
+	auto workgroupFor(const PushParams& p) const-> vuh::WorkgroupSize;
+	auto vectorWidthFor(const PushParams& p) const-> uint32_t;
+	auto enableProfiling(bool on = true)-> bool;
+	auto takeTimings() const-> std::vector<vuh::RunTiming>;
+
+	static auto createComputePipeline(const vk::Device& device, const vk::ShaderModule& shader
+	                                  , const vk::PipelineLayout& pipeLayout
+	                                  , const vk::PipelineCache& cache
+	                                  , const vuh::WorkgroupSize& wg
+	                                  )-> vk::Pipeline;
+private: // helpers
+	/// Part of the host frame streamed through the device as a whole
+	struct Tile {
+		T* y;
+		const T* x;
+		PushParams p;    ///< tile dimensions and saxpy parameter
+	};
+
+	auto streamTiles(const std::vector<Tile>& tiles, vk::DeviceSize tileBytes) const-> void;
+	auto streamThrough(vuh::StreamSlots& slots, const std::vector<Tile>& tiles) const-> void;
+	auto cachedBinding(vk::Buffer& out, const vk::Buffer& in, const PushParams& p) const-> CachedBinding&;
+	auto dropBinding(typename std::list<CachedBinding>::iterator it) const-> void;
+	auto timestamps() const-> std::shared_ptr<vuh::Profiler>;
+	auto poolsOfCaller() const-> std::shared_ptr<vuh::CallerPools>;
+	auto submit(const vk::CommandBuffer& cmdBuf, std::function<void()> recycle = {}
+	            , std::shared_ptr<vuh::PendingRun> pending = {}) const-> vuh::Completion;
+	auto recordBatch(const vk::CommandBuffer& cmdBuf, const vk::DescriptorPool& pool
+	                 , const std::vector<Job>& jobs) const-> void;
+	auto pipelineFor(const vuh::WorkgroupSize& wg, uint32_t vecWidth = 1) const-> vk::Pipeline;
+	auto recordDispatch(const vk::CommandBuffer& cmdBuf, const vk::DescriptorSet& dscSet
+	                    , const PushParams& p) const-> void;
+
 	static auto createDescriptorSetLayout(const vk::Device& device)-> vk::DescriptorSetLayout;
-	static auto allocDescriptorPool(const vk::Device& device)-> vk::DescriptorPool;
+	static auto allocDescriptorPool(const vk::Device& device, uint32_t maxSets = 1
+	                                , vk::DescriptorPoolCreateFlags flags = vk::DescriptorPoolCreateFlags()
+	                                )-> vk::DescriptorPool;
 	
 	static auto createPipelineLayout(const vk::Device& device
 	                                 , const vk::DescriptorSetLayout& dscLayout
 	                                 )-> vk::PipelineLayout;
 	
-	static auto createComputePipeline(const vk::Device& device, const vk::ShaderModule& shader
-	                                  , const vk::PipelineLayout& pipeLayout
-	                                  , const vk::PipelineCache& cache
-	                                  )-> vk::Pipeline;
-	
 	static auto createDescriptorSet(const vk::Device& device, const vk::DescriptorPool& pool
 	                                , const vk::DescriptorSetLayout& layout
 	                                , vk::Buffer& out
 	                                , const vk::Buffer& in
-	                                , uint32_t size
+	                                , vk::DeviceSize size
 	                                )-> vk::DescriptorSet;
 	
 	static auto createCommandBuffer(const vk::Device& device, const vk::CommandPool& cmdPool
 	                                , const vk::Pipeline& pipeline, const vk::PipelineLayout& pipeLayout
 	                                , const vk::DescriptorSet& dscSet
 	                                , const PushParams& p
+	                                , const vuh::WorkgroupSize& wg, uint32_t vecWidth
+	                                , vk::CommandBufferUsageFlags usage = vk::CommandBufferUsageFlags()
 	                                )-> vk::CommandBuffer;
-}; // struct MixpixFilter
+
+	static auto recordDispatch(const vk::CommandBuffer& cmdBuf
+	                           , const vk::Pipeline& pipeline, const vk::PipelineLayout& pipeLayout
+	                           , const vk::DescriptorSet& dscSet
+	                           , const PushParams& p
+	                           , const vuh::WorkgroupSize& wg, uint32_t vecWidth
+	                           )-> void;
+}; // struct BasicFilter
+
+extern template struct BasicFilter<float>;
+extern template struct BasicFilter<double>;
+extern template struct BasicFilter<vuh::half>;
+extern template struct BasicFilter<int32_t>;
+extern template struct BasicFilter<uint32_t>;
+
+using ExampleFilter = BasicFilter<float>;
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "device_resources.h"
+#include "expression_kernels.h"
+#include "vulkan_helpers.hpp"
+
+#include <initializer_list>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/// Elementwise expressions over vuh::Array<float> operands.
+/// Expression is evaluated by a single kernel when assigned to an array,
+///   y = a*x + b*z;
+///   y = clamp(y, lo, hi);
+/// so the whole expression costs one pass over memory.
+/// Kernels are generated per expression shape and cached per device,
+/// scalar values and arrays may change between evaluations without generating a new kernel.
+namespace vuh {
+
+namespace expr {
+	/// Array operand
+	struct ArrayTerm {
+		const Array<float>& array;
+
+		auto emit(ExprProgram& prog) const-> void {
+			prog.code.push_back(ExprProgram::ArrayRef);
+			prog.code.push_back(prog.addArray(array, array.size()));
+		}
+	};
+
+	/// Scalar operand, passed to the kernel as push constant
+	struct ScalarTerm {
+		float value;
+
+		auto emit(ExprProgram& prog) const-> void {
+			prog.code.push_back(ExprProgram::ScalarRef);
+			prog.code.push_back(prog.addScalar(value));
+		}
+	};
+
+	/// Operation applied to the results of its arguments
+	template<ExprProgram::Op op, class... Args>
+	struct Node {
+		std::tuple<Args...> args;
+
+		auto emit(ExprProgram& prog) const-> void {
+			emitArgs(prog, std::index_sequence_for<Args...>{});
+			prog.code.push_back(op);
+		}
+	private:
+		template<size_t... I>
+		auto emitArgs(ExprProgram& prog, std::index_sequence<I...>) const-> void {
+			using expand = int[];
+			(void)expand{0, (std::get<I>(args).emit(prog), 0)...};
+		}
+	};
+
+	inline auto term(const Array<float>& a)-> ArrayTerm { return {a}; }
+
+	template<class T, class = std::enable_if_t<std::is_arithmetic<T>::value>>
+	auto term(T value)-> ScalarTerm { return {float(value)}; }
+
+	template<class E>
+	auto term(const Expr<E>& e)-> const E& { return e.node; }
+
+	template<class T> struct is_array_expr: std::false_type {};
+	template<class E> struct is_array_expr<Expr<E>>: std::true_type {};
+	template<> struct is_array_expr<Array<float>>: std::true_type {};
+
+	template<class T>
+	using is_operand = std::integral_constant<bool, is_array_expr<T>::value || std::is_arithmetic<T>::value>;
+
+	constexpr auto all(std::initializer_list<bool> values)-> bool {
+		for(auto v: values){ if(!v) return false; }
+		return true;
+	}
+
+	constexpr auto any(std::initializer_list<bool> values)-> bool {
+		for(auto v: values){ if(v) return true; }
+		return false;
+	}
+
+	/// Enabled if all arguments are expression operands and at least one of them is an array expression
+	template<class... Args>
+	using enable_if_expr = std::enable_if_t<all({is_operand<Args>::value...})
+	                                        && any({is_array_expr<Args>::value...})>;
+
+	template<ExprProgram::Op op, class... Args>
+	auto make(const Args&... args)-> Expr<Node<op, std::decay_t<decltype(term(args))>...>> {
+		return {{std::make_tuple(term(args)...)}};
+	}
+} // namespace expr
+
+/// Elementwise expression, evaluated when assigned to Array<float>
+template<class E>
+struct Expr {
+	E node;
+};
+
+/// Evaluate the expression into the out array. Blocks till the result is written.
+/// Out array may be an operand of the expression as well.
+/// @throw std::runtime_error if operands differ in size from the out array
+template<class E>
+auto assign(Array<float>& out, const Expr<E>& e)-> void {
+	auto prog = ExprProgram(out, out.size());
+	e.node.emit(prog);
+	deviceResources(out.device(), out.physicalDevice()).expressions.run(prog);
+}
+
+template<class X, class = expr::enable_if_expr<X>>
+auto operator-(const X& x) { return expr::make<ExprProgram::Neg>(x); }
+
+template<class L, class R, class = expr::enable_if_expr<L, R>>
+auto operator+(const L& l, const R& r) { return expr::make<ExprProgram::Add>(l, r); }
+
+template<class L, class R, class = expr::enable_if_expr<L, R>>
+auto operator-(const L& l, const R& r) { return expr::make<ExprProgram::Sub>(l, r); }
+
+template<class L, class R, class = expr::enable_if_expr<L, R>>
+auto operator*(const L& l, const R& r) { return expr::make<ExprProgram::Mul>(l, r); }
+
+template<class L, class R, class = expr::enable_if_expr<L, R>>
+auto operator/(const L& l, const R& r) { return expr::make<ExprProgram::Div>(l, r); }
+
+template<class X, class = expr::enable_if_expr<X>>
+auto abs(const X& x) { return expr::make<ExprProgram::Abs>(x); }
+
+template<class X, class = expr::enable_if_expr<X>>
+auto sqrt(const X& x) { return expr::make<ExprProgram::Sqrt>(x); }
+
+template<class X, class = expr::enable_if_expr<X>>
+auto exp(const X& x) { return expr::make<ExprProgram::Exp>(x); }
+
+template<class L, class R, class = expr::enable_if_expr<L, R>>
+auto min(const L& l, const R& r) { return expr::make<ExprProgram::Min>(l, r); }
+
+template<class L, class R, class = expr::enable_if_expr<L, R>>
+auto max(const L& l, const R& r) { return expr::make<ExprProgram::Max>(l, r); }
+
+template<class X, class Lo, class Hi, class = expr::enable_if_expr<X, Lo, Hi>>
+auto clamp(const X& x, const Lo& lo, const Hi& hi) { return expr::make<ExprProgram::Clamp>(x, lo, hi); }
+
+} // namespace vuh
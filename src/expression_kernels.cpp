@@ -0,0 +1,415 @@
+#include "expression_kernels.h"
+
+#include "vulkan_helpers.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#define ARR_VIEW(x) uint32_t(x.size()), x.data()
+
+namespace vuh {
+
+namespace {
+	constexpr uint32_t LocalSize = 128;        ///< invocations per workgroup, spec-guaranteed minimum of the maximum
+	constexpr uint32_t MaxGroupCountX = 65535; ///< minimal value of maxComputeWorkGroupCount guaranteed by the spec
+
+	/// Push constants of the generated kernels
+	struct KernelParams {
+		uint32_t size;     ///< number of elements in the arrays
+		uint32_t rowSize;  ///< number of invocations in a row of workgroups
+		float scalars[ExprProgram::MaxScalars];
+	};
+
+	/// @return size of the push constants used by the kernel of the expression
+	auto paramsSize(const ExprProgram& prog)-> uint32_t {
+		return uint32_t(offsetof(KernelParams, scalars)
+		                + std::max<size_t>(1, prog.scalars.size())*sizeof(float));
+	}
+
+	/// Subset of SPIR-V enumerants used by the generated kernels
+	namespace spv {
+		enum Op: uint32_t {
+			OpExtInstImport = 11, OpExtInst = 12, OpMemoryModel = 14, OpEntryPoint = 15
+			, OpExecutionMode = 16, OpCapability = 17, OpTypeVoid = 19, OpTypeBool = 20
+			, OpTypeInt = 21, OpTypeFloat = 22, OpTypeVector = 23, OpTypeArray = 28
+			, OpTypeRuntimeArray = 29, OpTypeStruct = 30, OpTypePointer = 32, OpTypeFunction = 33
+			, OpConstant = 43, OpFunction = 54, OpFunctionEnd = 56, OpVariable = 59, OpLoad = 61
+			, OpStore = 62, OpAccessChain = 65, OpDecorate = 71, OpMemberDecorate = 72
+			, OpFNegate = 127, OpIAdd = 128, OpFAdd = 129, OpFSub = 131, OpIMul = 132, OpFMul = 133
+			, OpFDiv = 136, OpULessThan = 176, OpSelectionMerge = 247, OpLabel = 248, OpBranch = 249
+			, OpBranchConditional = 250, OpReturn = 253
+		};
+		constexpr uint32_t Magic = 0x07230203;
+		constexpr uint32_t Version10 = 0x00010000;
+		constexpr uint32_t CapabilityShader = 1;
+		constexpr uint32_t AddressingLogical = 0;
+		constexpr uint32_t MemoryGLSL450 = 1;
+		constexpr uint32_t ModelGLCompute = 5;
+		constexpr uint32_t ModeLocalSize = 17;
+		constexpr uint32_t DecorationBlock = 2;
+		constexpr uint32_t DecorationBufferBlock = 3;
+		constexpr uint32_t DecorationArrayStride = 6;
+		constexpr uint32_t DecorationBuiltIn = 11;
+		constexpr uint32_t DecorationBinding = 33;
+		constexpr uint32_t DecorationDescriptorSet = 34;
+		constexpr uint32_t DecorationOffset = 35;
+		constexpr uint32_t BuiltInGlobalInvocationId = 28;
+		constexpr uint32_t StorageInput = 1;
+		constexpr uint32_t StorageUniform = 2;
+		constexpr uint32_t StoragePushConstant = 9;
+		// GLSL.std.450 extended instructions
+		constexpr uint32_t GlslFAbs = 4;
+		constexpr uint32_t GlslExp = 27;
+		constexpr uint32_t GlslSqrt = 31;
+		constexpr uint32_t GlslFMin = 37;
+		constexpr uint32_t GlslFMax = 40;
+		constexpr uint32_t GlslFClamp = 43;
+	} // namespace spv
+
+	/// Accumulates SPIR-V module words
+	class SpirvWriter {
+	public:
+		auto id()-> uint32_t { return _bound++; }
+
+		auto op(uint32_t opcode, std::initializer_list<uint32_t> operands)-> void {
+			_words.push_back(uint32_t(operands.size() + 1) << 16 | opcode);
+			_words.insert(end(_words), operands);
+		}
+
+		/// Instruction with a literal string operand between the other operands
+		auto op(uint32_t opcode, std::initializer_list<uint32_t> before, const char* str
+		        , const std::vector<uint32_t>& after = {})-> void
+		{
+			auto strWords = std::vector<uint32_t>(std::strlen(str)/4 + 1, 0u); // null-terminated, zero-padded
+			std::memcpy(strWords.data(), str, std::strlen(str));
+			_words.push_back(uint32_t(1 + before.size() + strWords.size() + after.size()) << 16 | opcode);
+			_words.insert(end(_words), before);
+			_words.insert(end(_words), begin(strWords), end(strWords));
+			_words.insert(end(_words), begin(after), end(after));
+		}
+
+		auto module() const-> std::vector<uint32_t> {
+			auto ret = std::vector<uint32_t>{spv::Magic, spv::Version10, 0, _bound, 0};
+			ret.insert(end(ret), begin(_words), end(_words));
+			return ret;
+		}
+	private:
+		std::vector<uint32_t> _words;
+		uint32_t _bound = 1;
+	}; // class SpirvWriter
+} // namespace
+
+constexpr uint32_t ExprProgram::MaxScalars;
+
+/// Constructor
+/// @param out result array
+/// @param size number of elements in the result array
+/// @throw std::runtime_error if size is beyond the 32-bit element index of the kernels
+ExprProgram::ExprProgram(const vk::Buffer& out, size_t size)
+   : arrays{out}, size(uint32_t(size))
+{
+	if(size > std::numeric_limits<uint32_t>::max()){
+		throw std::runtime_error("expression arrays of " + std::to_string(size)
+		                         + " elements exceed the 32-bit kernel index range");
+	}
+}
+
+/// Register array operand. Arrays already registered get the same index.
+/// @return index of the array operand
+/// @throw std::runtime_error if array size differs from the result array size
+auto ExprProgram::addArray(const vk::Buffer& buf, size_t size)-> uint32_t {
+	if(size != this->size){
+		throw std::runtime_error("expression operands differ in size");
+	}
+	const auto it = std::find(begin(arrays), end(arrays), buf);
+	if(it != end(arrays)){
+		return uint32_t(std::distance(begin(arrays), it));
+	}
+	arrays.push_back(buf);
+	return uint32_t(arrays.size() - 1);
+}
+
+/// Register scalar operand.
+/// @return index of the scalar operand
+auto ExprProgram::addScalar(float value)-> uint32_t {
+	if(scalars.size() == MaxScalars){
+		throw std::runtime_error("too many scalar operands in expression");
+	}
+	scalars.push_back(value);
+	return uint32_t(scalars.size() - 1);
+}
+
+/// @return string identifying the expression shape, same for expressions sharing the kernel
+auto ExprProgram::signature() const-> std::string {
+	auto s = std::ostringstream{};
+	s << arrays.size() << ':' << scalars.size() << ':';
+	for(auto c: code){
+		s << c << ',';
+	}
+	return s.str();
+}
+
+/// Generate compute kernel evaluating the expression, out[i] = expr(operands[i]).
+/// Array operand k is bound to binding k of descriptor set 0, scalar operands and the array size
+/// are passed in push constants (see KernelParams).
+/// @return SPIR-V code of the kernel
+auto exprSpirv(const ExprProgram& prog)-> std::vector<uint32_t> {
+	using namespace spv;
+	auto w = SpirvWriter{};
+	const auto numScalars = std::max<uint32_t>(1, uint32_t(prog.scalars.size()));
+
+	const auto glsl = w.id(), main = w.id(), gid = w.id(), pc = w.id();
+	const auto tVoid = w.id(), tFn = w.id(), tBool = w.id(), tUint = w.id(), tFloat = w.id();
+	const auto tUint3 = w.id(), tPtrInUint3 = w.id(), tPtrInUint = w.id();
+	const auto tRtArr = w.id(), tBuf = w.id(), tPtrBuf = w.id(), tPtrFloat = w.id();
+	const auto tScalars = w.id(), tParams = w.id(), tPtrParams = w.id(), tPtrPcUint = w.id(), tPtrPcFloat = w.id();
+	const auto cScalars = w.id();
+	auto c = std::vector<uint32_t>(std::max(3u, numScalars)); // uint constants 0, 1, 2...
+	for(auto& id: c){ id = w.id(); }
+	auto bufs = std::vector<uint32_t>(prog.arrays.size());
+	for(auto& id: bufs){ id = w.id(); }
+
+	w.op(OpCapability, {CapabilityShader});
+	w.op(OpExtInstImport, {glsl}, "GLSL.std.450");
+	w.op(OpMemoryModel, {AddressingLogical, MemoryGLSL450});
+	w.op(OpEntryPoint, {ModelGLCompute, main}, "main", {gid});
+	w.op(OpExecutionMode, {main, ModeLocalSize, LocalSize, 1, 1});
+
+	w.op(OpDecorate, {gid, DecorationBuiltIn, BuiltInGlobalInvocationId});
+	w.op(OpDecorate, {tRtArr, DecorationArrayStride, 4});
+	w.op(OpMemberDecorate, {tBuf, 0, DecorationOffset, 0});
+	w.op(OpDecorate, {tBuf, DecorationBufferBlock});
+	for(uint32_t i = 0; i < bufs.size(); ++i){
+		w.op(OpDecorate, {bufs[i], DecorationDescriptorSet, 0});
+		w.op(OpDecorate, {bufs[i], DecorationBinding, i});
+	}
+	w.op(OpDecorate, {tScalars, DecorationArrayStride, 4});
+	w.op(OpMemberDecorate, {tParams, 0, DecorationOffset, uint32_t(offsetof(KernelParams, size))});
+	w.op(OpMemberDecorate, {tParams, 1, DecorationOffset, uint32_t(offsetof(KernelParams, rowSize))});
+	w.op(OpMemberDecorate, {tParams, 2, DecorationOffset, uint32_t(offsetof(KernelParams, scalars))});
+	w.op(OpDecorate, {tParams, DecorationBlock});
+
+	w.op(OpTypeVoid, {tVoid});
+	w.op(OpTypeFunction, {tFn, tVoid});
+	w.op(OpTypeBool, {tBool});
+	w.op(OpTypeInt, {tUint, 32, 0});
+	w.op(OpTypeFloat, {tFloat, 32});
+	w.op(OpTypeVector, {tUint3, tUint, 3});
+	w.op(OpTypePointer, {tPtrInUint3, StorageInput, tUint3});
+	w.op(OpTypePointer, {tPtrInUint, StorageInput, tUint});
+	w.op(OpTypeRuntimeArray, {tRtArr, tFloat});
+	w.op(OpTypeStruct, {tBuf, tRtArr});
+	w.op(OpTypePointer, {tPtrBuf, StorageUniform, tBuf});
+	w.op(OpTypePointer, {tPtrFloat, StorageUniform, tFloat});
+	for(uint32_t i = 0; i < c.size(); ++i){
+		w.op(OpConstant, {tUint, c[i], i});
+	}
+	w.op(OpConstant, {tUint, cScalars, numScalars});
+	w.op(OpTypeArray, {tScalars, tFloat, cScalars});
+	w.op(OpTypeStruct, {tParams, tUint, tUint, tScalars});
+	w.op(OpTypePointer, {tPtrParams, StoragePushConstant, tParams});
+	w.op(OpTypePointer, {tPtrPcUint, StoragePushConstant, tUint});
+	w.op(OpTypePointer, {tPtrPcFloat, StoragePushConstant, tFloat});
+	w.op(OpVariable, {tPtrInUint3, gid, StorageInput});
+	w.op(OpVariable, {tPtrParams, pc, StoragePushConstant});
+	for(auto b: bufs){
+		w.op(OpVariable, {tPtrBuf, b, StorageUniform});
+	}
+
+	// id = gl_GlobalInvocationID.y*rowSize + gl_GlobalInvocationID.x; if(id < size) out[id] = expr;
+	const auto entry = w.id(), body = w.id(), merge = w.id();
+	w.op(OpFunction, {tVoid, main, 0, tFn});
+	w.op(OpLabel, {entry});
+	const auto pgx = w.id(), gx = w.id(), pgy = w.id(), gy = w.id();
+	const auto pRow = w.id(), row = w.id(), pSize = w.id(), size = w.id();
+	const auto offset = w.id(), id = w.id(), inside = w.id();
+	w.op(OpAccessChain, {tPtrInUint, pgx, gid, c[0]});
+	w.op(OpLoad, {tUint, gx, pgx});
+	w.op(OpAccessChain, {tPtrInUint, pgy, gid, c[1]});
+	w.op(OpLoad, {tUint, gy, pgy});
+	w.op(OpAccessChain, {tPtrPcUint, pRow, pc, c[1]});
+	w.op(OpLoad, {tUint, row, pRow});
+	w.op(OpAccessChain, {tPtrPcUint, pSize, pc, c[0]});
+	w.op(OpLoad, {tUint, size, pSize});
+	w.op(OpIMul, {tUint, offset, gy, row});
+	w.op(OpIAdd, {tUint, id, offset, gx});
+	w.op(OpULessThan, {tBool, inside, id, size});
+	w.op(OpSelectionMerge, {merge, 0});
+	w.op(OpBranchConditional, {inside, body, merge});
+	w.op(OpLabel, {body});
+
+	auto stack = std::vector<uint32_t>{};
+	auto loaded = std::map<uint32_t, uint32_t>{}; // array operand -> id of its value
+	auto pop = [&]{ const auto r = stack.back(); stack.pop_back(); return r; };
+	for(size_t i = 0; i < prog.code.size(); ++i){
+		const auto r = w.id();
+		switch(prog.code[i]){
+		case ExprProgram::ArrayRef: {
+			const auto a = prog.code[++i];
+			if(loaded.count(a)){
+				stack.push_back(loaded[a]);
+				continue;
+			}
+			const auto ptr = w.id();
+			w.op(OpAccessChain, {tPtrFloat, ptr, bufs[a], c[0], id});
+			w.op(OpLoad, {tFloat, r, ptr});
+			loaded[a] = r;
+			break;
+		}
+		case ExprProgram::ScalarRef: {
+			const auto ptr = w.id();
+			w.op(OpAccessChain, {tPtrPcFloat, ptr, pc, c[2], c[prog.code[++i]]});
+			w.op(OpLoad, {tFloat, r, ptr});
+			break;
+		}
+		case ExprProgram::Neg: { const auto x = pop(); w.op(OpFNegate, {tFloat, r, x}); break; }
+		case ExprProgram::Abs: { const auto x = pop(); w.op(OpExtInst, {tFloat, r, glsl, GlslFAbs, x}); break; }
+		case ExprProgram::Sqrt:{ const auto x = pop(); w.op(OpExtInst, {tFloat, r, glsl, GlslSqrt, x}); break; }
+		case ExprProgram::Exp: { const auto x = pop(); w.op(OpExtInst, {tFloat, r, glsl, GlslExp, x}); break; }
+		case ExprProgram::Add: { const auto y = pop(), x = pop(); w.op(OpFAdd, {tFloat, r, x, y}); break; }
+		case ExprProgram::Sub: { const auto y = pop(), x = pop(); w.op(OpFSub, {tFloat, r, x, y}); break; }
+		case ExprProgram::Mul: { const auto y = pop(), x = pop(); w.op(OpFMul, {tFloat, r, x, y}); break; }
+		case ExprProgram::Div: { const auto y = pop(), x = pop(); w.op(OpFDiv, {tFloat, r, x, y}); break; }
+		case ExprProgram::Min: { const auto y = pop(), x = pop(); w.op(OpExtInst, {tFloat, r, glsl, GlslFMin, x, y}); break; }
+		case ExprProgram::Max: { const auto y = pop(), x = pop(); w.op(OpExtInst, {tFloat, r, glsl, GlslFMax, x, y}); break; }
+		case ExprProgram::Clamp: {
+			const auto hi = pop(), lo = pop(), x = pop();
+			w.op(OpExtInst, {tFloat, r, glsl, GlslFClamp, x, lo, hi});
+			break;
+		}
+		default:
+			throw std::logic_error("unknown expression operation");
+		}
+		stack.push_back(r);
+	}
+	if(stack.size() != 1){
+		throw std::logic_error("malformed expression");
+	}
+	const auto pOut = w.id();
+	w.op(OpAccessChain, {tPtrFloat, pOut, bufs[0], c[0], id});
+	w.op(OpStore, {pOut, stack.back()});
+	w.op(OpBranch, {merge});
+	w.op(OpLabel, {merge});
+	w.op(OpReturn, {});
+	w.op(OpFunctionEnd, {});
+	return w.module();
+}
+
+/// Constructor. Vulkan objects are created on first use.
+ExpressionKernels::ExpressionKernels(const vk::Device& device, const vk::PhysicalDevice& physDev
+                                     , uint32_t queueFamilyId, FencePool& fences)
+   : _device(device)
+   , _physDev(physDev)
+   , _queueFamilyId(queueFamilyId)
+   , _queue(device.getQueue(queueFamilyId, 0))
+   , _fences(fences)
+{}
+
+/// Destructor
+ExpressionKernels::~ExpressionKernels() noexcept {
+	for(auto& k: _kernels){
+		_device.destroyDescriptorPool(k.second.dscPool);
+		_device.destroyPipeline(k.second.pipeline);
+		_device.destroyShaderModule(k.second.shader);
+		_device.destroyPipelineLayout(k.second.pipeLayout);
+		_device.destroyDescriptorSetLayout(k.second.dscLayout);
+	}
+	if(_cmdPool){
+		_device.destroyCommandPool(_cmdPool);
+		_device.destroyPipelineCache(_pipeCache);
+	}
+}
+
+/// Evaluate the expression. Blocks till the result array is written.
+/// Descriptor set and command buffer of the kernel are rewritten for each run, runs are serialized.
+auto ExpressionKernels::run(const ExprProgram& prog)-> void {
+	if(prog.size == 0){
+		return;
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+	const auto& k = kernel(prog);
+	const auto dscSet = k.dscSet;
+
+	auto bufInfos = std::vector<vk::DescriptorBufferInfo>{};
+	for(const auto& a: prog.arrays){
+		bufInfos.emplace_back(a, 0, prog.size*sizeof(float));
+	}
+	auto writes = std::vector<vk::WriteDescriptorSet>{};
+	for(uint32_t i = 0; i < bufInfos.size(); ++i){
+		writes.emplace_back(dscSet, i, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufInfos[i]);
+	}
+	_device.updateDescriptorSets(writes, {});
+
+	const auto groups = div_up(prog.size, LocalSize);
+	const auto groupsX = std::min(groups, MaxGroupCountX);
+	auto params = KernelParams{prog.size, groupsX*LocalSize, {}};
+	std::copy(begin(prog.scalars), end(prog.scalars), params.scalars);
+
+	const auto cmdBuf = k.cmdBuf;
+	cmdBuf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit}); // implicitly resets the previous run
+	cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, k.pipeline);
+	cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, k.pipeLayout, 0, {dscSet}, {});
+	cmdBuf.pushConstants(k.pipeLayout, vk::ShaderStageFlagBits::eCompute, 0, paramsSize(prog), &params);
+	cmdBuf.dispatch(groupsX, div_up(groups, groupsX), 1);
+	auto barrier = vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite
+	                                 , vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eHostRead);
+	cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader
+	                       , vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eHost
+	                       , vk::DependencyFlags(), {barrier}, {}, {});
+	cmdBuf.end();
+
+	auto fence = _fences.acquire();
+	auto submitInfo = vk::SubmitInfo(0, nullptr, nullptr, 1, &cmdBuf);
+	{
+		std::lock_guard<std::mutex> lock(queueMutex(_queue));
+		_queue.submit({submitInfo}, fence);
+	}
+	Completion(_device, fence, [this](vk::Fence f){ _fences.release(f); }).wait();
+}
+
+/// @return kernel for the expression, generated if there is none for its signature yet
+auto ExpressionKernels::kernel(const ExprProgram& prog)-> const Kernel& {
+	const auto signature = prog.signature();
+	auto it = _kernels.find(signature);
+	if(it != _kernels.end()){
+		return it->second;
+	}
+	if(prog.arrays.size() > _physDev.getProperties().limits.maxPerStageDescriptorStorageBuffers){
+		throw std::runtime_error("too many array operands in expression");
+	}
+	if(!_cmdPool){
+		_cmdPool = _device.createCommandPool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer
+		                                      , _queueFamilyId});
+		_pipeCache = _device.createPipelineCache(vk::PipelineCacheCreateInfo());
+	}
+
+	auto k = Kernel{};
+	auto bindings = std::vector<vk::DescriptorSetLayoutBinding>{};
+	for(uint32_t i = 0; i < prog.arrays.size(); ++i){
+		bindings.emplace_back(i, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute);
+	}
+	k.dscLayout = _device.createDescriptorSetLayout({vk::DescriptorSetLayoutCreateFlags()
+	                                                 , ARR_VIEW(bindings)});
+	auto pushRange = vk::PushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, paramsSize(prog));
+	k.pipeLayout = _device.createPipelineLayout({vk::PipelineLayoutCreateFlags(), 1, &k.dscLayout
+	                                             , 1, &pushRange});
+	const auto code = exprSpirv(prog);
+	k.shader = _device.createShaderModule({vk::ShaderModuleCreateFlags()
+	                                       , code.size()*sizeof(uint32_t), code.data()});
+	auto stageCI = vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags()
+	                                                 , vk::ShaderStageFlagBits::eCompute, k.shader, "main");
+	k.pipeline = _device.createComputePipeline(_pipeCache
+	                                           , {vk::PipelineCreateFlags(), stageCI, k.pipeLayout}, nullptr);
+	auto poolSize = vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, uint32_t(prog.arrays.size()));
+	k.dscPool = _device.createDescriptorPool({vk::DescriptorPoolCreateFlags(), 1, 1, &poolSize});
+	k.dscSet = _device.allocateDescriptorSets({k.dscPool, 1, &k.dscLayout})[0];
+	k.cmdBuf = _device.allocateCommandBuffers({_cmdPool, vk::CommandBufferLevel::ePrimary, 1})[0];
+	return _kernels.emplace(signature, k).first->second;
+}
+
+} // namespace vuh
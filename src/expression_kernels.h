@@ -0,0 +1,74 @@
+#pragma once
+
+#include "completion.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace vuh {
+
+/// Elementwise expression flattened to postfix form, ready to be turned into a compute kernel.
+/// Operands are referred to by index, so that the same kernel serves all expressions
+/// of the same shape, whatever the arrays and scalar values are.
+struct ExprProgram {
+	/// Operations of the expression. ArrayRef and ScalarRef are followed by the operand index in the code.
+	enum Op: uint32_t { ArrayRef, ScalarRef, Neg, Abs, Sqrt, Exp, Add, Sub, Mul, Div, Min, Max, Clamp };
+
+	static constexpr uint32_t MaxScalars = 30; ///< push constant space guaranteed by the spec is 128 bytes
+
+	ExprProgram(const vk::Buffer& out, size_t size);
+
+	auto addArray(const vk::Buffer& buf, size_t size)-> uint32_t;
+	auto addScalar(float value)-> uint32_t;
+	auto signature() const-> std::string;
+
+	std::vector<uint32_t> code;      ///< operations in postfix order
+	std::vector<vk::Buffer> arrays;  ///< distinct array operands, the first one is the result array
+	std::vector<float> scalars;      ///< scalar operands
+	uint32_t size;                   ///< number of elements in every array operand, fits the 32-bit kernel index
+}; // struct ExprProgram
+
+auto exprSpirv(const ExprProgram& prog)-> std::vector<uint32_t>;
+
+/// Compute kernels generated for elementwise expressions.
+/// Kernels are generated on first use and cached by expression signature.
+class ExpressionKernels {
+public:
+	ExpressionKernels(const vk::Device& device, const vk::PhysicalDevice& physDev
+	                  , uint32_t queueFamilyId, FencePool& fences);
+	~ExpressionKernels() noexcept;
+	ExpressionKernels(const ExpressionKernels&) = delete;
+	auto operator=(const ExpressionKernels&)-> ExpressionKernels& = delete;
+
+	auto run(const ExprProgram& prog)-> void;
+	/// @return number of distinct kernels generated so far
+	auto size() const-> size_t { return _kernels.size(); }
+private: // helpers
+	struct Kernel {
+		vk::DescriptorSetLayout dscLayout;
+		vk::PipelineLayout pipeLayout;
+		vk::ShaderModule shader;
+		vk::Pipeline pipeline;
+		vk::DescriptorPool dscPool;  ///< holds the single descriptor set of the kernel
+		vk::DescriptorSet dscSet;    ///< rewritten with the operands of each run
+		vk::CommandBuffer cmdBuf;    ///< re-recorded for each run
+	};
+
+	auto kernel(const ExprProgram& prog)-> const Kernel&;
+private: // data
+	vk::Device _device;
+	vk::PhysicalDevice _physDev;
+	uint32_t _queueFamilyId;
+	vk::Queue _queue;                          ///< queue kernels are submitted to
+	FencePool& _fences;
+	vk::CommandPool _cmdPool;                  ///< created on first use
+	vk::PipelineCache _pipeCache;              ///< created on first use
+	std::map<std::string, Kernel> _kernels;    ///< kernels by expression signature
+	std::mutex _mutex;
+}; // class ExpressionKernels
+
+} // namespace vuh
@@ -1,6 +1,8 @@
 #include "example_filter.h"
 #include "vulkan_helpers.hpp"
 
+#include <iostream>
+
 auto main(int argc, char* argv[])-> int {
 	const auto width = 90;
 	const auto height = 60;
@@ -9,7 +11,8 @@ auto main(int argc, char* argv[])-> int {
 	auto y = std::vector<float>(width*height, 0.71f);
 	auto x = std::vector<float>(width*height, 0.65f);
 	
-	ExampleFilter f("shaders/saxpy.spv");
+	ExampleFilter f;
+	std::cout << "running on " << f.deviceInfo.name << ", " << f.deviceInfo.reason << "\n";
 	auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice);
 	auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
 
@@ -0,0 +1,214 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace vuh {
+
+namespace {
+#ifdef _WIN32
+	/// @throw std::runtime_error describing the failed operation and the system error code
+	[[noreturn]] auto fail(const std::string& what, const std::string& path, unsigned long err)-> void {
+		throw std::runtime_error(what + " " + path + ": error " + std::to_string(err));
+	}
+#else
+	/// @throw std::runtime_error describing the failed operation and errno
+	[[noreturn]] auto fail(const std::string& what, const std::string& path, int err)-> void {
+		throw std::runtime_error(what + " " + path + ": " + std::strerror(err));
+	}
+#endif
+} // namespace
+
+constexpr size_t MappedFile::ChunkSize;
+
+#ifdef _WIN32
+
+/// Map existing file for reading.
+/// @throw std::runtime_error if file can not be opened or mapped
+MappedFile::MappedFile(const std::string& path): _path(path) {
+	_file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING
+	                      , FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(_file == INVALID_HANDLE_VALUE){
+		fail("failed to open", path, ::GetLastError());
+	}
+	auto size = LARGE_INTEGER{};
+	if(!::GetFileSizeEx(_file, &size)){
+		const auto err = ::GetLastError();
+		::CloseHandle(_file);
+		fail("failed to stat", path, err);
+	}
+	_size = size_t(size.QuadPart);
+	map();
+}
+
+/// Create (or truncate) file of the given size and map it for writing.
+/// @throw std::runtime_error if file can not be created or mapped
+MappedFile::MappedFile(const std::string& path, size_t size)
+   : _path(path), _size(size), _writable(true)
+{
+	_file = ::CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS
+	                      , FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(_file == INVALID_HANDLE_VALUE){
+		fail("failed to create", path, ::GetLastError());
+	}
+	auto end = LARGE_INTEGER{};
+	end.QuadPart = LONGLONG(size);
+	if(!::SetFilePointerEx(_file, end, nullptr, FILE_BEGIN) || !::SetEndOfFile(_file)){
+		const auto err = ::GetLastError();
+		::CloseHandle(_file);
+		fail("failed to resize", path, err);
+	}
+	map();
+}
+
+/// Destructor. Written data is handed over to the system cache, which writes it back.
+MappedFile::~MappedFile() noexcept {
+	if(_data){
+		::UnmapViewOfFile(_data);
+		::CloseHandle(_mapping);
+	}
+	::CloseHandle(_file);
+}
+
+/// Tell the system the range is not needed anymore, so it does not add up to the process footprint.
+/// Written ranges are scheduled for write-back first.
+auto MappedFile::release(size_t offset, size_t size)-> void {
+	const auto last = std::min(offset + size, _size);
+	if(!_data || last <= offset){
+		return;
+	}
+	if(_writable){
+		::FlushViewOfFile(_data + offset, last - offset);
+	}
+	// unlocking pages that are not locked drops them from the working set
+	::VirtualUnlock(_data + offset, last - offset);
+}
+
+/// Map the whole file.
+auto MappedFile::map()-> void {
+	if(_size == 0){
+		return;
+	}
+	_mapping = ::CreateFileMappingA(_file, nullptr, _writable ? PAGE_READWRITE : PAGE_READONLY
+	                                , 0, 0, nullptr);
+	if(!_mapping){
+		const auto err = ::GetLastError();
+		::CloseHandle(_file);
+		fail("failed to map", _path, err);
+	}
+	_data = static_cast<char*>(::MapViewOfFile(_mapping, _writable ? FILE_MAP_WRITE : FILE_MAP_READ
+	                                           , 0, 0, _size));
+	if(!_data){
+		const auto err = ::GetLastError();
+		::CloseHandle(_mapping);
+		::CloseHandle(_file);
+		fail("failed to map", _path, err);
+	}
+}
+
+#else // POSIX
+
+/// Map existing file for reading.
+/// @throw std::runtime_error if file can not be opened or mapped
+MappedFile::MappedFile(const std::string& path): _path(path) {
+	_fd = ::open(path.c_str(), O_RDONLY);
+	if(_fd < 0){
+		fail("failed to open", path, errno);
+	}
+	struct stat st;
+	if(::fstat(_fd, &st) != 0){
+		const auto err = errno;
+		::close(_fd);
+		fail("failed to stat", path, err);
+	}
+	_size = size_t(st.st_size);
+	map();
+}
+
+/// Create (or truncate) file of the given size and map it for writing.
+/// @throw std::runtime_error if file can not be created or mapped
+MappedFile::MappedFile(const std::string& path, size_t size)
+   : _path(path), _size(size), _writable(true)
+{
+	_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(_fd < 0){
+		fail("failed to create", path, errno);
+	}
+	if(::ftruncate(_fd, off_t(size)) != 0){
+		const auto err = errno;
+		::close(_fd);
+		fail("failed to resize", path, err);
+	}
+	map();
+}
+
+/// Destructor. Written data is handed over to the page cache, the kernel writes it back.
+MappedFile::~MappedFile() noexcept {
+	if(_data){
+		::munmap(_data, _size);
+	}
+	::close(_fd);
+}
+
+/// Tell the kernel the range is not needed anymore, so it does not add up to the process footprint.
+/// Written ranges are scheduled for write-back first.
+auto MappedFile::release(size_t offset, size_t size)-> void {
+	const auto page = size_t(::sysconf(_SC_PAGESIZE));
+	const auto first = offset/page*page;   // madvise wants page-aligned start
+	const auto last = std::min(offset + size, _size);
+	if(!_data || last <= first){
+		return;
+	}
+	if(_writable){
+		::msync(_data + first, last - first, MS_ASYNC);
+	} else {
+		::madvise(_data + first, last - first, MADV_DONTNEED);
+	}
+}
+
+/// Map the whole file and advise the kernel it is going to be accessed sequentially.
+/// Read mappings are private and read-only, write mappings are shared.
+auto MappedFile::map()-> void {
+	if(_size == 0){
+		return;
+	}
+	auto ptr = _writable ? ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0)
+	                     : ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	if(ptr == MAP_FAILED){
+		const auto err = errno;
+		::close(_fd);
+		fail("failed to map", _path, err);
+	}
+	_data = static_cast<char*>(ptr);
+	::madvise(_data, _size, MADV_SEQUENTIAL);
+}
+
+#endif // _WIN32
+
+/// Move file in place of the existing one in a single step.
+/// std::rename fails on Windows if the target exists, MoveFileEx replaces it there.
+/// @return true on success
+auto replaceFile(const std::string& from, const std::string& to)-> bool {
+#ifdef _WIN32
+	return ::MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+} // namespace vuh
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace vuh {
+
+/// File mapped to the process address space for sequential streaming.
+/// Read mappings are private and read-only, write mappings are shared, so that data written
+/// through the mapping ends up in the file. Both are advised for sequential access.
+/// Implemented with mmap on POSIX systems and with file mapping objects on Windows.
+class MappedFile {
+public:
+	static constexpr size_t ChunkSize = 64u << 20; ///< granularity files are streamed with, bytes
+
+	explicit MappedFile(const std::string& path);
+	MappedFile(const std::string& path, size_t size);
+	~MappedFile() noexcept;
+	MappedFile(const MappedFile&) = delete;
+	auto operator=(const MappedFile&)-> MappedFile& = delete;
+
+	auto data() const-> char* { return _data; }
+	auto size() const-> size_t { return _size; }
+	auto release(size_t offset, size_t size)-> void;
+private: // helpers
+	auto map()-> void;
+private: // data
+	std::string _path;
+#ifdef _WIN32
+	void* _file = nullptr;     ///< file HANDLE
+	void* _mapping = nullptr;  ///< file mapping HANDLE, null for empty file
+#else
+	int _fd = -1;
+#endif
+	char* _data = nullptr;  ///< start of the mapping, nullptr for empty file
+	size_t _size = 0;       ///< file size, bytes
+	bool _writable = false;
+}; // class MappedFile
+
+auto replaceFile(const std::string& from, const std::string& to)-> bool;
+
+} // namespace vuh
@@ -0,0 +1,119 @@
+#include "multi_device_filter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <future>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+	constexpr double ThroughputSmoothing = 0.3; ///< weight of the latest measurement in the throughput average
+} // namespace
+
+/// Constructor. Creates a logical device per physical device.
+/// @param shaderPath shader file overriding the one compiled into the binary, empty to use the latter
+/// @param deviceIndices indices of the physical devices to use in the instance device list.
+///        When empty all devices supporting compute are used. An index may be repeated
+///        to get several logical devices on the same physical device.
+MultiDeviceFilter::MultiDeviceFilter(const std::string& shaderPath
+                                     , const std::vector<uint32_t>& deviceIndices)
+{
+	if(!deviceIndices.empty()){
+		for(auto i: deviceIndices){
+			_filters.push_back(std::make_unique<ExampleFilter>(shaderPath, std::string{}
+			                                                   , vuh::DeviceRequest{std::to_string(i)}));
+		}
+	} else {
+		auto appInfo = vk::ApplicationInfo("Example Filter", 0, "no_engine", 0, vuh::instanceApiVersion());
+		auto instance = vk::createInstance({vk::InstanceCreateFlags(), &appInfo});
+		for(const auto& c: vuh::rankDevices(instance)){
+			if(c.suitable){
+				_filters.push_back(std::make_unique<ExampleFilter>(shaderPath, std::string{}
+				                                       , vuh::DeviceRequest{std::to_string(c.index)}));
+			}
+		}
+		instance.destroy();
+	}
+	if(_filters.empty()){
+		throw std::runtime_error("no device supporting compute found");
+	}
+	_throughput.assign(_filters.size(), 0.0);
+}
+
+/// Split the frame height to bands proportional to the measured device throughput.
+/// Devices not measured yet are assumed to be as fast as the average measured one.
+/// @return number of rows assigned to each device
+auto MultiDeviceFilter::bands(uint32_t height) const-> std::vector<uint32_t> {
+	auto weights = _throughput;
+	const auto measured = std::count_if(begin(weights), end(weights), [](double w){ return w > 0.0; });
+	const auto mean = measured ? std::accumulate(begin(weights), end(weights), 0.0)/measured : 1.0;
+	for(auto& w: weights){
+		if(w <= 0.0){
+			w = mean;
+		}
+	}
+	const auto total = std::accumulate(begin(weights), end(weights), 0.0);
+
+	auto ret = std::vector<uint32_t>(weights.size());
+	auto assigned = uint32_t(0);
+	for(size_t i = 0; i < weights.size(); ++i){
+		ret[i] = uint32_t(height*weights[i]/total);
+		assigned += ret[i];
+	}
+	// rows lost to rounding go to the fastest devices
+	auto order = std::vector<size_t>(weights.size());
+	std::iota(begin(order), end(order), size_t(0));
+	std::sort(begin(order), end(order), [&](size_t a, size_t b){ return weights[a] > weights[b]; });
+	for(size_t i = 0; assigned < height; i = (i + 1) % order.size(), ++assigned){
+		++ret[order[i]];
+	}
+	return ret;
+}
+
+/// Run the filter on the host frame. Blocks till the results are gathered back to y.
+/// @param y in-out array of p.width*p.height elements
+/// @param x input array of p.width*p.height elements
+auto MultiDeviceFilter::operator()(float* y, const float* x, const ExampleFilter::PushParams& p)-> void {
+	using clock = std::chrono::steady_clock;
+	const auto rows = bands(p.height);
+
+	auto runs = std::vector<std::future<double>>{};
+	auto row = uint32_t(0);
+	for(size_t i = 0; i < _filters.size(); ++i){
+		if(rows[i] == 0){
+			runs.emplace_back();
+			continue;
+		}
+		const auto offset = size_t(row)*p.width;
+		// bands are streamed in tiles, so that these may exceed the storage buffer limits of the device
+		const auto band = ExampleFilter::Grid{p.width, rows[i], p.a};
+		runs.push_back(std::async(std::launch::async, [this, i, y, x, offset, band]{
+			const auto start = clock::now();
+			_filters[i]->streamGrid(y + offset, x + offset, band);
+			return std::chrono::duration<double>(clock::now() - start).count();
+		}));
+		row += rows[i];
+	}
+
+	for(size_t i = 0; i < runs.size(); ++i){
+		if(!runs[i].valid()){
+			continue;
+		}
+		const auto seconds = runs[i].get();
+		if(seconds > 0.0){
+			const auto measured = rows[i]/seconds;
+			_throughput[i] = _throughput[i] > 0.0
+			                 ? (1.0 - ThroughputSmoothing)*_throughput[i] + ThroughputSmoothing*measured
+			                 : measured;
+		}
+	}
+}
+
+/// Run the filter on the host frame held in std::vector-s.
+auto MultiDeviceFilter::operator()(std::vector<float>& y, const std::vector<float>& x
+                                   , const ExampleFilter::PushParams& p)-> void
+{
+	assert(y.size() >= size_t(p.width)*p.height && x.size() >= size_t(p.width)*p.height);
+	(*this)(y.data(), x.data(), p);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "example_filter.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/// Saxpy filter spread over several devices.
+/// Each frame is split into bands of rows, one band per device. Band heights are proportional
+/// to the throughput each device has shown on the previous frames, so that faster devices get
+/// more rows and all devices finish at about the same time.
+/// Bands are processed concurrently, each device streams its band from and to the host frame.
+class MultiDeviceFilter {
+public:
+	explicit MultiDeviceFilter(const std::string& shaderPath = {}
+	                           , const std::vector<uint32_t>& deviceIndices = {});
+
+	auto operator()(float* y, const float* x, const ExampleFilter::PushParams& p)-> void;
+	auto operator()(std::vector<float>& y, const std::vector<float>& x
+	                , const ExampleFilter::PushParams& p)-> void;
+
+	/// @return number of devices the work is spread over
+	auto size() const-> size_t { return _filters.size(); }
+	auto filter(size_t i) const-> const ExampleFilter& { return *_filters[i]; }
+	auto bands(uint32_t height) const-> std::vector<uint32_t>;
+private: // data
+	std::vector<std::unique_ptr<ExampleFilter>> _filters; ///< filter per logical device
+	std::vector<double> _throughput;  ///< smoothed rows per second of each device, 0 if not measured yet
+}; // class MultiDeviceFilter
@@ -0,0 +1,170 @@
+#include "profiler.h"
+
+#include "trace.h"
+
+#include <array>
+
+namespace vuh {
+
+constexpr uint32_t Profiler::Capacity;
+
+/// Constructor.
+/// @param calibratedTimestamps device was created with VK_EXT_calibrated_timestamps enabled
+DeviceClock::DeviceClock(const vk::Device& device, const vk::PhysicalDevice& physDev
+                         , bool calibratedTimestamps)
+   : _period(physDev.getProperties().limits.timestampPeriod)
+{
+	_calibrated = calibratedTimestamps && calibrate(device);
+	_anchored = _calibrated;
+}
+
+/// Take the device and host clocks at the same moment as the origin.
+/// Host clock is CLOCK_MONOTONIC, which steady_clock is on Linux, elsewhere the origin is estimated.
+/// @return false if the clocks could not be calibrated
+auto DeviceClock::calibrate(const vk::Device& device)-> bool {
+#if defined(VK_EXT_calibrated_timestamps) && defined(__linux__)
+	auto getCalibratedTimestamps = PFN_vkGetCalibratedTimestampsEXT(
+	                                  vkGetDeviceProcAddr(VkDevice(device), "vkGetCalibratedTimestampsEXT"));
+	if(!getCalibratedTimestamps){
+		return false;
+	}
+	auto infos = std::array<VkCalibratedTimestampInfoEXT, 2>{};
+	infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+	infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+	infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+	infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+	auto stamps = std::array<uint64_t, 2>{};
+	auto deviation = uint64_t(0);
+	if(getCalibratedTimestamps(VkDevice(device), uint32_t(infos.size()), infos.data()
+	                           , stamps.data(), &deviation) != VK_SUCCESS)
+	{
+		return false;
+	}
+	_originTicks = stamps[0];
+	_originHost = Clock::time_point(std::chrono::duration_cast<Clock::duration>(
+	                                   std::chrono::nanoseconds(stamps[1])));
+	return true;
+#else
+	(void)device;
+	return false;
+#endif
+}
+
+/// @return host clock time of the device timestamp, not earlier than notBefore.
+/// @param shift number of invalid (upper) bits of the timestamps of the queue
+/// @param notBefore submission time of the work the timestamp was written by
+auto DeviceClock::hostTime(uint64_t ticks, uint32_t shift, Clock::time_point notBefore
+                           )-> Clock::time_point
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(!_anchored){
+		_anchored = true;
+		_originTicks = ticks;
+		_originHost = notBefore;
+	}
+	const auto delta = int64_t((ticks - _originTicks) << shift) >> shift; // sign-extend valid bits
+	auto ret = _originHost + std::chrono::duration_cast<Clock::duration>(
+	                            std::chrono::duration<double, std::nano>(double(delta)*_period));
+	if(ret < notBefore){
+		if(!_calibrated){ // the estimated origin was too early
+			_originHost += notBefore - ret;
+		}
+		ret = notBefore;
+	}
+	return ret;
+}
+
+/// Constructor. Records the timestamp command buffers of all slots.
+/// @param clock timestamps mapping shared with the other profilers of the device
+Profiler::Profiler(const vk::Device& device, const vk::PhysicalDevice& physDev, uint32_t queueFamilyId
+                   , std::shared_ptr<DeviceClock> clock)
+   : _device(device)
+   , _queueFamilyId(queueFamilyId)
+   , _period(physDev.getProperties().limits.timestampPeriod)
+   , _clock(std::move(clock))
+   , _queries(device.createQueryPool({vk::QueryPoolCreateFlags(), vk::QueryType::eTimestamp, 2*Capacity}))
+   , _cmdPool(device.createCommandPool({vk::CommandPoolCreateFlags(), queueFamilyId}))
+{
+	const auto validBits = physDev.getQueueFamilyProperties()[queueFamilyId].timestampValidBits;
+	_mask = validBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << validBits) - 1;
+	_shift = validBits >= 64 ? 0 : 64 - validBits;
+	_cmdBuffers = device.allocateCommandBuffers({_cmdPool, vk::CommandBufferLevel::ePrimary, 2*Capacity});
+	for(uint32_t slot = 0; slot < Capacity; ++slot){
+		auto& begin = _cmdBuffers[2*slot];
+		begin.begin(vk::CommandBufferBeginInfo());
+		begin.resetQueryPool(_queries, 2*slot, 2);
+		begin.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, _queries, 2*slot);
+		begin.end();
+		auto& end = _cmdBuffers[2*slot + 1];
+		end.begin(vk::CommandBufferBeginInfo());
+		end.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, _queries, 2*slot + 1);
+		end.end();
+		_free.push_back(Capacity - 1 - slot);
+	}
+}
+
+/// Destructor. All profiled submissions should be complete by now.
+Profiler::~Profiler() noexcept {
+	_device.destroyCommandPool(_cmdPool);
+	_device.destroyQueryPool(_queries);
+}
+
+/// @return true if the queues of the family support timestamps
+auto Profiler::supported(const vk::PhysicalDevice& physDev, uint32_t queueFamilyId)-> bool {
+	return physDev.getQueueFamilyProperties()[queueFamilyId].timestampValidBits > 0;
+}
+
+/// @return timestamp command buffers to submit before and after the profiled work,
+///         empty probe if Capacity submissions are already in flight.
+/// @param timed keep the timing of the submission to be taken by takeTimings()
+/// @param traceName name of the device event added to the Trace, null to not trace the submission
+auto Profiler::probe(bool timed, const char* traceName)-> Probe {
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto ret = Probe{};
+	ret.timed = timed;
+	ret.traceName = traceName;
+	if(!_free.empty()){
+		ret.slot = _free.back();
+		_free.pop_back();
+		ret.begin = _cmdBuffers[2*ret.slot];
+		ret.end = _cmdBuffers[2*ret.slot + 1];
+	}
+	ret.submitted = Clock::now();
+	return ret;
+}
+
+/// Read the timestamps of the completed submission, store its timing and recycle the probe.
+auto Profiler::complete(const Probe& probe)-> void {
+	if(!probe){
+		return;
+	}
+	const auto host = std::chrono::duration<double>(Clock::now() - probe.submitted).count();
+	auto ticks = std::array<uint64_t, 2>{};
+	const auto r = vkGetQueryPoolResults(VkDevice(_device), VkQueryPool(_queries), 2*probe.slot, 2
+	                                     , sizeof(ticks), ticks.data(), sizeof(uint64_t)
+	                                     , VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(r == VK_SUCCESS){
+		const auto elapsed = (ticks[1] - ticks[0]) & _mask;
+		if(probe.timed){
+			_timings.push_back({double(elapsed)*_period*1.e-9, host});
+		}
+		if(probe.traceName){
+			const auto begin = _clock->hostTime(ticks[0], _shift, probe.submitted);
+			const auto duration = std::chrono::duration_cast<Clock::duration>(
+			                         std::chrono::duration<double, std::nano>(double(elapsed)*_period));
+			Trace::record({probe.traceName, begin, duration, _queueFamilyId, true});
+		}
+	}
+	_free.push_back(probe.slot);
+}
+
+/// @return timings of the submissions completed since the last call, oldest first
+auto Profiler::takeTimings()-> std::vector<RunTiming> {
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto ret = std::vector<RunTiming>{};
+	ret.swap(_timings);
+	return ret;
+}
+
+} // namespace vuh
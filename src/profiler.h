@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vuh {
+
+/// Device and host time of a single profiled submission.
+struct RunTiming {
+	double deviceSeconds;  ///< time between the timestamps written before and after the submitted work
+	double hostSeconds;    ///< wall time from the submission till its completion was observed on the host
+};
+
+/// Mapping of the device timestamps to the host clock, one per logical device.
+/// All queues of the device count time in the same domain, so the profilers of the compute
+/// and transfer queues share the clock and their events are ordered against each other.
+/// With VK_EXT_calibrated_timestamps enabled the clock is calibrated once when created.
+/// Otherwise the first timestamp is taken to coincide with its submission and the origin moves
+/// forward whenever a timestamp of any queue would precede its submission.
+class DeviceClock {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	DeviceClock(const vk::Device& device, const vk::PhysicalDevice& physDev, bool calibratedTimestamps);
+	DeviceClock(const DeviceClock&) = delete;
+	auto operator=(const DeviceClock&)-> DeviceClock& = delete;
+
+	auto hostTime(uint64_t ticks, uint32_t shift, Clock::time_point notBefore)-> Clock::time_point;
+private: // helpers
+	auto calibrate(const vk::Device& device)-> bool;
+private: // data
+	double _period;                      ///< nanoseconds per timestamp tick
+	bool _calibrated = false;            ///< origin is measured, not estimated from the submissions
+	bool _anchored = false;              ///< origin is set
+	uint64_t _originTicks = 0;           ///< device timestamp corresponding to _originHost
+	Clock::time_point _originHost;
+	std::mutex _mutex;
+}; // class DeviceClock
+
+/// Timestamp queries around the work submitted to a queue.
+/// Each profiled submission is bracketed by two tiny command buffers writing timestamps
+/// before and after the submitted ones, so that command buffers recorded once and resubmitted
+/// many times (even simultaneously) need not to be re-recorded.
+/// Traced submissions are also added to the Trace timeline as device events, their timestamps
+/// are mapped to the host clock by the DeviceClock shared by all profilers of the device.
+class Profiler {
+public:
+	using Clock = std::chrono::steady_clock;
+	static constexpr uint32_t Capacity = 128; ///< max number of profiled submissions in flight
+
+	/// Timestamp command buffers of a single submission. Empty if all slots are in flight.
+	struct Probe {
+		uint32_t slot = uint32_t(-1);
+		vk::CommandBuffer begin;  ///< resets the slot queries and writes the first timestamp
+		vk::CommandBuffer end;    ///< writes the second timestamp
+		Clock::time_point submitted;
+		bool timed = true;             ///< keep timing of the submission for takeTimings()
+		const char* traceName = nullptr; ///< name of the device trace event, null if not traced
+
+		explicit operator bool() const { return slot != uint32_t(-1); }
+	};
+
+	Profiler(const vk::Device& device, const vk::PhysicalDevice& physDev, uint32_t queueFamilyId
+	         , std::shared_ptr<DeviceClock> clock);
+	~Profiler() noexcept;
+	Profiler(const Profiler&) = delete;
+	auto operator=(const Profiler&)-> Profiler& = delete;
+
+	static auto supported(const vk::PhysicalDevice& physDev, uint32_t queueFamilyId)-> bool;
+
+	auto probe(bool timed = true, const char* traceName = nullptr)-> Probe;
+	auto complete(const Probe& probe)-> void;
+	auto takeTimings()-> std::vector<RunTiming>;
+private: // data
+	vk::Device _device;
+	uint32_t _queueFamilyId;
+	double _period;                      ///< nanoseconds per timestamp tick
+	uint64_t _mask;                      ///< valid bits of the timestamps
+	uint32_t _shift;                     ///< number of invalid (upper) bits of the timestamps
+	std::shared_ptr<DeviceClock> _clock; ///< maps the timestamps to the host clock
+	vk::QueryPool _queries;              ///< two timestamps per slot
+	vk::CommandPool _cmdPool;
+	std::vector<vk::CommandBuffer> _cmdBuffers; ///< begin and end command buffers per slot, recorded once
+	std::vector<uint32_t> _free;         ///< slots not in flight
+	std::vector<RunTiming> _timings;     ///< timings of the completed submissions not yet taken
+	std::mutex _mutex;
+}; // class Profiler
+
+} // namespace vuh
@@ -0,0 +1,103 @@
+#include "staging_ring.h"
+
+#include "vulkan_helpers.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vuh {
+
+constexpr vk::DeviceSize StagingRing::SlotSize;
+constexpr uint32_t StagingRing::NumSlots;
+
+/// Constructor. Does not allocate anything untill the first transfer.
+StagingRing::StagingRing(const vk::Device& device, const vk::PhysicalDevice& physDev
+                         , Allocator& allocator, Transfer& transfer)
+   : _device(device), _physDev(physDev), _allocator(allocator), _transfer(transfer)
+{}
+
+/// Destructor. Waits for all pending copies.
+StagingRing::~StagingRing() noexcept {
+	if(!_buf){
+		return;
+	}
+	for(auto& s: _slots){
+		s.wait();
+	}
+	_device.destroyBuffer(_buf);
+	_allocator.free(_mem);
+}
+
+/// Copy host data to device buffer.
+/// Returns when all data has reached the destination buffer.
+auto StagingRing::upload(vk::Buffer& dst, const void* src, vk::DeviceSize size
+                         , vk::DeviceSize dstOffset
+                         )-> void
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	init();
+	auto bytes = static_cast<const char*>(src);
+	for(vk::DeviceSize off = 0, chunk = 0; off < size; off += SlotSize, ++chunk){
+		const auto i = uint32_t(chunk % NumSlots);
+		_slots[i].wait();
+		const auto n = std::min(SlotSize, size - off);
+		std::memcpy(slotData(i), bytes + off, n);
+		_allocator.flush(_mem, i*SlotSize, n);
+		_slots[i] = _transfer.copy(_buf, dst, n, i*SlotSize, dstOffset + off);
+	}
+	for(auto& s: _slots){
+		s.wait();
+	}
+}
+
+/// Copy device buffer data to host memory.
+/// All chunk copies are put in flight before waiting for the first one, so that
+/// device-side copies of later chunks overlap with host-side copy of the earlier ones.
+auto StagingRing::download(void* dst, const vk::Buffer& src, vk::DeviceSize size
+                           , vk::DeviceSize srcOffset
+                           )-> void
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	init();
+	auto bytes = static_cast<char*>(dst);
+	const auto numChunks = (size + SlotSize - 1)/SlotSize;
+	for(vk::DeviceSize chunk = 0; chunk < std::min<vk::DeviceSize>(numChunks, NumSlots); ++chunk){
+		const auto off = chunk*SlotSize;
+		_slots[chunk] = _transfer.copy(src, _buf, std::min(SlotSize, size - off), srcOffset + off, off);
+	}
+	for(vk::DeviceSize chunk = 0; chunk < numChunks; ++chunk){
+		const auto i = uint32_t(chunk % NumSlots);
+		const auto off = chunk*SlotSize;
+		_slots[i].wait();
+		_allocator.invalidate(_mem, i*SlotSize, std::min(SlotSize, size - off));
+		std::memcpy(bytes + off, slotData(i), std::min(SlotSize, size - off));
+
+		const auto next = chunk + NumSlots;
+		if(next < numChunks){
+			const auto nextOff = next*SlotSize;
+			_slots[i] = _transfer.copy(src, _buf, std::min(SlotSize, size - nextOff)
+			                           , srcOffset + nextOff, i*SlotSize);
+		}
+	}
+}
+
+/// Create and map the ring buffer if not yet there.
+/// Host-cached memory is preferred, downloads read the ring from the host.
+auto StagingRing::init()-> void {
+	if(_buf){
+		return;
+	}
+	_buf = createBuffer(_device, NumSlots*SlotSize
+	                    , vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst);
+	const auto memId = selectMemory(_physDev, _device, _buf, vk::MemoryPropertyFlagBits::eHostVisible
+	                                , vk::MemoryPropertyFlagBits::eHostCached);
+	_mem = _allocator.alloc(_device.getBufferMemoryRequirements(_buf), memId);
+	_device.bindBufferMemory(_buf, _mem.memory, _mem.offset);
+}
+
+/// @return host pointer to the staging memory of i-th slot
+auto StagingRing::slotData(uint32_t i) const-> char* {
+	return static_cast<char*>(_mem.mapped) + i*SlotSize;
+}
+
+} // namespace vuh
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "allocator.h"
+#include "transfer.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <mutex>
+
+namespace vuh {
+
+/// Persistently mapped host-visible buffer used to move data between host and
+/// device-local memory. The ring is split into slots, each tracking the copy in flight
+/// through it. Transfers bigger than a slot are cut into slot-sized chunks, so that host-side
+/// copy of one chunk overlaps with the device copying the previous ones.
+/// The ring is created on the first transfer and reused by all later ones.
+class StagingRing {
+public:
+	static constexpr vk::DeviceSize SlotSize = 4u << 20; ///< size of a single chunk, bytes
+	static constexpr uint32_t NumSlots = 4;              ///< number of chunks in flight
+
+	StagingRing(const vk::Device& device, const vk::PhysicalDevice& physDev
+	            , Allocator& allocator, Transfer& transfer);
+	~StagingRing() noexcept;
+	StagingRing(const StagingRing&) = delete;
+	auto operator=(const StagingRing&)-> StagingRing& = delete;
+
+	auto upload(vk::Buffer& dst, const void* src, vk::DeviceSize size, vk::DeviceSize dstOffset = 0)-> void;
+	auto download(void* dst, const vk::Buffer& src, vk::DeviceSize size, vk::DeviceSize srcOffset = 0)-> void;
+private: // helpers
+	auto init()-> void;
+	auto slotData(uint32_t i) const-> char*;
+private: // data
+	vk::Device _device;
+	vk::PhysicalDevice _physDev;
+	Allocator& _allocator;
+	Transfer& _transfer;
+	vk::Buffer _buf;               ///< ring buffer, NumSlots*SlotSize bytes
+	Allocation _mem;               ///< memory bound to the ring buffer
+	std::array<Completion, NumSlots> _slots; ///< copies in flight through each slot
+	std::mutex _mutex;             ///< transfers through the ring are serialized
+}; // class StagingRing
+
+} // namespace vuh
@@ -0,0 +1,80 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace vuh {
+
+/// Constructor
+/// @param numThreads total number of threads to spread work over, the calling thread included.
+///        When 0 all hardware threads are used.
+ThreadPool::ThreadPool(size_t numThreads) {
+	if(numThreads == 0){
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for(size_t i = 1; i < numThreads; ++i){
+		_threads.emplace_back([this]{ work(); });
+	}
+}
+
+/// Destructor. Tasks already queued are finished first.
+ThreadPool::~ThreadPool() noexcept {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+	for(auto& t: _threads){
+		t.join();
+	}
+}
+
+/// Split [0, n) into contiguous chunks, one per thread, and run body(begin, end) on each.
+/// The calling thread takes the first chunk. Returns when all chunks are done.
+auto ThreadPool::parallelFor(size_t n, const std::function<void(size_t, size_t)>& body)-> void {
+	const auto chunk = (n + size() - 1)/size();
+	const auto numChunks = chunk ? (n + chunk - 1)/chunk : 0;
+	if(numChunks <= 1){
+		body(0, n);
+		return;
+	}
+	auto pending = numChunks - 1;
+	std::condition_variable done;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for(size_t c = 1; c < numChunks; ++c){
+			const auto first = c*chunk;
+			const auto last = std::min(n, first + chunk);
+			_tasks.emplace_back([&, first, last]{
+				body(first, last);
+				std::lock_guard<std::mutex> lock(_mutex);
+				if(--pending == 0){
+					done.notify_one();
+				}
+			});
+		}
+	}
+	_wake.notify_all();
+	body(0, chunk);
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	done.wait(lock, [&]{ return pending == 0; });
+}
+
+/// Worker thread loop
+auto ThreadPool::work()-> void {
+	for(;;){
+		auto task = std::function<void()>{};
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [this]{ return _stop || !_tasks.empty(); });
+			if(_tasks.empty()){
+				return;
+			}
+			task = std::move(_tasks.front());
+			_tasks.pop_front();
+		}
+		task();
+	}
+}
+
+} // namespace vuh
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vuh {
+
+/// Fixed set of worker threads running tasks from a shared queue.
+class ThreadPool {
+public:
+	explicit ThreadPool(size_t numThreads = 0);
+	~ThreadPool() noexcept;
+	ThreadPool(const ThreadPool&) = delete;
+	auto operator=(const ThreadPool&)-> ThreadPool& = delete;
+
+	/// @return number of threads work is spread over, the calling thread included
+	auto size() const-> size_t { return _threads.size() + 1; }
+	auto parallelFor(size_t n, const std::function<void(size_t, size_t)>& body)-> void;
+private: // helpers
+	auto work()-> void;
+private: // data
+	std::vector<std::thread> _threads;
+	std::deque<std::function<void()>> _tasks;
+	std::mutex _mutex;
+	std::condition_variable _wake;   ///< signaled when a task is queued or the pool stops
+	bool _stop = false;
+}; // class ThreadPool
+
+} // namespace vuh
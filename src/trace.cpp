@@ -0,0 +1,106 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+namespace vuh {
+
+constexpr size_t Trace::Capacity;
+std::atomic<bool> Trace::_enabled{false};
+
+namespace {
+	std::mutex traceMutex;
+	std::vector<Trace::Event> traceEvents;    ///< events recorded since the last start
+	Trace::Clock::time_point traceOrigin;     ///< zero of the exported timestamps
+
+	/// @return microseconds of the duration, the unit of the trace-event format
+	auto micros(Trace::Clock::duration d)-> double {
+		return std::chrono::duration<double, std::micro>(d).count();
+	}
+} // namespace
+
+/// Discard the events recorded so far and start recording new ones.
+auto Trace::start()-> void {
+	std::lock_guard<std::mutex> lock(traceMutex);
+	traceEvents.clear();
+	traceOrigin = Clock::now();
+	_enabled = true;
+}
+
+/// Stop recording. Recorded events are kept till the next start.
+/// Scopes entered while tracing was on are still recorded when they exit.
+auto Trace::stop()-> void {
+	_enabled = false;
+}
+
+/// Add event to the timeline.
+auto Trace::record(const Event& e)-> void {
+	std::lock_guard<std::mutex> lock(traceMutex);
+	if(traceEvents.size() < Capacity){
+		traceEvents.push_back(e);
+	}
+}
+
+/// @return recorded events ordered by start time, enclosing events before the nested ones
+auto Trace::events()-> std::vector<Event> {
+	auto ret = std::vector<Event>{};
+	{
+		std::lock_guard<std::mutex> lock(traceMutex);
+		ret = traceEvents;
+	}
+	std::stable_sort(begin(ret), end(ret), [](const Event& a, const Event& b){
+		return a.begin < b.begin || (a.begin == b.begin && a.duration > b.duration);
+	});
+	return ret;
+}
+
+/// @return recorded events in Chrome trace-event format.
+/// Host threads go to the "host" process, device queues (by family index) to the "device" one.
+auto Trace::json()-> std::string {
+	const auto evs = events();
+	auto origin = Clock::time_point();
+	{
+		std::lock_guard<std::mutex> lock(traceMutex);
+		origin = traceOrigin;
+	}
+	std::ostringstream out;
+	out.precision(15);
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+	    << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"host\"}},\n"
+	    << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"device\"}}";
+	for(const auto& e: evs){
+		out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << (e.device ? "device" : "host")
+		    << "\",\"ph\":\"X\",\"ts\":" << micros(e.begin - origin) << ",\"dur\":" << micros(e.duration)
+		    << ",\"pid\":" << (e.device ? 2 : 1) << ",\"tid\":" << e.tid << "}";
+	}
+	out << "\n]}\n";
+	return out.str();
+}
+
+/// Write the recorded events to the file in Chrome trace-event format.
+auto Trace::write(const std::string& path)-> void {
+	std::ofstream out(path);
+	if(!out){
+		throw std::runtime_error("can not open trace file " + path);
+	}
+	out << json();
+}
+
+/// @return small sequential id of the calling thread, stable for the thread lifetime
+auto Trace::threadId()-> uint64_t {
+	static std::atomic<uint64_t> next{0};
+	thread_local const auto id = ++next;
+	return id;
+}
+
+/// Record the scope as a complete host event. Out of memory drops the event.
+auto TraceScope::finish() noexcept-> void {
+	try {
+		Trace::record({_name, _begin, Trace::Clock::now() - _begin, Trace::threadId(), false});
+	} catch(...) {}
+}
+
+} // namespace vuh
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vuh {
+
+/// Opt-in process-wide timeline of host and device events, exported as Chrome trace-event JSON
+/// (opens in Perfetto or chrome://tracing).
+/// Host events are scopes on the calling threads. Device events are the submissions bracketed
+/// with timestamps by the Profiler, mapped to the host clock.
+/// While tracing is off a scope costs a single relaxed atomic load.
+class Trace {
+public:
+	using Clock = std::chrono::steady_clock;
+	static constexpr size_t Capacity = 1u << 20; ///< max number of recorded events, later ones are dropped
+
+	/// Named interval on a host thread or a device queue
+	struct Event {
+		const char* name;         ///< static string
+		Clock::time_point begin;
+		Clock::duration duration;
+		uint64_t tid;             ///< host thread id or device queue family
+		bool device;              ///< event happened on a device queue
+	};
+
+	static auto enabled()-> bool { return _enabled.load(std::memory_order_relaxed); }
+	static auto start()-> void;
+	static auto stop()-> void;
+	static auto record(const Event& e)-> void;
+	static auto events()-> std::vector<Event>;
+	static auto json()-> std::string;
+	static auto write(const std::string& path)-> void;
+	static auto threadId()-> uint64_t;
+private: // data
+	static std::atomic<bool> _enabled;
+}; // class Trace
+
+/// Host event covering the lifetime of the scope object on the current thread.
+class TraceScope {
+public:
+	explicit TraceScope(const char* name)
+	   : _name(Trace::enabled() ? name : nullptr)
+	   , _begin(_name ? Trace::Clock::now() : Trace::Clock::time_point())
+	{}
+	~TraceScope() noexcept {
+		if(_name){
+			finish();
+		}
+	}
+	TraceScope(const TraceScope&) = delete;
+	auto operator=(const TraceScope&)-> TraceScope& = delete;
+private: // helpers
+	auto finish() noexcept-> void;
+private: // data
+	const char* _name;             ///< null if tracing was off when the scope was entered
+	Trace::Clock::time_point _begin;
+}; // class TraceScope
+
+} // namespace vuh
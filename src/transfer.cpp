@@ -0,0 +1,210 @@
+#include "transfer.h"
+
+#include "trace.h"
+
+#include <cassert>
+
+namespace vuh {
+
+/// Command buffers, fences and profiler of the copies.
+/// Completions of the copies hold on to it, so that they can recycle their resources
+/// even when the Transfer is gone.
+struct Transfer::Pools {
+	Pools(const vk::Device& device, uint32_t queueFamilyId);
+	~Pools() noexcept;
+
+	auto release(vk::CommandBuffer cmdBuf)-> void;
+
+	vk::Device device;
+	vk::CommandPool cmdPool;               ///< pool of the copy command buffers
+	std::vector<vk::CommandBuffer> free;   ///< command buffers ready for reuse
+	FencePool fences;
+	std::unique_ptr<Profiler> profiler;    ///< timestamps around each batch, created when profiling or tracing is first used
+	std::mutex mutex;
+}; // struct Transfer::Pools
+
+/// Constructor
+Transfer::Pools::Pools(const vk::Device& device, uint32_t queueFamilyId)
+   : device(device)
+   , cmdPool(device.createCommandPool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer
+                                       | vk::CommandPoolCreateFlagBits::eTransient, queueFamilyId}))
+   , fences(device)
+{}
+
+/// Destructor. Command buffers are freed together with the pool.
+Transfer::Pools::~Pools() noexcept {
+	device.destroyCommandPool(cmdPool);
+}
+
+/// Return command buffer to the pool. It will be implicitly reset when recording starts again.
+auto Transfer::Pools::release(vk::CommandBuffer cmdBuf)-> void {
+	std::lock_guard<std::mutex> lock(mutex);
+	free.push_back(cmdBuf);
+}
+
+/// Constructor. Starts recording to a pooled command buffer.
+Transfer::Batch::Batch(Transfer& transfer)
+   : _transfer(&transfer), _cmdBuf(transfer.acquireCmdBuffer())
+{
+	_cmdBuf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+}
+
+/// Move constructor
+Transfer::Batch::Batch(Batch&& other) noexcept
+   : _transfer(other._transfer), _cmdBuf(other._cmdBuf)
+{
+	other._cmdBuf = nullptr;
+}
+
+/// Destructor. Copies of the batch never submitted are discarded.
+Transfer::Batch::~Batch() noexcept {
+	if(_cmdBuf){
+		_cmdBuf.reset(vk::CommandBufferResetFlags());
+		_transfer->releaseCmdBuffer(_cmdBuf);
+	}
+}
+
+/// Record a copy of size bytes from src buffer to dst buffer.
+auto Transfer::Batch::copy(const vk::Buffer& src, const vk::Buffer& dst, vk::DeviceSize size
+                           , vk::DeviceSize srcOffset, vk::DeviceSize dstOffset
+                           )-> Batch&
+{
+	assert(_cmdBuf); // batch is not yet submitted
+	auto region = vk::BufferCopy(srcOffset, dstOffset, size);
+	_cmdBuf.copyBuffer(src, dst, 1, &region);
+	return *this;
+}
+
+/// Submit all copies recorded to the batch.
+/// @return handle to wait for the copies to complete
+auto Transfer::Batch::submit()-> Completion {
+	auto cmdBuf = _cmdBuf;
+	_cmdBuf = nullptr;
+	return _transfer->submit(cmdBuf);
+}
+
+/// Constructor
+/// @param familyFlags capabilities of the queue family, transfer-only queues can not
+///        synchronize with compute shader stages.
+/// @param clock device timestamps mapping, shared with the compute queue profilers
+Transfer::Transfer(const vk::Device& device, const vk::PhysicalDevice& physDev
+                   , uint32_t queueFamilyId, vk::QueueFlags familyFlags
+                   , std::shared_ptr<DeviceClock> clock)
+   : _device(device)
+   , _physDev(physDev)
+   , _queueFamilyId(queueFamilyId)
+   , _queue(device.getQueue(queueFamilyId, 0))
+   , _queueMutex(queueMutex(_queue))
+   , _dstStages(vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eHost)
+   , _dstAccess(vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite
+                | vk::AccessFlagBits::eHostRead)
+   , _timestamps(Profiler::supported(physDev, queueFamilyId))
+   , _clock(std::move(clock))
+   , _pools(std::make_shared<Pools>(device, queueFamilyId))
+{
+	if(familyFlags & vk::QueueFlagBits::eCompute){
+		_dstStages |= vk::PipelineStageFlagBits::eComputeShader;
+		_dstAccess |= vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+	}
+}
+
+/// Destructor. Waits for all copies in flight.
+/// Pools are released by the last of their completions, if any is still not observed.
+Transfer::~Transfer() noexcept {
+	std::lock_guard<std::mutex> lock(_queueMutex);
+	_queue.waitIdle();
+}
+
+/// Enable or disable timestamps around each batch of copies submitted from now on.
+/// @return true if profiling is enabled, false if it is off or the queue does not support timestamps
+auto Transfer::enableProfiling(bool on)-> bool {
+	std::lock_guard<std::mutex> lock(_pools->mutex);
+	_profiling = on && _timestamps;
+	if(_profiling){
+		createProfiler();
+	}
+	return _profiling;
+}
+
+/// @return device and host times of the batches completed since the last call, empty if not profiling
+auto Transfer::takeTimings()-> std::vector<RunTiming> {
+	std::lock_guard<std::mutex> lock(_pools->mutex);
+	return _pools->profiler ? _pools->profiler->takeTimings() : std::vector<RunTiming>{};
+}
+
+/// Create the profiler if not yet there. It is kept once created, completions in flight may refer to it.
+/// Should be called with the pools mutex locked.
+auto Transfer::createProfiler()-> void {
+	if(!_pools->profiler){
+		_pools->profiler = std::make_unique<Profiler>(_device, _physDev, _queueFamilyId, _clock);
+	}
+}
+
+/// Start new batch of copies.
+auto Transfer::batch()-> Batch {
+	return Batch(*this);
+}
+
+/// Submit single buffer copy.
+auto Transfer::copy(const vk::Buffer& src, const vk::Buffer& dst, vk::DeviceSize size
+                    , vk::DeviceSize srcOffset, vk::DeviceSize dstOffset
+                    )-> Completion
+{
+	return batch().copy(src, dst, size, srcOffset, dstOffset).submit();
+}
+
+/// @return command buffer from the pool ready for recording
+auto Transfer::acquireCmdBuffer()-> vk::CommandBuffer {
+	std::lock_guard<std::mutex> lock(_pools->mutex);
+	auto& free = _pools->free;
+	if(free.empty()){
+		return _device.allocateCommandBuffers({_pools->cmdPool, vk::CommandBufferLevel::ePrimary, 1})[0];
+	}
+	auto ret = free.back();
+	free.pop_back();
+	return ret;
+}
+
+/// Return command buffer to the pool. It will be implicitly reset when recording starts again.
+auto Transfer::releaseCmdBuffer(vk::CommandBuffer cmdBuf)-> void {
+	_pools->release(cmdBuf);
+}
+
+/// Finish recording and submit the command buffer.
+/// A trailing barrier makes copy results visible to later accesses on the queue and from the host.
+auto Transfer::submit(vk::CommandBuffer cmdBuf)-> Completion {
+	auto barrier = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, _dstAccess);
+	cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, _dstStages
+	                       , vk::DependencyFlags(), {barrier}, {}, {});
+	cmdBuf.end();
+
+	auto fence = _pools->fences.acquire();
+	const auto traced = Trace::enabled() && _timestamps;
+	auto profiler = static_cast<Profiler*>(nullptr);
+	auto timed = false;
+	{
+		std::lock_guard<std::mutex> lock(_pools->mutex);
+		if(traced){
+			createProfiler();
+		}
+		timed = _profiling;
+		profiler = (timed || traced) ? _pools->profiler.get() : nullptr;
+	}
+	auto probe = profiler ? profiler->probe(timed, traced ? "copy" : nullptr) : Profiler::Probe{};
+	auto cmdBufs = probe ? std::vector<vk::CommandBuffer>{probe.begin, cmdBuf, probe.end}
+	                     : std::vector<vk::CommandBuffer>{cmdBuf};
+	auto submitInfo = vk::SubmitInfo(0, nullptr, nullptr, uint32_t(cmdBufs.size()), cmdBufs.data());
+	{
+		std::lock_guard<std::mutex> lock(_queueMutex);
+		_queue.submit({submitInfo}, fence);
+	}
+	return Completion(_device, fence, [pools = _pools, cmdBuf, profiler, probe](vk::Fence f){
+		pools->fences.release(f);
+		pools->release(cmdBuf);
+		if(profiler){
+			profiler->complete(probe);
+		}
+	});
+}
+
+} // namespace vuh
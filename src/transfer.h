@@ -0,0 +1,74 @@
+#pragma once
+
+#include "completion.h"
+#include "profiler.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vuh {
+
+/// Asynchronous buffer copies on a device queue.
+/// Copies are recorded to pooled command buffers and signal pooled fences,
+/// the caller gets a Completion handle to wait on.
+/// Copied data is made available to all later commands submitted to the same queue.
+/// Commands on other queues should be ordered after the copies by waiting on the Completion
+/// or with semaphores.
+/// Completions of the copies may outlive the Transfer, the pools they recycle to are kept alive
+/// till the last of them is done.
+class Transfer {
+public:
+	/// Group of copies recorded to a single command buffer and submitted at once.
+	class Batch {
+	public:
+		explicit Batch(Transfer& transfer);
+		Batch(Batch&& other) noexcept;
+		~Batch() noexcept;
+		Batch(const Batch&) = delete;
+		auto operator=(const Batch&)-> Batch& = delete;
+
+		auto copy(const vk::Buffer& src, const vk::Buffer& dst, vk::DeviceSize size
+		          , vk::DeviceSize srcOffset = 0, vk::DeviceSize dstOffset = 0)-> Batch&;
+		auto submit()-> Completion;
+	private: // data
+		Transfer* _transfer;
+		vk::CommandBuffer _cmdBuf;  ///< null once the batch is submitted
+	}; // class Batch
+
+	Transfer(const vk::Device& device, const vk::PhysicalDevice& physDev
+	         , uint32_t queueFamilyId, vk::QueueFlags familyFlags
+	         , std::shared_ptr<DeviceClock> clock);
+	~Transfer() noexcept;
+	Transfer(const Transfer&) = delete;
+	auto operator=(const Transfer&)-> Transfer& = delete;
+
+	auto batch()-> Batch;
+	auto copy(const vk::Buffer& src, const vk::Buffer& dst, vk::DeviceSize size
+	          , vk::DeviceSize srcOffset = 0, vk::DeviceSize dstOffset = 0)-> Completion;
+	auto queueFamilyId() const-> uint32_t { return _queueFamilyId; }
+	auto enableProfiling(bool on = true)-> bool;
+	auto takeTimings()-> std::vector<RunTiming>;
+private: // helpers
+	auto acquireCmdBuffer()-> vk::CommandBuffer;
+	auto releaseCmdBuffer(vk::CommandBuffer cmdBuf)-> void;
+	auto submit(vk::CommandBuffer cmdBuf)-> Completion;
+	auto createProfiler()-> void;
+private: // data
+	struct Pools;                           ///< resources recycled by the completions
+	vk::Device _device;
+	vk::PhysicalDevice _physDev;
+	uint32_t _queueFamilyId;                ///< family of the queue copies are submitted to
+	vk::Queue _queue;                       ///< queue copies are submitted to
+	std::mutex& _queueMutex;                ///< serializes access to the queue, which may be shared with compute work
+	vk::PipelineStageFlags _dstStages;      ///< stages of later commands on the queue waiting for the copy results
+	vk::AccessFlags _dstAccess;             ///< accesses of later commands the copy results are made visible to
+	bool _timestamps;                       ///< queue supports timestamps
+	std::shared_ptr<DeviceClock> _clock;    ///< maps the batch timestamps to the host clock
+	bool _profiling = false;                ///< profile new batches, guarded by the pools mutex
+	std::shared_ptr<Pools> _pools;          ///< shared with the completions in flight
+}; // class Transfer
+
+} // namespace vuh
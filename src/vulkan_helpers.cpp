@@ -1,8 +1,15 @@
 #include "vulkan_helpers.h"
 #include "vulkan_helpers.hpp"
+#include "device_resources.h"
+#include "mapped_file.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <random>
 
 using std::begin;
 using std::end;
@@ -11,6 +18,39 @@ using std::end;
 
 namespace vuh {
 
+namespace {
+	constexpr uint32_t PipelineCacheMagic = 0x50454356;  ///< 'VCEP' in little endian
+	constexpr uint32_t PipelineCacheFormat = 1;          ///< bump when the layout of the header changes
+
+	/// Header prepended to the driver pipeline cache blob stored on disk.
+	struct PipelineCacheFileHeader {
+		uint32_t magic;
+		uint32_t format;
+		uint32_t vendorId;
+		uint32_t deviceId;
+		uint32_t driverVersion;
+		uint8_t  uuid[VK_UUID_SIZE];
+		uint64_t shaderHash;
+		uint64_t dataSize;
+		uint64_t dataHash;
+	};
+
+	/// Check the header Vulkan itself puts in front of the cache data against the device key.
+	auto isValidCacheData(const std::vector<char>& data, const PipelineCacheKey& key)-> bool {
+		constexpr auto vkHeaderSize = 16 + VK_UUID_SIZE;
+		if(data.size() < vkHeaderSize){
+			return false;
+		}
+		uint32_t fields[4];
+		std::memcpy(fields, data.data(), sizeof(fields));
+		return fields[0] >= vkHeaderSize
+		       && fields[1] == uint32_t(VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+		       && fields[2] == key.vendorId
+		       && fields[3] == key.deviceId
+		       && std::memcmp(data.data() + 16, key.uuid.data(), VK_UUID_SIZE) == 0;
+	}
+} // namespace
+
 VKAPI_ATTR VkBool32 VKAPI_CALL debugReporter(
       VkDebugReportFlagsEXT , VkDebugReportObjectTypeEXT, uint64_t, size_t, int32_t
       , const char*                pLayerPrefix
@@ -22,15 +62,18 @@ VKAPI_ATTR VkBool32 VKAPI_CALL debugReporter(
 }
 
 /// Read binary shader file into array of uint32_t. little endian assumed.
-/// Padded by 0s to a boundary of 4.
+/// Padded by 0s to a boundary of 4. The file is read with a single call, its size is known upfront.
 auto readShaderSrc(const char* filename)-> std::vector<char> {
-	auto fin = std::ifstream(filename, std::ios::binary);
+	auto fin = std::ifstream(filename, std::ios::binary | std::ios::ate);
 	if(!fin.is_open()){
 		throw std::runtime_error(std::string("could not open file ") + filename);
 	}
-	auto ret = std::vector<char>(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
-	
-	ret.resize(4*div_up(ret.size(), size_t(4)));
+	const auto size = size_t(fin.tellg());
+	auto ret = std::vector<char>(4*div_up(size, size_t(4)));
+	fin.seekg(0);
+	if(!fin.read(ret.data(), std::streamsize(size))){
+		throw std::runtime_error(std::string("could not read file ") + filename);
+	}
 	return ret;
 }
 
@@ -39,12 +82,143 @@ auto loadShader(const vk::Device& device, const char* filename
                 , vk::ShaderModuleCreateFlags flags
                 )-> vk::ShaderModule
 {
-	auto code = readShaderSrc(filename);
-	auto shaderCI = vk::ShaderModuleCreateInfo(flags, code.size()
-	                                           , reinterpret_cast<uint32_t*>(code.data()));
+	return loadShader(device, readShaderSrc(filename), flags);
+}
+
+/// create shader module from spir-v code already in memory
+auto loadShader(const vk::Device& device, const std::vector<char>& code
+                , vk::ShaderModuleCreateFlags flags
+                )-> vk::ShaderModule
+{
+	return loadShader(device, reinterpret_cast<const uint32_t*>(code.data()), code.size(), flags);
+}
+
+/// create shader module from spir-v code in memory, e.g. compiled into the binary.
+/// @param size code size, bytes
+auto loadShader(const vk::Device& device, const uint32_t* code, size_t size
+                , vk::ShaderModuleCreateFlags flags
+                )-> vk::ShaderModule
+{
+	auto shaderCI = vk::ShaderModuleCreateInfo(flags, size, code);
 	return device.createShaderModule(shaderCI);
 }
 
+/// 64-bit FNV-1a hash of a byte range. Not cryptographic, only used to detect changed or damaged data.
+auto hashBytes(const void* data, size_t size)-> uint64_t {
+	auto ret = uint64_t(14695981039346656037ull);
+	auto bytes = static_cast<const uint8_t*>(data);
+	for(size_t i = 0; i < size; ++i){
+		ret ^= bytes[i];
+		ret *= 1099511628211ull;
+	}
+	return ret;
+}
+
+/// @return key identifying pipeline cache data produced by the given device for the given shader.
+auto pipelineCacheKey(const vk::PhysicalDevice& physDev, uint64_t shaderHash)-> PipelineCacheKey {
+	auto props = physDev.getProperties();
+	auto ret = PipelineCacheKey{props.vendorID, props.deviceID, props.driverVersion, {}, shaderHash};
+	std::copy(std::begin(props.pipelineCacheUUID), std::end(props.pipelineCacheUUID), ret.uuid.data());
+	return ret;
+}
+
+/// Create pipeline cache initialized with the data previously saved to the given path.
+/// Data saved for a different device, driver or shader, as well as truncated or damaged files
+/// are silently ignored and an empty cache is created instead.
+/// @param loaded if not null set to whether the cache was initialized with the saved data
+auto loadPipelineCache(const vk::Device& device, const std::string& path
+                       , const PipelineCacheKey& key
+                       , bool* loaded
+                       )-> vk::PipelineCache
+{
+	if(loaded){
+		*loaded = false;
+	}
+	auto data = std::vector<char>{};
+	auto fin = std::ifstream(path, std::ios::binary);
+	auto header = PipelineCacheFileHeader{};
+	if(fin.read(reinterpret_cast<char*>(&header), sizeof(header))
+	   && header.magic == PipelineCacheMagic
+	   && header.format == PipelineCacheFormat
+	   && header.vendorId == key.vendorId
+	   && header.deviceId == key.deviceId
+	   && header.driverVersion == key.driverVersion
+	   && std::equal(ALL(key.uuid), header.uuid)
+	   && header.shaderHash == key.shaderHash
+	   && header.dataSize < (uint64_t(1) << 31))
+	{
+		data.resize(header.dataSize);
+		if(!fin.read(data.data(), std::streamsize(data.size()))
+		   || hashBytes(data.data(), data.size()) != header.dataHash
+		   || !isValidCacheData(data, key))
+		{
+			data.clear();
+		}
+	}
+
+	if(!data.empty()){
+		try {
+			auto ret = device.createPipelineCache({vk::PipelineCacheCreateFlags(), data.size(), data.data()});
+			if(loaded){
+				*loaded = true;
+			}
+			return ret;
+		} catch(vk::SystemError&) { // driver refused the data, start from scratch
+			std::cerr << "[WARNING]: pipeline cache " << path << " rejected by the driver" "\n";
+		}
+	}
+	return device.createPipelineCache(vk::PipelineCacheCreateInfo());
+}
+
+/// Save pipeline cache data to the given path.
+/// Data is written to a temporary file first and then moved in place, so that concurrently
+/// starting processes never observe partially written cache.
+auto savePipelineCache(const vk::Device& device, const vk::PipelineCache& cache
+                       , const std::string& path
+                       , const PipelineCacheKey& key
+                       )-> void
+{
+	const auto data = device.getPipelineCacheData(cache);
+	auto header = PipelineCacheFileHeader{PipelineCacheMagic, PipelineCacheFormat
+	                                      , key.vendorId, key.deviceId, key.driverVersion, {}
+	                                      , key.shaderHash, data.size()
+	                                      , hashBytes(data.data(), data.size())};
+	std::copy(ALL(key.uuid), header.uuid);
+
+	const auto tmpPath = path + ".tmp" + std::to_string(std::random_device{}());
+	{
+		auto fout = std::ofstream(tmpPath, std::ios::binary | std::ios::trunc);
+		fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		fout.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+		if(!fout){
+			std::remove(tmpPath.c_str());
+			throw std::runtime_error("could not write pipeline cache " + tmpPath);
+		}
+	}
+	if(!replaceFile(tmpPath, path)){
+		std::remove(tmpPath.c_str());
+		throw std::runtime_error("could not replace pipeline cache " + path);
+	}
+}
+
+/// @return Vulkan version to create instances with: 1.1 if the loader supports it, 1.0 otherwise.
+/// Vulkan 1.0 loaders have no vkEnumerateInstanceVersion and may refuse instances asking for more than 1.0.
+auto instanceApiVersion()-> uint32_t {
+	auto enumerateVersion = PFN_vkEnumerateInstanceVersion(
+	                          vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+	auto version = uint32_t(VK_API_VERSION_1_0);
+	if(!enumerateVersion || enumerateVersion(&version) != VK_SUCCESS){
+		return VK_API_VERSION_1_0;
+	}
+	return std::min(version, uint32_t(VK_API_VERSION_1_1));
+}
+
+/// @return Vulkan version the device can be used with on instances created with instanceApiVersion(),
+///         the lesser of the instance and the device versions.
+auto usableApiVersion(const vk::PhysicalDevice& physDev)-> uint32_t {
+	return std::min(instanceApiVersion(), physDev.getProperties().apiVersion);
+}
+
 /// filter list of desired extensions to include only those supported by current Vulkan instance
 auto enabledExtensions(const std::vector<const char*>& extensions)-> std::vector<const char*> {
 	auto ret = std::vector<const char*>{};
@@ -104,24 +278,180 @@ auto registerValidationReporter(const vk::Instance& instance, PFN_vkDebugReportC
 auto createDevice(const vk::PhysicalDevice& physicalDevice, const std::vector<const char*>& layers
                   , uint32_t queueFamilyID
                   )-> vk::Device
+{
+	return createDevice(physicalDevice, layers, std::vector<uint32_t>{queueFamilyID});
+}
+
+/// create logical device with a single queue from each of the given queue families
+/// and the given features enabled
+/// @param next chain of extension feature structures enabling features beyond the core ones
+auto createDevice(const vk::PhysicalDevice& physicalDevice, const std::vector<const char*>& layers
+                  , const std::vector<uint32_t>& queueFamilyIDs
+                  , const vk::PhysicalDeviceFeatures& features
+                  , const std::vector<const char*>& extensions
+                  , const void* next
+                  )-> vk::Device
 {
 	// When creating the device specify what queues it has
 	auto p = float(1.0); // queue priority
-	auto queueCI = vk::DeviceQueueCreateInfo(vk::DeviceQueueCreateFlags(), queueFamilyID, 1, &p);
-	auto devCI = vk::DeviceCreateInfo(vk::DeviceCreateFlags(), 1, &queueCI, ARR_VIEW(layers));
+	auto queueCIs = std::vector<vk::DeviceQueueCreateInfo>{};
+	for(auto id: queueFamilyIDs){
+		auto same = [=](const vk::DeviceQueueCreateInfo& ci){ return ci.queueFamilyIndex == id; };
+		if(std::none_of(ALL(queueCIs), same)){ // each family may be listed only once
+			queueCIs.emplace_back(vk::DeviceQueueCreateFlags(), id, 1, &p);
+		}
+	}
+	auto devCI = vk::DeviceCreateInfo(vk::DeviceCreateFlags(), ARR_VIEW(queueCIs), ARR_VIEW(layers)
+	                                  , ARR_VIEW(extensions), &features);
+	devCI.setPNext(next);
 	
 	return physicalDevice.createDevice(devCI, nullptr);
 }
 
 /// Create buffer on a device. Does NOT allocate memory.
-auto createBuffer(const vk::Device& device, uint32_t bufSize
+/// Buffer is shared concurrently between queue families if more than one distinct family is given,
+/// otherwise it is owned exclusively by a single queue family at a time.
+auto createBuffer(const vk::Device& device, vk::DeviceSize bufSize
                   , vk::BufferUsageFlags usage
+                  , const std::vector<uint32_t>& queueFamilyIDs
                   )-> vk::Buffer 
 {
 	auto bufferCI = vk::BufferCreateInfo(vk::BufferCreateFlags(), bufSize, usage);
+	if(queueFamilyIDs.size() > 1
+	   && std::any_of(ALL(queueFamilyIDs), [&](uint32_t id){ return id != queueFamilyIDs[0]; }))
+	{
+		bufferCI.setSharingMode(vk::SharingMode::eConcurrent);
+		bufferCI.setQueueFamilyIndexCount(uint32_t(queueFamilyIDs.size()));
+		bufferCI.setPQueueFamilyIndices(queueFamilyIDs.data());
+	}
 	return device.createBuffer(bufferCI);
 }
 
+/// @return alignment required for host pointers imported with VK_EXT_external_memory_host,
+///         0 if the device does not support the extension.
+auto hostImportAlignment(const vk::Instance& instance, const vk::PhysicalDevice& physDev
+                         )-> vk::DeviceSize
+{
+	if(usableApiVersion(physDev) < VK_API_VERSION_1_1){ // external memory is core since 1.1
+		return 0;
+	}
+	const auto extensions = physDev.enumerateDeviceExtensionProperties();
+	if(std::none_of(ALL(extensions), [](const vk::ExtensionProperties& e){
+	      return std::strcmp(e.extensionName, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0; }))
+	{
+		return 0;
+	}
+	auto getProperties2 = PFN_vkGetPhysicalDeviceProperties2(
+	                       vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2"));
+	if(!getProperties2){
+		return 0;
+	}
+	auto hostProps = VkPhysicalDeviceExternalMemoryHostPropertiesEXT{};
+	hostProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+	auto props = VkPhysicalDeviceProperties2{};
+	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	props.pNext = &hostProps;
+	getProperties2(VkPhysicalDevice(physDev), &props);
+	return hostProps.minImportedHostPointerAlignment;
+}
+
+/// @return true if the device supports VK_EXT_calibrated_timestamps and can calibrate its timestamps
+///         against the host clock vuh::DeviceClock maps them to (CLOCK_MONOTONIC, Linux only).
+auto calibratedTimestampsSupported(const vk::Instance& instance, const vk::PhysicalDevice& physDev
+                                   )-> bool
+{
+#if defined(VK_EXT_calibrated_timestamps) && defined(__linux__)
+	const auto extensions = physDev.enumerateDeviceExtensionProperties();
+	if(std::none_of(ALL(extensions), [](const vk::ExtensionProperties& e){
+	      return std::strcmp(e.extensionName, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) == 0; }))
+	{
+		return false;
+	}
+	auto getTimeDomains = PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(
+	                       vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+	if(!getTimeDomains){
+		return false;
+	}
+	auto count = uint32_t(0);
+	getTimeDomains(VkPhysicalDevice(physDev), &count, nullptr);
+	auto domains = std::vector<VkTimeDomainEXT>(count);
+	getTimeDomains(VkPhysicalDevice(physDev), &count, domains.data());
+	return std::count(ALL(domains), VK_TIME_DOMAIN_DEVICE_EXT) > 0
+	       && std::count(ALL(domains), VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT) > 0;
+#else
+	(void)instance;
+	(void)physDev;
+	return false;
+#endif
+}
+
+/// Wrap host allocation as device memory and bind it to a new buffer, no data is copied.
+/// Device should be created with VK_EXT_external_memory_host enabled.
+/// Host memory should stay alive and not be moved while the buffer is in use.
+/// @param alignment minImportedHostPointerAlignment of the device, 0 if import is not supported
+/// @return null buffer if the pointer or size are not aligned, or the memory can not be imported
+auto importHostPointer(const vk::Device& device, const vk::PhysicalDevice& physDev
+                       , void* ptr, vk::DeviceSize size, vk::DeviceSize alignment
+                       , vk::BufferUsageFlags usage
+                       , const std::vector<uint32_t>& queueFamilyIDs
+                       )-> HostImport
+{
+	const auto handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+	auto getHostPointerProps = PFN_vkGetMemoryHostPointerPropertiesEXT(
+	                            device.getProcAddr("vkGetMemoryHostPointerPropertiesEXT"));
+	if(alignment == 0 || !getHostPointerProps || size == 0
+	   || reinterpret_cast<uintptr_t>(ptr) % alignment != 0 || size % alignment != 0)
+	{
+		return {};
+	}
+	auto pointerProps = VkMemoryHostPointerPropertiesEXT{};
+	pointerProps.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+	if(getHostPointerProps(VkDevice(device), handleType, ptr, &pointerProps) != VK_SUCCESS){
+		return {};
+	}
+
+	auto externalCI = VkExternalMemoryBufferCreateInfo{};
+	externalCI.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+	externalCI.handleTypes = handleType;
+	auto bufferCI = vk::BufferCreateInfo(vk::BufferCreateFlags(), size, usage);
+	bufferCI.setPNext(&externalCI);
+	if(queueFamilyIDs.size() > 1
+	   && std::any_of(ALL(queueFamilyIDs), [&](uint32_t id){ return id != queueFamilyIDs[0]; }))
+	{
+		bufferCI.setSharingMode(vk::SharingMode::eConcurrent);
+		bufferCI.setQueueFamilyIndexCount(uint32_t(queueFamilyIDs.size()));
+		bufferCI.setPQueueFamilyIndices(queueFamilyIDs.data());
+	}
+	auto buf = device.createBuffer(bufferCI);
+
+	const auto reqs = device.getBufferMemoryRequirements(buf);
+	const auto typeBits = reqs.memoryTypeBits & pointerProps.memoryTypeBits;
+	if(typeBits == 0 || reqs.size > size){
+		device.destroyBuffer(buf);
+		return {};
+	}
+	auto memoryId = uint32_t(0);
+	while(!(typeBits & (1u << memoryId))){
+		++memoryId;
+	}
+
+	auto importInfo = VkImportMemoryHostPointerInfoEXT{};
+	importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+	importInfo.handleType = handleType;
+	importInfo.pHostPointer = ptr;
+	auto allocInfo = vk::MemoryAllocateInfo(size, memoryId);
+	allocInfo.setPNext(&importInfo);
+	auto mem = vk::DeviceMemory{};
+	try {
+		mem = device.allocateMemory(allocInfo);
+	} catch(const vk::SystemError&) { // driver refused the range, caller falls back to the copy
+		device.destroyBuffer(buf);
+		return {};
+	}
+	device.bindBufferMemory(buf, mem, 0);
+	return {buf, mem, memoryId};
+}
+
 /// @return the index of a queue family that supports compute operations.
 /// Groups of queues that have the same capabilities (for instance, they all supports graphics
 /// and computer operations), are grouped into queue families.
@@ -152,24 +482,54 @@ auto getComputeQueueFamilyId(const vk::PhysicalDevice& physicalDevice)-> uint32_
 	throw std::runtime_error("could not find a queue family that supports compute operations");
 }
 
-/// Select memory with desired properties.
-/// @return id of the suitable memory, -1 if no suitable memory found.
+/// @return the index of a queue family to be used for host-device transfers.
+/// Transfer-only families (typically backed by DMA engines of discrete GPUs) are preferred,
+/// when there is none the compute family is returned, as every compute queue supports transfers.
+auto getTransferQueueFamilyId(const vk::PhysicalDevice& physicalDevice)-> uint32_t {
+	auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+	auto queue_it = std::find_if(ALL(queueFamilies), [](auto& f){
+		auto maskedFlags = ~vk::QueueFlagBits::eSparseBinding & f.queueFlags;
+		return 0 < f.queueCount
+		      && (vk::QueueFlagBits::eTransfer & maskedFlags)
+		      && !(vk::QueueFlagBits::eCompute & maskedFlags)
+		      && !(vk::QueueFlagBits::eGraphics & maskedFlags);
+	});
+	if(queue_it != end(queueFamilies)){
+		return uint32_t(std::distance(begin(queueFamilies), queue_it));
+	}
+	return getComputeQueueFamilyId(physicalDevice);
+}
+
+/// Select memory with required properties.
+/// Among the memory types having all required properties the first one having also all
+/// the preferred properties is selected, if there is no such the first suitable one is.
+/// Prefer eHostCached for memory read back on the host, reading uncached (write-combined)
+/// memory is very slow.
+/// @return id of the suitable memory
+/// @throw std::runtime_error if no suitable memory found
 auto selectMemory(const vk::PhysicalDevice& physDev
                   , const vk::Device& device
                   , const vk::Buffer& buf
-                  , const vk::MemoryPropertyFlags properties ///< desired memory properties
+                  , const vk::MemoryPropertyFlags properties
+                  , const vk::MemoryPropertyFlags preferred
                   )-> uint32_t
 {
 	auto memProperties = physDev.getMemoryProperties();
 	auto memoryReqs = device.getBufferMemoryRequirements(buf);
+	auto ret = uint32_t(-1);
 	for(uint32_t i = 0; i < memProperties.memoryTypeCount; ++i){
-		if( (memoryReqs.memoryTypeBits & (1u << i))
-		    && ((properties & memProperties.memoryTypes[i].propertyFlags) == properties))
-		{
-			return i;
+		const auto flags = memProperties.memoryTypes[i].propertyFlags;
+		if( (memoryReqs.memoryTypeBits & (1u << i)) && ((properties & flags) == properties)){
+			if((preferred & flags) == preferred){
+				return i;
+			}
+			ret = std::min(ret, i);
 		}
 	}
-	throw std::runtime_error("failed to select memory with required properties");
+	if(ret == uint32_t(-1)){
+		throw std::runtime_error("failed to select memory with required properties");
+	}
+	return ret;
 }
 
 auto allocMemory(const vk::PhysicalDevice& physDev, const vk::Device& device
@@ -182,24 +542,22 @@ auto allocMemory(const vk::PhysicalDevice& physDev, const vk::Device& device
    return device.allocateMemory(allocInfo);
 }
 
-/// Copy device buffers using the transient command pool.
-/// Fully sync, no latency hiding whatsoever.
+/// Copy device buffers. Blocks till the copy is complete.
 auto copyBuf(const vk::Buffer& src, vk::Buffer& dst, const uint32_t size
              , const vk::Device& device, const vk::PhysicalDevice& physDev)-> void
 {
-	const auto qf_id = getComputeQueueFamilyId(physDev); // queue family id, TODO: use transfer queue
-	auto cmd_pool = device.createCommandPool({vk::CommandPoolCreateFlagBits::eTransient, qf_id});
-	auto cmd_buf = device.allocateCommandBuffers({cmd_pool, vk::CommandBufferLevel::ePrimary, 1})[0];
-	cmd_buf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-	auto region = vk::BufferCopy(0, 0, size);
-	cmd_buf.copyBuffer(src, dst, 1, &region);
-	cmd_buf.end();
-	auto queue = device.getQueue(qf_id, 0);
-	auto submit_info = vk::SubmitInfo(0, nullptr, nullptr, 1, &cmd_buf);
-	queue.submit({submit_info}, nullptr);
-	queue.waitIdle();
-	device.freeCommandBuffers(cmd_pool, 1, &cmd_buf);
-	device.destroyCommandPool(cmd_pool);
+	TraceScope scope("copyBuf");
+	copyBufAsync(src, dst, size, device, physDev).wait();
+}
+
+/// Copy device buffers asynchronously.
+/// Copy is recorded to a pooled command buffer and submitted to the device transfer queue.
+/// For several copies at once use deviceResources(device, physDev).transfer.batch().
+/// @return handle to wait for the copy to complete
+auto copyBufAsync(const vk::Buffer& src, vk::Buffer& dst, const vk::DeviceSize size
+                  , const vk::Device& device, const vk::PhysicalDevice& physDev)-> Completion
+{
+	return deviceResources(device, physDev).transfer.copy(src, dst, size);
 }
 
 } // namespace vuh
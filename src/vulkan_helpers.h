@@ -1,7 +1,11 @@
 #pragma once
 
+#include "completion.h"
+
 #include <vulkan/vulkan.hpp>
 
+#include <array>
+#include <string>
 #include <vector>
 
 namespace vuh {
@@ -21,6 +25,40 @@ auto loadShader(const vk::Device& device, const char* filename
                 , vk::ShaderModuleCreateFlags flags = vk::ShaderModuleCreateFlags()
                 )-> vk::ShaderModule;
 
+auto loadShader(const vk::Device& device, const std::vector<char>& code
+                , vk::ShaderModuleCreateFlags flags = vk::ShaderModuleCreateFlags()
+                )-> vk::ShaderModule;
+
+auto loadShader(const vk::Device& device, const uint32_t* code, size_t size
+                , vk::ShaderModuleCreateFlags flags = vk::ShaderModuleCreateFlags()
+                )-> vk::ShaderModule;
+
+auto hashBytes(const void* data, size_t size)-> uint64_t;
+
+/// Identifies the device, driver and shader a serialized pipeline cache was produced for.
+struct PipelineCacheKey {
+	uint32_t vendorId;                         ///< PCI vendor id of the physical device
+	uint32_t deviceId;                         ///< PCI device id of the physical device
+	uint32_t driverVersion;                    ///< vendor-specific driver version
+	std::array<uint8_t, VK_UUID_SIZE> uuid;    ///< pipeline cache UUID reported by the device
+	uint64_t shaderHash;                       ///< hash of the SPIR-V code the pipelines were built from
+};
+
+auto pipelineCacheKey(const vk::PhysicalDevice& physDev, uint64_t shaderHash)-> PipelineCacheKey;
+
+auto loadPipelineCache(const vk::Device& device, const std::string& path
+                       , const PipelineCacheKey& key
+                       , bool* loaded = nullptr
+                       )-> vk::PipelineCache;
+
+auto savePipelineCache(const vk::Device& device, const vk::PipelineCache& cache
+                       , const std::string& path
+                       , const PipelineCacheKey& key
+                       )-> void;
+
+auto instanceApiVersion()-> uint32_t;
+auto usableApiVersion(const vk::PhysicalDevice& physDev)-> uint32_t;
+
 auto enabledExtensions(const std::vector<const char*>& extensions)-> std::vector<const char*>;
 
 auto enabledLayers(const std::vector<const char*>& layers)-> std::vector<const char*>;
@@ -30,18 +68,46 @@ auto registerValidationReporter(const vk::Instance& instance, PFN_vkDebugReportC
 
 auto getComputeQueueFamilyId(const vk::PhysicalDevice& physicalDevice)-> uint32_t;
 
+auto getTransferQueueFamilyId(const vk::PhysicalDevice& physicalDevice)-> uint32_t;
+
 auto createDevice(const vk::PhysicalDevice& physicalDevice, const std::vector<const char*>& layers
                   , uint32_t queueFamilyID)-> vk::Device;
 
+auto createDevice(const vk::PhysicalDevice& physicalDevice, const std::vector<const char*>& layers
+                  , const std::vector<uint32_t>& queueFamilyIDs
+                  , const vk::PhysicalDeviceFeatures& features = vk::PhysicalDeviceFeatures()
+                  , const std::vector<const char*>& extensions = {}
+                  , const void* next = nullptr
+                  )-> vk::Device;
+
 auto createBuffer(const vk::Device& device
-                  , uint32_t bufSize
+                  , vk::DeviceSize bufSize
                   , vk::BufferUsageFlags usage=vk::BufferUsageFlagBits::eStorageBuffer
+                  , const std::vector<uint32_t>& queueFamilyIDs = {}
                   )-> vk::Buffer;
 
+/// Buffer bound to device memory imported from a host allocation.
+struct HostImport {
+	vk::Buffer buffer;        ///< null if the import is not possible
+	vk::DeviceMemory memory;  ///< imported memory, owned by the caller
+	uint32_t memoryId;        ///< memory type index of the imported memory
+};
+
+auto hostImportAlignment(const vk::Instance& instance, const vk::PhysicalDevice& physDev)-> vk::DeviceSize;
+auto calibratedTimestampsSupported(const vk::Instance& instance, const vk::PhysicalDevice& physDev)-> bool;
+
+auto importHostPointer(const vk::Device& device, const vk::PhysicalDevice& physDev
+                       , void* ptr, vk::DeviceSize size
+                       , vk::DeviceSize alignment
+                       , vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eStorageBuffer
+                       , const std::vector<uint32_t>& queueFamilyIDs = {}
+                       )-> HostImport;
+
 auto selectMemory(const vk::PhysicalDevice& physDev
                   , const vk::Device& device
                   , const vk::Buffer& buf
-                  , const vk::MemoryPropertyFlags properties ///< desired memory properties
+                  , const vk::MemoryPropertyFlags properties ///< required memory properties
+                  , const vk::MemoryPropertyFlags preferred = vk::MemoryPropertyFlags() ///< properties to prefer if available
                   )-> uint32_t;
 
 auto allocMemory(const vk::PhysicalDevice& physDev, const vk::Device& device
@@ -52,4 +118,7 @@ auto allocMemory(const vk::PhysicalDevice& physDev, const vk::Device& device
 auto copyBuf(const vk::Buffer& src, vk::Buffer& dst, const uint32_t size
              , const vk::Device& device, const vk::PhysicalDevice& physDev)-> void;
 
+auto copyBufAsync(const vk::Buffer& src, vk::Buffer& dst, const vk::DeviceSize size
+                  , const vk::Device& device, const vk::PhysicalDevice& physDev)-> Completion;
+
 } // namespace vuh
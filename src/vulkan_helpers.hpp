@@ -1,35 +1,43 @@
 #pragma once
 
 #include "vulkan_helpers.h"
+#include "device_resources.h"
+#include "mapped_file.h"
+#include "trace.h"
 
 #include <vulkan/vulkan.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <limits>
+#include <stdexcept>
 #include <type_traits>
 
 namespace vuh {
 
+template<class T> class Array;
+template<class E> struct Expr;
+template<class E> auto assign(Array<float>& out, const Expr<E>& e)-> void;
+
 /// Device buffer owning its chunk of memory.
 template<class T>
 class Array {
-	// Helper class to access to (host-visible!!!) device memory from the host. 
-	// Unmapping memory is not necessary.
+	// Helper class to access to (host-visible!!!) device memory from the host.
+	// Memory stays mapped for the whole lifetime of the allocation, so unmapping is not necessary.
+	// Accesses to memory that is not host-coherent should be bracketed with flush() and invalidate().
 	struct BufferHostView {
 		using ptr_type = T*;
 		
-		const vk::Device device;
-		const vk::DeviceMemory devMemory;
 		const ptr_type data; ///< points to the first element
 		const size_t size;   ///< number of elements
 		
 		/// Constructor
-		explicit BufferHostView(vk::Device device, vk::DeviceMemory devMem
-										, size_t nelements ///< number of elements
-										)
-			: device(device), devMemory(devMem)
-			, data(ptr_type(device.mapMemory(devMem, 0, nelements*sizeof(T))))
-			, size(nelements)
+		explicit BufferHostView(void* mapped   ///< host pointer to the mapped allocation
+		                        , size_t nelements ///< number of elements
+		                        )
+			: data(ptr_type(mapped)), size(nelements)
 		{}
 		
 		auto begin()-> ptr_type { return data; }
@@ -38,11 +46,13 @@ class Array {
 	
 private:
 	vk::Buffer _buf;                        ///< device buffer
-	vk::DeviceMemory _mem;                  ///< associated chunk of device memorys
+	DeviceResources* _resources;            ///< device memory pool the buffer memory comes from and other shared resources
+	Allocation _mem;                        ///< associated range of device memory
 	vk::PhysicalDevice _physdev;            ///< physical device owning the memory
 	std::unique_ptr<const vk::Device> _dev; ///< pointer to logical device. no real ownership, just to provide value semantics to the class.
 	vk::MemoryPropertyFlags _flags;         ///< Actual flags of allocated memory. Can be a superset of requested flags.
 	size_t _size;                           ///< number of elements. actual allocated memory may be a bit bigger than necessary.
+	bool _imported = false;                 ///< memory is imported from the host allocation, not owned by the allocator
 public:
 	using value_type = T;
 
@@ -50,21 +60,29 @@ public:
 	auto operator=(Array&&)-> Array& = default;
 	
 	/// Constructor
+	/// Pass eHostCached in preferred for host-visible arrays read back on the host.
 	explicit Array(const vk::Device& device, const vk::PhysicalDevice& physDevice
 	                         , uint32_t n_elements ///< number of elements of corresponding type
 	                         , vk::MemoryPropertyFlags properties=vk::MemoryPropertyFlagBits::eDeviceLocal
 	                         , vk::BufferUsageFlags usage=vk::BufferUsageFlagBits::eStorageBuffer
+	                         , vk::MemoryPropertyFlags preferred=vk::MemoryPropertyFlags() ///< properties to prefer if available
 	                         )
 	   : Array(device, physDevice
-	       , createBuffer(device, n_elements*sizeof(T), update_usage(physDevice, properties, usage))
-	       , properties, n_elements)
+	       , createBuffer(device, n_elements*sizeof(T), update_usage(physDevice, properties, usage)
+	                      , deviceResources(device, physDevice).sharingFamilies())
+	       , properties, preferred, n_elements)
 	{}
 	
 	/// Destructor
 	~Array() noexcept {
 		if(_dev){
-			_dev->freeMemory(_mem);
+			_resources->bufferDestroyed(_buf);
 			_dev->destroyBuffer(_buf);
+			if(_imported){
+				_dev->freeMemory(_mem.memory);
+			} else {
+				_resources->allocator.free(_mem);
+			}
 			_dev.release();
 		}
 	}
@@ -73,20 +91,102 @@ public:
 	static auto fromHost(C&& c, const vk::Device& device, const vk::PhysicalDevice& physDev
 	                     , vk::MemoryPropertyFlags properties=vk::MemoryPropertyFlagBits::eDeviceLocal
 								, vk::BufferUsageFlags usage=vk::BufferUsageFlagBits::eStorageBuffer
+	                     , vk::MemoryPropertyFlags preferred=vk::MemoryPropertyFlags()
 	                    )-> Array 
 	{
-		auto r = Array<T>(device, physDev, uint32_t(c.size()), properties, usage);
+		TraceScope scope("fromHost");
+		auto r = Array<T>(device, physDev, uint32_t(c.size()), properties, usage, preferred);
 		if(r._flags & vk::MemoryPropertyFlagBits::eHostVisible){ // memory is host-visible
 			std::copy(begin(c), end(c), r.host_view().data);
+			r.flush();
 		} else { // memory is not host visible, use staging buffer
-			auto stage_buf = fromHost(std::forward<C>(c), device, physDev
-			                          , vk::MemoryPropertyFlagBits::eHostVisible
-			                          , vk::BufferUsageFlagBits::eTransferSrc);
-			copyBuf(stage_buf, r, stage_buf.size()*sizeof(T), device, physDev);
+			static_assert(std::is_same<std::decay_t<decltype(*c.data())>, T>::value
+			              , "staging upload requires contiguous container of the array value type");
+			r._resources->staging.upload(r, c.data(), c.size()*sizeof(T));
+		}
+		return r;
+	}
+
+	/// Make device array from the binary file holding the raw array data.
+	/// File is memory-mapped and streamed in chunks straight to the mapped buffer or through
+	/// the staging ring, chunks already uploaded are dropped from the process memory.
+	/// @throw std::runtime_error if file can not be read or its size is not a multiple of sizeof(T)
+	static auto fromFile(const std::string& path, const vk::Device& device, const vk::PhysicalDevice& physDev
+	                     , vk::MemoryPropertyFlags properties=vk::MemoryPropertyFlagBits::eDeviceLocal
+	                     , vk::BufferUsageFlags usage=vk::BufferUsageFlagBits::eStorageBuffer
+	                    )-> Array
+	{
+		auto file = MappedFile(path);
+		const auto n = file.size()/sizeof(T);
+		if(n == 0 || file.size() % sizeof(T) != 0 || n > std::numeric_limits<uint32_t>::max()){
+			throw std::runtime_error("file " + path + " of " + std::to_string(file.size())
+			                         + " bytes does not hold an array of " + std::to_string(sizeof(T)) + "-byte elements");
+		}
+		auto r = Array<T>(device, physDev, uint32_t(n), properties, usage);
+		for(size_t off = 0; off < file.size(); off += MappedFile::ChunkSize){
+			const auto chunk = std::min(MappedFile::ChunkSize, file.size() - off);
+			if(r._mem.mapped){
+				std::memcpy(static_cast<char*>(r._mem.mapped) + off, file.data() + off, chunk);
+				r.flush(off, chunk);
+			} else {
+				r._resources->staging.upload(r, file.data() + off, chunk, off);
+			}
+			file.release(off, chunk);
+		}
+		return r;
+	}
+
+	/// Write raw array data to the binary file, the file is created or overwritten.
+	/// Data goes to the memory-mapped file in chunks straight from the mapped buffer or through
+	/// the staging ring, chunks already written are handed over to the kernel for write-back.
+	/// @throw std::runtime_error if file can not be written
+	auto toFile(const std::string& path)-> void {
+		const auto bytes = size()*sizeof(T);
+		auto file = MappedFile(path, bytes);
+		for(size_t off = 0; off < bytes; off += MappedFile::ChunkSize){
+			const auto chunk = std::min(MappedFile::ChunkSize, bytes - off);
+			if(_mem.mapped){
+				invalidate(off, chunk);
+				std::memcpy(file.data() + off, static_cast<const char*>(_mem.mapped) + off, chunk);
+			} else {
+				_resources->staging.download(file.data() + off, _buf, chunk, off);
+			}
+			file.release(off, chunk);
+		}
+	}
+
+	/// Make device array using the host memory in place, without copying, when the device supports
+	/// VK_EXT_external_memory_host and both the pointer and the byte size are aligned
+	/// to DeviceResources::hostImportAlignment. Otherwise data is copied to a new device-local array,
+	/// use imported() to tell which way it went.
+	/// Imported host memory should outlive the array and results written by the device land directly in it.
+	static auto importHost(T* data, size_t n_elements, const vk::Device& device, const vk::PhysicalDevice& physDev
+	                       , vk::BufferUsageFlags usage=vk::BufferUsageFlagBits::eStorageBuffer
+	                      )-> Array
+	{
+		auto& resources = deviceResources(device, physDev);
+		auto imp = importHostPointer(device, physDev, data, n_elements*sizeof(T)
+		                             , resources.hostImportAlignment, usage, resources.sharingFamilies());
+		if(imp.buffer){
+			return Array(device, physDev, imp, data, n_elements);
+		}
+		auto r = Array<T>(device, physDev, uint32_t(n_elements), vk::MemoryPropertyFlagBits::eDeviceLocal, usage);
+		if(r._mem.mapped){
+			std::copy(data, data + n_elements, r.host_view().data);
+			r.flush();
+		} else {
+			r._resources->staging.upload(r, data, n_elements*sizeof(T));
 		}
 		return r;
 	}
 
+	/// Evaluate elementwise expression of arrays into this one, see expression.hpp
+	template<class E>
+	auto operator=(const Expr<E>& e)-> Array& {
+		assign(*this, e);
+		return *this;
+	}
+
 	operator vk::Buffer& () { return *reinterpret_cast<vk::Buffer*>(this + offsetof(Array, _buf)); }
 	operator const vk::Buffer& () const { return *reinterpret_cast<const vk::Buffer*>(this + offsetof(Array, _buf)); }
 
@@ -94,35 +194,56 @@ public:
 	auto size() const-> size_t {
 		return _size;
 	}
+
+	auto device() const-> const vk::Device& { return *_dev; }
+	auto physicalDevice() const-> const vk::PhysicalDevice& { return _physdev; }
+	/// @return actual properties of the array memory
+	auto memoryProperties() const-> vk::MemoryPropertyFlags { return _flags; }
+	/// @return true if the array memory is the host allocation it was imported from
+	auto imported() const-> bool { return _imported; }
 	
 	template<class C>
 	auto to_host(C& c)-> void {
-		if(_flags & vk::MemoryPropertyFlagBits::eHostVisible){ // memory IS host visible
+		TraceScope scope("to_host");
+		if(_mem.mapped){ // memory IS host visible or imported from the host
+			invalidate();
 			auto hv = host_view();
 			c.resize(size());
 			std::copy(std::begin(hv), std::end(hv), c.data());
 		} else { // memory is not host visible, use staging buffer
-			// copy device memory to staging buffer
-			auto stage_buf = Array(*_dev, _physdev, size()
-			                                 , vk::MemoryPropertyFlagBits::eHostVisible
-			                                 , vk::BufferUsageFlagBits::eTransferDst);
-			copyBuf(_buf, stage_buf, size()*sizeof(T), *_dev, _physdev);
-			stage_buf.to_host(c); // copy from staging buffer to host
+			c.resize(size());
+			_resources->staging.download(c.data(), _buf, size()*sizeof(T));
 		}
 	}
 	
 private: // helpers
 	///
-	auto host_view()-> BufferHostView { return BufferHostView(*_dev, _mem, size()); }
+	auto host_view()-> BufferHostView { return BufferHostView(_mem.mapped, size()); }
+
+	/// Make host writes to the byte range of the mapped memory visible to the device.
+	/// Imported host memory is never flushed.
+	auto flush(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE)-> void {
+		if(!_imported){
+			_resources->allocator.flush(_mem, offset, size);
+		}
+	}
+
+	/// Make device writes to the byte range of the mapped memory visible to the host.
+	auto invalidate(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE)-> void {
+		if(!_imported){
+			_resources->allocator.invalidate(_mem, offset, size);
+		}
+	}
 
 	/// Helper constructor
 	explicit Array(const vk::Device& device, const vk::PhysicalDevice& physDevice
 	                         , vk::Buffer buffer
 	                         , vk::MemoryPropertyFlags properties
+	                         , vk::MemoryPropertyFlags preferred
 	                         , size_t size
 	                         )
 	   : Array(device, physDevice, buffer, size
-	                     , selectMemory(physDevice, device, buffer, properties))
+	                     , selectMemory(physDevice, device, buffer, properties, preferred))
 	{}
 	
 	/// Helper constructor. This one does the actual construction and binding.
@@ -130,15 +251,29 @@ private: // helpers
 	                         , vk::Buffer buf, size_t size
 	                         , uint32_t memory_id)
 	   : _buf(buf)
-	   , _mem(allocMemory(physDevice, device, buf, memory_id))
+	   , _resources(&deviceResources(device, physDevice))
+	   , _mem(_resources->allocator.alloc(device.getBufferMemoryRequirements(buf), memory_id))
 	   , _physdev(physDevice)
 	   , _dev(&device)
 	   , _flags(physDevice.getMemoryProperties().memoryTypes[memory_id].propertyFlags)
 	   , _size(size)
 	{
-		device.bindBufferMemory(buf, _mem, 0);
+		device.bindBufferMemory(buf, _mem.memory, _mem.offset);
 	}
 	
+	/// Helper constructor. Takes ownership of the imported memory.
+	explicit Array(const vk::Device& device, const vk::PhysicalDevice& physDevice
+	               , const HostImport& imp, T* data, size_t size)
+	   : _buf(imp.buffer)
+	   , _resources(&deviceResources(device, physDevice))
+	   , _mem{imp.memory, 0, size*sizeof(T), data, imp.memoryId, 0, 0}
+	   , _physdev(physDevice)
+	   , _dev(&device)
+	   , _flags(physDevice.getMemoryProperties().memoryTypes[imp.memoryId].propertyFlags)
+	   , _size(size)
+	   , _imported(true)
+	{}
+
 	/// crutch to modify buffer usage
 	auto update_usage(const vk::PhysicalDevice& physDevice
 	                  , vk::MemoryPropertyFlags properties
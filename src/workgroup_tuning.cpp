@@ -0,0 +1,163 @@
+#include "workgroup_tuning.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace vuh {
+
+namespace {
+	constexpr auto TableHeader = "vulkan-compute-example workgroups 1";
+	constexpr uint32_t MinInvocations = 32;   ///< smallest workgroup considered, typical SIMD width
+	constexpr uint32_t MaxBucket = 15;
+
+	/// @return device and shader part of the table line
+	auto keyString(const PipelineCacheKey& key)-> std::string {
+		auto s = std::ostringstream{};
+		s << std::hex << key.vendorId << ' ' << key.deviceId << ' ' << key.driverVersion << ' ';
+		for(auto b: key.uuid){
+			s << (b >> 4) << (b & 0xf);
+		}
+		s << ' ' << key.shaderHash;
+		return s.str();
+	}
+
+	/// @return lines of the table file, header excluded. Empty if file does not exist or is not a table.
+	auto readLines(const std::string& path)-> std::vector<std::string> {
+		auto fin = std::ifstream(path);
+		auto line = std::string{};
+		if(!std::getline(fin, line) || line != TableHeader){
+			return {};
+		}
+		auto ret = std::vector<std::string>{};
+		while(std::getline(fin, line)){
+			if(!line.empty()){
+				ret.push_back(line);
+			}
+		}
+		return ret;
+	}
+} // namespace
+
+/// Frames are bucketed by the order of magnitude of their pixel count, each bucket covering
+/// a factor of 4 (i.e. doubling of both frame dimensions).
+/// @return size bucket of the frame
+auto sizeBucket(uint32_t width, uint32_t height)-> uint32_t {
+	auto pixels = uint64_t(width)*height;
+	auto log2 = uint32_t(0);
+	while(pixels >>= 1){
+		++log2;
+	}
+	return std::min(log2/2, MaxBucket);
+}
+
+/// Power-of-two workgroup shapes from 32 to 1024 invocations, at least as wide as high
+/// (rows are contiguous in memory), including 1D shapes like 256x1.
+/// @return candidate workgroup sizes within the device limits
+auto workgroupCandidates(const vk::PhysicalDeviceLimits& limits)-> std::vector<WorkgroupSize> {
+	auto ret = std::vector<WorkgroupSize>{};
+	for(uint32_t x = 1; x <= 1024; x *= 2){
+		for(uint32_t y = 1; y <= x; y *= 2){
+			if(x*y >= MinInvocations
+			   && x <= limits.maxComputeWorkGroupSize[0]
+			   && y <= limits.maxComputeWorkGroupSize[1]
+			   && x*y <= limits.maxComputeWorkGroupInvocations)
+			{
+				ret.push_back({x, y});
+			}
+		}
+	}
+	return ret;
+}
+
+/// @return true if a 2D dispatch of the workgroup size covers the frame within maxComputeWorkGroupCount
+auto coversFrame(const WorkgroupSize& wg, uint32_t width, uint32_t height
+                 , const vk::PhysicalDeviceLimits& limits)-> bool
+{
+	return div_up(width, wg.x) <= limits.maxComputeWorkGroupCount[0]
+	       && div_up(height, wg.y) <= limits.maxComputeWorkGroupCount[1];
+}
+
+/// Shapes tuned on one frame size may need more workgroups along y than the device can dispatch
+/// for much taller frames (1D shapes like 256x1 in particular). Invocations are moved from x to y
+/// until the frame is covered, keeping the workgroup size within the device limits.
+/// @return workgroup size covering the frame, wg if it does already.
+///         May still not cover the frame if no shape of the same invocation count does.
+auto fitWorkgroup(WorkgroupSize wg, uint32_t width, uint32_t height
+                  , const vk::PhysicalDeviceLimits& limits)-> WorkgroupSize
+{
+	while(!coversFrame(wg, width, height, limits)
+	      && wg.x > 1 && 2*wg.y <= limits.maxComputeWorkGroupSize[1]
+	      && div_up(width, wg.x/2) <= limits.maxComputeWorkGroupCount[0])
+	{
+		wg = {wg.x/2, 2*wg.y};
+	}
+	return wg;
+}
+
+/// @return workgroup size tuned for the bucket or the nearest tuned bucket,
+///         DefaultWorkgroupSize if nothing was tuned.
+auto WorkgroupTable::lookup(uint32_t bucket) const-> WorkgroupSize {
+	if(_sizes.empty()){
+		return DefaultWorkgroupSize;
+	}
+	auto hi = _sizes.lower_bound(bucket);
+	if(hi == _sizes.end()){
+		return std::prev(hi)->second;
+	}
+	if(hi->first == bucket || hi == _sizes.begin()){
+		return hi->second;
+	}
+	auto lo = std::prev(hi);
+	return (bucket - lo->first <= hi->first - bucket) ? lo->second : hi->second;
+}
+
+/// Load entries tuned for the given device and shader. Missing or damaged file leaves table empty.
+auto WorkgroupTable::load(const std::string& path, const PipelineCacheKey& key)-> void {
+	const auto prefix = keyString(key) + ' ';
+	for(const auto& line: readLines(path)){
+		if(line.compare(0, prefix.size(), prefix) != 0){
+			continue;
+		}
+		auto s = std::istringstream(line.substr(prefix.size()));
+		auto bucket = uint32_t(0);
+		auto size = WorkgroupSize{0, 0};
+		if(s >> std::dec >> bucket >> size.x >> size.y && size.x > 0 && size.y > 0){
+			_sizes[bucket] = size;
+		}
+	}
+}
+
+/// Save entries to file replacing earlier entries for the same device and shader.
+/// Entries of other devices are kept.
+auto WorkgroupTable::save(const std::string& path, const PipelineCacheKey& key) const-> void {
+	const auto prefix = keyString(key) + ' ';
+	const auto tmpPath = path + ".tmp" + std::to_string(std::random_device{}());
+	{
+		auto fout = std::ofstream(tmpPath, std::ios::trunc);
+		fout << TableHeader << '\n';
+		for(const auto& line: readLines(path)){
+			if(line.compare(0, prefix.size(), prefix) != 0){
+				fout << line << '\n';
+			}
+		}
+		for(const auto& e: _sizes){
+			fout << prefix << std::dec << e.first << ' ' << e.second.x << ' ' << e.second.y << '\n';
+		}
+		if(!fout){
+			std::remove(tmpPath.c_str());
+			throw std::runtime_error("could not write workgroup table " + tmpPath);
+		}
+	}
+	if(!replaceFile(tmpPath, path)){
+		std::remove(tmpPath.c_str());
+		throw std::runtime_error("could not replace workgroup table " + path);
+	}
+}
+
+} // namespace vuh
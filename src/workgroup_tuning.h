@@ -0,0 +1,51 @@
+#pragma once
+
+#include "vulkan_helpers.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace vuh {
+
+/// Compute shader workgroup dimensions
+struct WorkgroupSize {
+	uint32_t x;
+	uint32_t y;
+};
+
+inline auto operator==(const WorkgroupSize& a, const WorkgroupSize& b)-> bool {
+	return a.x == b.x && a.y == b.y;
+}
+inline auto operator<(const WorkgroupSize& a, const WorkgroupSize& b)-> bool {
+	return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+constexpr auto DefaultWorkgroupSize = WorkgroupSize{16, 16};
+
+auto sizeBucket(uint32_t width, uint32_t height)-> uint32_t;
+
+auto workgroupCandidates(const vk::PhysicalDeviceLimits& limits)-> std::vector<WorkgroupSize>;
+auto coversFrame(const WorkgroupSize& wg, uint32_t width, uint32_t height
+                 , const vk::PhysicalDeviceLimits& limits)-> bool;
+auto fitWorkgroup(WorkgroupSize wg, uint32_t width, uint32_t height
+                  , const vk::PhysicalDeviceLimits& limits)-> WorkgroupSize;
+
+/// Best workgroup sizes found for a device by problem-size bucket.
+/// Tables of several devices (and shaders) may share a file, entries are told apart by the
+/// pipeline cache key of the device and shader they were tuned for.
+class WorkgroupTable {
+public:
+	auto lookup(uint32_t bucket) const-> WorkgroupSize;
+	auto set(uint32_t bucket, const WorkgroupSize& size)-> void { _sizes[bucket] = size; }
+	auto empty() const-> bool { return _sizes.empty(); }
+
+	auto load(const std::string& path, const PipelineCacheKey& key)-> void;
+	auto save(const std::string& path, const PipelineCacheKey& key) const-> void;
+private: // data
+	std::map<uint32_t, WorkgroupSize> _sizes; ///< tuned size by size bucket
+}; // class WorkgroupTable
+
+} // namespace vuh
@@ -0,0 +1,96 @@
+#define CATCH_CONFIG_MAIN
+#include <catch/catch.hpp>
+
+#include "approx.hpp"
+
+#include <example_filter.h>
+#include <expression.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using test::approx;
+
+namespace {
+	const auto n = size_t(1000*3 + 7); // not a multiple of the workgroup size
+
+	auto ramp(float start, float step)-> std::vector<float> {
+		auto ret = std::vector<float>(n);
+		for(size_t i = 0; i < n; ++i){
+			ret[i] = start + step*float(i % 101);
+		}
+		return ret;
+	}
+} // namespace
+
+TEST_CASE("elementwise expressions", "[correctness]"){
+	ExampleFilter f;
+	const auto x = ramp(-1.0f, 0.02f);
+	const auto z = ramp(0.5f, 0.01f);
+	const auto y0 = ramp(3.0f, -0.05f);
+	auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+	auto d_z = vuh::Array<float>::fromHost(z, f.device, f.physDevice);
+	auto d_y = vuh::Array<float>::fromHost(y0, f.device, f.physDevice);
+	const auto a = 2.0f;
+	const auto b = -0.5f;
+	auto out = std::vector<float>{};
+
+	SECTION("linear combination"){
+		d_y = a*d_x + b*d_z;
+		auto ref = std::vector<float>(n);
+		for(size_t i = 0; i < n; ++i){
+			ref[i] = a*x[i] + b*z[i];
+		}
+		d_y.to_host(out);
+		REQUIRE(out == approx(ref).eps(1.e-5).verbose());
+	}
+	SECTION("result array as operand"){
+		d_y = clamp(d_y, 0.0f, 1.5f);
+		auto ref = y0;
+		for(auto& v: ref){
+			v = std::min(std::max(v, 0.0f), 1.5f);
+		}
+		d_y.to_host(out);
+		REQUIRE(out == approx(ref).eps(1.e-5).verbose());
+	}
+	SECTION("fused chain"){
+		d_y = clamp(a*d_x + b*d_z, -1.0f, 1.0f)*d_y - abs(d_x)/(1.0f + sqrt(d_z))
+		      + max(min(exp(-d_x), d_z), 0.25f);
+		auto ref = std::vector<float>(n);
+		for(size_t i = 0; i < n; ++i){
+			ref[i] = std::min(std::max(a*x[i] + b*z[i], -1.0f), 1.0f)*y0[i]
+			         - std::abs(x[i])/(1.0f + std::sqrt(z[i]))
+			         + std::max(std::min(std::exp(-x[i]), z[i]), 0.25f);
+		}
+		d_y.to_host(out);
+		REQUIRE(out == approx(ref).eps(1.e-4).verbose());
+	}
+}
+
+TEST_CASE("expression kernels cache", "[correctness]"){
+	ExampleFilter f;
+	auto& kernels = vuh::deviceResources(f.device, f.physDevice).expressions;
+	const auto x = ramp(0.0f, 1.0f);
+	auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+	auto d_z = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+	auto d_y = vuh::Array<float>(f.device, f.physDevice, n);
+
+	const auto before = kernels.size();
+	d_y = 2.0f*d_x + d_z;
+	REQUIRE(kernels.size() == before + 1);
+	d_y = 3.0f*d_z + d_x; // same shape, other operands
+	REQUIRE(kernels.size() == before + 1);
+	auto out = std::vector<float>{};
+	d_y.to_host(out);
+	auto ref = x;
+	for(auto& v: ref){
+		v = 4.0f*v;
+	}
+	REQUIRE(out == approx(ref).eps(1.e-5).verbose());
+
+	d_y = 2.0f*d_x - d_z;
+	REQUIRE(kernels.size() == before + 2);
+
+	auto d_short = vuh::Array<float>(f.device, f.physDevice, n - 1);
+	REQUIRE_THROWS(d_y = d_x + d_short);
+}
@@ -3,9 +3,25 @@
 
 #include "approx.hpp"
 
+#include <auto_filter.h>
+#include <cpu_filter.h>
+#include <embedded_shaders.h>
 #include <example_filter.h>
+#include <multi_device_filter.h>
+#include <trace.h>
 #include <vulkan_helpers.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+
 using test::approx;
 
 TEST_CASE("saxpy", "[correctness]"){
@@ -16,7 +32,7 @@ TEST_CASE("saxpy", "[correctness]"){
 	auto y = std::vector<float>(width*height, 0.71f);
 	auto x = std::vector<float>(width*height, 0.65f);
 	
-	ExampleFilter f("shaders/saxpy.spv");
+	ExampleFilter f;
 	auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice);
 	auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
 
@@ -32,3 +48,993 @@ TEST_CASE("saxpy", "[correctness]"){
 	
 	REQUIRE(out_tst == approx(out_ref).eps(1.e-5).verbose());
 }
+
+TEST_CASE("embedded shaders", "[correctness]"){
+	SECTION("all shaders are compiled into the binary"){
+		for(auto name: {"saxpy.spv", "saxpy_vec2.spv", "saxpy_vec4.spv", "saxpy_f16.spv"
+		                , "saxpy_f64.spv", "saxpy_i32.spv", "saxpy_u32.spv"}){
+			const auto code = vuh::embeddedShader(name);
+			REQUIRE(code.data != nullptr);
+			REQUIRE(code.size % 4 == 0);
+			REQUIRE(code.data[0] == 0x07230203); // SPIR-V magic number
+		}
+		REQUIRE(vuh::embeddedShader("missing.spv").data == nullptr);
+	}
+	SECTION("embedded code is the shader file"){
+		const auto code = vuh::embeddedShader("saxpy.spv");
+		const auto file = vuh::readShaderSrc(SHADER_DIR "/saxpy.spv");
+		REQUIRE(file.size() == code.size);
+		REQUIRE(std::memcmp(file.data(), code.data, code.size) == 0);
+	}
+	SECTION("shader file overrides the embedded one"){
+		const auto width = 90;
+		const auto height = 60;
+		auto y = std::vector<float>(width*height, 0.5f);
+		auto x = std::vector<float>(width*height, 1.0f);
+		ExampleFilter f(SHADER_DIR "/saxpy.spv");
+		REQUIRE(f.vectorShaders.size() == 2); // variants are found next to the file
+		auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice);
+		auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+		f(d_y, d_x, {width, height, 2.0f});
+		auto out = std::vector<float>{};
+		d_y.to_host(out);
+		REQUIRE(out == approx(std::vector<float>(width*height, 2.5f)).eps(1.e-5).verbose());
+	}
+	SECTION("pipeline cache key covers all variants"){
+		ExampleFilter embedded;
+		ExampleFilter file(SHADER_DIR "/saxpy.spv");
+		const auto code = vuh::embeddedShader("saxpy.spv");
+		REQUIRE(embedded.pipeCacheKey.shaderHash == file.pipeCacheKey.shaderHash);
+		REQUIRE(embedded.pipeCacheKey.shaderHash != vuh::hashBytes(code.data, code.size));
+	}
+	SECTION("missing shader file"){
+		REQUIRE_THROWS(ExampleFilter("no_such_dir/saxpy.spv"));
+	}
+}
+
+TEST_CASE("pipeline cache persistence", "[correctness]"){
+	const auto width = 64;
+	const auto height = 32;
+	const auto a = 3.0f;
+	const auto cachePath = std::string("saxpy_t.pipecache");
+	std::remove(cachePath.c_str());
+
+	auto y = std::vector<float>(width*height, 1.5f);
+	auto x = std::vector<float>(width*height, 0.5f);
+	auto out_ref = y;
+	for(size_t i = 0; i < y.size(); ++i){
+		out_ref[i] += a*x[i];
+	}
+
+	auto loaded = false; // whether the last run started from the saved cache
+	auto run = [&]{
+		ExampleFilter f("", cachePath);
+		loaded = f.pipeCacheLoaded;
+		auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice);
+		auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+		f(d_y, d_x, {width, height, a});
+		auto out_tst = std::vector<float>{};
+		d_y.to_host(out_tst);
+		return out_tst;
+	};
+
+	SECTION("cold and warm cache"){
+		REQUIRE(run() == approx(out_ref).eps(1.e-5).verbose());
+		REQUIRE(!loaded);
+		REQUIRE(std::ifstream(cachePath).good());
+		REQUIRE(run() == approx(out_ref).eps(1.e-5).verbose());
+		REQUIRE(loaded);
+	}
+	SECTION("damaged cache file is ignored"){
+		REQUIRE(run() == approx(out_ref).eps(1.e-5).verbose());
+		{
+			auto f = std::fstream(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+			f.seekp(64);
+			f.write("garbage", 7);
+		}
+		REQUIRE(run() == approx(out_ref).eps(1.e-5).verbose());
+		REQUIRE(!loaded);
+		std::ofstream(cachePath, std::ios::trunc) << "short";
+		REQUIRE(run() == approx(out_ref).eps(1.e-5).verbose());
+		REQUIRE(!loaded);
+		REQUIRE(run() == approx(out_ref).eps(1.e-5).verbose());
+		REQUIRE(loaded); // rewritten by the run that ignored the damaged file
+	}
+	std::remove(cachePath.c_str());
+}
+
+TEST_CASE("shared context", "[correctness]"){
+	const auto width = 90;
+	const auto height = 60;
+	auto y = std::vector<float>(width*height, 0.5f);
+	auto x = std::vector<float>(width*height, 1.0f);
+
+	auto context = std::make_shared<vuh::Context>();
+	auto f1 = std::make_unique<ExampleFilter>(context);
+	ExampleFilter f2(context);
+	REQUIRE(f1->device == context->device());
+	REQUIRE(f2.device == context->device());
+	REQUIRE(f1->pipeCache == context->pipelineCache());
+	REQUIRE(context.use_count() == 3);
+
+	auto d_y = vuh::Array<float>::fromHost(y, context->device(), context->physicalDevice());
+	auto d_x = vuh::Array<float>::fromHost(x, context->device(), context->physicalDevice());
+	(*f1)(d_y, d_x, {width, height, 1.0f}); // same arrays used by both filters
+	f2(d_y, d_x, {width, height, 2.0f});
+	auto out = std::vector<float>{};
+	d_y.to_host(out);
+	REQUIRE(out == approx(std::vector<float>(width*height, 3.5f)).eps(1.e-5).verbose());
+
+	f1.reset(); // context and arrays outlive the filter
+	REQUIRE(context.use_count() == 2);
+	f2(d_y, d_x, {width, height, 1.0f});
+	d_y.to_host(out);
+	REQUIRE(out == approx(std::vector<float>(width*height, 4.5f)).eps(1.e-5).verbose());
+}
+
+TEST_CASE("device memory pool", "[correctness]"){
+	ExampleFilter f;
+	const auto& allocator = vuh::deviceResources(f.device, f.physDevice).allocator;
+	auto x = std::vector<float>(1000, 1.f);
+	{
+		auto arrays = std::vector<vuh::Array<float>>{};
+		for(size_t i = 0; i < 256; ++i){
+			arrays.push_back(vuh::Array<float>::fromHost(x, f.device, f.physDevice));
+		}
+		const auto s = allocator.stats();
+		REQUIRE(s.blockCount <= 4);
+		REQUIRE(s.bytesInUse >= 256*x.size()*sizeof(float));
+		REQUIRE(s.bytesReserved >= s.bytesCarved);
+		REQUIRE(s.bytesCarved >= s.bytesInUse);
+	}
+	const auto freed = allocator.stats();
+	REQUIRE(freed.bytesInUse == 0);
+	REQUIRE(freed.bytesCached == freed.bytesCarved);
+
+	{ // freed ranges are reused, no new memory is reserved
+		auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+		auto out = std::vector<float>{};
+		d_x.to_host(out);
+		REQUIRE(out == approx(x).verbose());
+		REQUIRE(allocator.stats().bytesReserved == freed.bytesReserved);
+	}
+	{ // ranges of varying sizes merge back into the block they were split from
+		for(size_t n = 1000; n < 1000000; n *= 3){
+			auto d_y = vuh::Array<float>::fromHost(std::vector<float>(n, 1.f), f.device, f.physDevice);
+		}
+		REQUIRE(allocator.stats().bytesReserved == freed.bytesReserved);
+		REQUIRE(allocator.stats().bytesCached == freed.bytesCached);
+	}
+}
+
+TEST_CASE("host memory import", "[correctness]"){
+	const auto a = 2.0f;
+	ExampleFilter f;
+	const auto alignment = size_t(vuh::deviceResources(f.device, f.physDevice).hostImportAlignment);
+	const auto pageFloats = std::max<size_t>(alignment, 4096)/sizeof(float);
+	const auto width = uint32_t(pageFloats);
+	const auto height = uint32_t(4);          // byte size is a multiple of the import alignment
+	const auto n = size_t(width)*height;
+
+	// aligned host arrays carved out of bigger vectors
+	auto y_storage = std::vector<float>(n + pageFloats);
+	auto x_storage = std::vector<float>(n + pageFloats);
+	auto align = [&](std::vector<float>& v){
+		void* ptr = v.data();
+		auto space = v.size()*sizeof(float);
+		return static_cast<float*>(std::align(pageFloats*sizeof(float), n*sizeof(float), ptr, space));
+	};
+	auto y = align(y_storage);
+	auto x = align(x_storage);
+	std::fill(y, y + n, 0.71f);
+	std::fill(x, x + n, 0.65f);
+	const auto out_ref = std::vector<float>(n, 0.71f + a*0.65f);
+
+	auto d_y = vuh::Array<float>::importHost(y, n, f.device, f.physDevice);
+	auto d_x = vuh::Array<float>::importHost(x, n, f.device, f.physDevice);
+	REQUIRE(d_y.imported() == (alignment != 0));
+	f(d_y, d_x, {width, height, a});
+
+	auto out_tst = std::vector<float>{};
+	d_y.to_host(out_tst);
+	REQUIRE(out_tst == approx(out_ref).eps(1.e-5).verbose());
+	if(d_y.imported()){ // results land in the host array directly
+		REQUIRE(std::vector<float>(y, y + n) == approx(out_ref).eps(1.e-5).verbose());
+	}
+
+	SECTION("misaligned pointer falls back to copy"){
+		auto d_z = vuh::Array<float>::importHost(y + 1, n - 1, f.device, f.physDevice);
+		REQUIRE(!d_z.imported());
+		REQUIRE(d_z.size() == n - 1);
+	}
+}
+
+TEST_CASE("file input output", "[correctness]"){
+	const auto width = 90;
+	const auto height = 60;
+	const auto a = 2.0f;
+	const auto yPath = std::string("saxpy_t_y.bin");
+	const auto xPath = std::string("saxpy_t_x.bin");
+	const auto outPath = std::string("saxpy_t_out.bin");
+
+	auto y = std::vector<float>(width*height);
+	auto x = std::vector<float>(width*height);
+	std::iota(begin(y), end(y), 0.0f);
+	std::iota(begin(x), end(x), 0.5f);
+	std::ofstream(yPath, std::ios::binary).write(reinterpret_cast<const char*>(y.data()), y.size()*sizeof(float));
+	std::ofstream(xPath, std::ios::binary).write(reinterpret_cast<const char*>(x.data()), x.size()*sizeof(float));
+	auto out_ref = y;
+	for(size_t i = 0; i < out_ref.size(); ++i){
+		out_ref[i] += a*x[i];
+	}
+
+	ExampleFilter f;
+	SECTION("device-local arrays"){
+		auto d_y = vuh::Array<float>::fromFile(yPath, f.device, f.physDevice);
+		auto d_x = vuh::Array<float>::fromFile(xPath, f.device, f.physDevice);
+		REQUIRE(d_y.size() == y.size());
+		f(d_y, d_x, {width, height, a});
+		d_y.toFile(outPath);
+	}
+	SECTION("host-visible arrays"){
+		const auto props = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+		auto d_y = vuh::Array<float>::fromFile(yPath, f.device, f.physDevice, props);
+		auto d_x = vuh::Array<float>::fromFile(xPath, f.device, f.physDevice, props);
+		f(d_y, d_x, {width, height, a});
+		d_y.toFile(outPath);
+	}
+	auto out_tst = std::vector<float>(width*height);
+	std::ifstream(outPath, std::ios::binary).read(reinterpret_cast<char*>(out_tst.data()), out_tst.size()*sizeof(float));
+	REQUIRE(out_tst == approx(out_ref).eps(1.e-5).verbose());
+
+	std::ofstream(outPath, std::ios::binary | std::ios::trunc) << "odd";
+	REQUIRE_THROWS(vuh::Array<float>::fromFile(outPath, f.device, f.physDevice));
+	REQUIRE_THROWS(vuh::Array<float>::fromFile("no_such_file.bin", f.device, f.physDevice));
+	std::remove(yPath.c_str());
+	std::remove(xPath.c_str());
+	std::remove(outPath.c_str());
+}
+
+TEST_CASE("host-cached readback", "[correctness]"){
+	using Props = vk::MemoryPropertyFlagBits;
+	const auto width = 90;
+	const auto height = 60;
+	const auto a = 2.0f;
+	auto y = std::vector<float>(width*height, 0.71f);
+	auto x = std::vector<float>(width*height, 0.65f);
+	const auto out_ref = std::vector<float>(width*height, 0.71f + a*0.65f);
+
+	ExampleFilter f;
+	auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice, Props::eHostVisible
+	                                       , vk::BufferUsageFlagBits::eStorageBuffer, Props::eHostCached);
+	auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice, Props::eHostVisible);
+	REQUIRE(d_y.memoryProperties() & Props::eHostVisible);
+
+	const auto memProps = f.physDevice.getMemoryProperties();
+	auto hasCached = false;
+	for(uint32_t i = 0; i < memProps.memoryTypeCount; ++i){
+		const auto flags = memProps.memoryTypes[i].propertyFlags;
+		hasCached |= (flags & Props::eHostVisible) && (flags & Props::eHostCached);
+	}
+	if(hasCached){ // cached memory is picked whenever the device has some
+		REQUIRE(d_y.memoryProperties() & Props::eHostCached);
+	}
+
+	f(d_y, d_x, {width, height, a});
+	auto out_tst = std::vector<float>{};
+	d_y.to_host(out_tst); // invalidates the mapped range if memory is not coherent
+	REQUIRE(out_tst == approx(out_ref).eps(1.e-5).verbose());
+}
+
+TEST_CASE("transfers bigger than staging ring", "[correctness]"){
+	ExampleFilter f;
+	const auto usage = vk::BufferUsageFlagBits::eStorageBuffer
+	                   | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+	auto x = std::vector<float>(6*(1u << 20) + 3);
+	for(size_t i = 0; i < x.size(); ++i){
+		x[i] = float(i % 1024);
+	}
+	auto d_x = vuh::Array<float>(f.device, f.physDevice, uint32_t(x.size())
+	                             , vk::MemoryPropertyFlagBits::eDeviceLocal, usage);
+	// through the ring explicitly, host-visible device memory would otherwise be mapped directly
+	auto& staging = vuh::deviceResources(f.device, f.physDevice).staging;
+	const auto bytes = x.size()*sizeof(float);
+	static_assert(6*(1u << 20)*sizeof(float) > vuh::StagingRing::NumSlots*vuh::StagingRing::SlotSize
+	              , "transfer should wrap around the ring");
+	staging.upload(d_x, x.data(), bytes);
+	auto out = std::vector<float>(x.size());
+	staging.download(out.data(), d_x, bytes);
+	REQUIRE(out == x);
+}
+
+TEST_CASE("asynchronous batched copies", "[correctness]"){
+	ExampleFilter f;
+	const auto usage = vk::BufferUsageFlagBits::eStorageBuffer
+	                   | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+	auto x = std::vector<float>(4096, 0.5f);
+	auto z = std::vector<float>(4096, 1.5f);
+	auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice, vk::MemoryPropertyFlagBits::eDeviceLocal, usage);
+	auto d_z = vuh::Array<float>::fromHost(z, f.device, f.physDevice, vk::MemoryPropertyFlagBits::eDeviceLocal, usage);
+	auto d_y = vuh::Array<float>(f.device, f.physDevice, 2*4096, vk::MemoryPropertyFlagBits::eDeviceLocal, usage);
+
+	auto done = vuh::deviceResources(f.device, f.physDevice).transfer.batch()
+	            .copy(d_x, d_y, 4096*sizeof(float))
+	            .copy(d_z, d_y, 4096*sizeof(float), 0, 4096*sizeof(float))
+	            .submit();
+	REQUIRE(done.wait_for(std::chrono::seconds(10)));
+	REQUIRE(done.poll());
+
+	auto out = std::vector<float>{};
+	d_y.to_host(out);
+	auto out_ref = x;
+	out_ref.insert(end(out_ref), begin(z), end(z));
+	REQUIRE(out == out_ref);
+}
+
+TEST_CASE("streaming frames", "[correctness]"){
+	const auto width = 90;
+	const auto height = 60;
+	const auto a = 2.0f;
+	const auto numFrames = 7;
+
+	auto ys = std::vector<std::vector<float>>{};
+	auto xs = std::vector<std::vector<float>>{};
+	auto frames = std::vector<ExampleFilter::Frame>{};
+	for(int i = 0; i < numFrames; ++i){
+		ys.emplace_back(width*height, 0.1f*i);
+		xs.emplace_back(width*height, 1.0f + i);
+	}
+	for(int i = 0; i < numFrames; ++i){
+		frames.push_back({ys[i].data(), xs[i].data()});
+	}
+	auto out_ref = ys;
+	for(int i = 0; i < numFrames; ++i){
+		for(size_t j = 0; j < out_ref[i].size(); ++j){
+			out_ref[i][j] += a*xs[i][j];
+		}
+	}
+
+	ExampleFilter f;
+	f.stream(frames, {width, height, a});
+	for(int i = 0; i < numFrames; ++i){
+		REQUIRE(ys[i] == approx(out_ref[i]).eps(1.e-5).verbose());
+	}
+}
+
+TEST_CASE("out-of-core grid streaming", "[correctness]"){
+	const auto a = 2.0f;
+	const auto budget = vk::DeviceSize(6*sizeof(float)*1000); // 1000 elements per tile array, 3 slots
+	ExampleFilter f;
+	auto check = [&](uint64_t width, uint64_t height){
+		auto y = std::vector<float>(width*height);
+		auto x = std::vector<float>(width*height);
+		std::iota(begin(y), end(y), 0.0f);
+		std::iota(begin(x), end(x), 0.5f);
+		auto out_ref = y;
+		for(size_t i = 0; i < out_ref.size(); ++i){
+			out_ref[i] += a*x[i];
+		}
+		f.streamGrid(y.data(), x.data(), {width, height, a}, budget);
+		REQUIRE(y == approx(out_ref).eps(1.e-5).verbose());
+	};
+
+	SECTION("tiles of whole rows"){
+		check(300, 50);  // 3 rows per tile, last tile partial
+	}
+	SECTION("tiles of row segments"){
+		check(2500, 3);  // row does not fit a tile
+	}
+	SECTION("grid fitting a single tile"){
+		check(20, 10);
+	}
+	SECTION("budget too small"){
+		auto y = std::vector<float>(16);
+		auto x = std::vector<float>(16);
+		REQUIRE_THROWS(f.streamGrid(y.data(), x.data(), {4, 4, a}, 8));
+	}
+}
+
+TEST_CASE("cached bindings", "[correctness]"){
+	const auto width = 32;
+	const auto height = 16;
+	const auto a = 0.5f;
+	auto y = std::vector<float>(width*height, 1.0f);
+	auto x = std::vector<float>(width*height, 2.0f);
+
+	ExampleFilter f;
+	SECTION("repeated calls reuse recorded commands"){
+		auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice);
+		auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+		for(int i = 0; i < 3; ++i){
+			f(d_y, d_x, {width, height, a});
+		}
+		REQUIRE(f.bindings.size() == 1);
+		auto out = std::vector<float>{};
+		d_y.to_host(out);
+		REQUIRE(out == approx(std::vector<float>(width*height, 4.0f)).eps(1.e-5).verbose());
+	}
+	SECTION("bindings of destroyed buffers are dropped"){
+		for(int i = 0; i < 3; ++i){
+			auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice);
+			auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+			f(d_y, d_x, {width, height, a});
+			auto out = std::vector<float>{};
+			d_y.to_host(out);
+			REQUIRE(out == approx(std::vector<float>(width*height, 2.0f)).eps(1.e-5).verbose());
+		}
+		REQUIRE(f.bindings.empty());
+	}
+	SECTION("bindings of buffers destroyed on other threads are dropped"){
+		auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice);
+		auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+		std::thread([&]{
+			auto d_z = vuh::Array<float>::fromHost(y, f.device, f.physDevice);
+			f(d_z, d_x, {width, height, a});
+		}).join();
+		f(d_y, d_x, {width, height, a});
+		REQUIRE(f.bindings.size() == 1);
+		REQUIRE(f.bindings.front().out == vk::Buffer(d_y));
+	}
+	SECTION("least recently used bindings are evicted"){
+		auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice);
+		auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+		for(uint32_t i = 0; i < ExampleFilter::BindingCacheSize + 8; ++i){
+			f(d_y, d_x, {width, height, float(i)});
+		}
+		REQUIRE(f.bindings.size() == ExampleFilter::BindingCacheSize);
+	}
+}
+
+TEST_CASE("batched jobs", "[correctness]"){
+	const auto width = 32;
+	const auto height = 32;
+	auto y1 = std::vector<float>(width*height, 1.0f);
+	auto y2 = std::vector<float>(width*height, 2.0f);
+	auto x = std::vector<float>(width*height, 3.0f);
+
+	ExampleFilter f;
+	auto d_y1 = vuh::Array<float>::fromHost(y1, f.device, f.physDevice);
+	auto d_y2 = vuh::Array<float>::fromHost(y2, f.device, f.physDevice);
+	auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+
+	f({ {d_y1, d_x, {width, height, 1.0f}}   // y1 = 1 + 3 = 4, independent of the next one
+	  , {d_y2, d_x, {width, height, 2.0f}}   // y2 = 2 + 6 = 8
+	  , {d_y2, d_y1, {width, height, 0.5f}}  // y2 = 8 + 2 = 10, depends on both previous jobs
+	  , {d_y1, d_x, {width, height, 1.0f}}   // y1 = 4 + 3 = 7, overwrites input of the previous job
+	  });
+
+	auto out1 = std::vector<float>{};
+	auto out2 = std::vector<float>{};
+	d_y1.to_host(out1);
+	d_y2.to_host(out2);
+	REQUIRE(out1 == approx(std::vector<float>(width*height, 7.0f)).eps(1.e-5).verbose());
+	REQUIRE(out2 == approx(std::vector<float>(width*height, 10.0f)).eps(1.e-5).verbose());
+}
+
+TEST_CASE("asynchronous runs", "[correctness]"){
+	const auto width = 64;
+	const auto height = 64;
+	const auto numArrays = 4;
+	auto x = std::vector<float>(width*height, 1.0f);
+
+	ExampleFilter f;
+	auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+	auto d_ys = std::vector<vuh::Array<float>>{};
+	for(int i = 0; i < numArrays; ++i){
+		d_ys.push_back(vuh::Array<float>::fromHost(std::vector<float>(width*height, float(i))
+		                                          , f.device, f.physDevice));
+	}
+
+	auto runs = std::vector<vuh::Completion>{};
+	for(int i = 0; i < numArrays; ++i){
+		runs.push_back(f.async(d_ys[i], d_x, {width, height, 2.0f}));
+	}
+	REQUIRE(runs[0].wait_for(std::chrono::seconds(10)));
+	for(auto& r: runs){
+		r.wait();
+		REQUIRE(r.poll());
+	}
+	for(int i = 0; i < numArrays; ++i){
+		auto out = std::vector<float>{};
+		d_ys[i].to_host(out);
+		REQUIRE(out == approx(std::vector<float>(width*height, i + 2.0f)).eps(1.e-5).verbose());
+	}
+}
+
+TEST_CASE("completions outliving the filter", "[correctness]"){
+	const auto width = 64;
+	const auto height = 64;
+	auto run = vuh::Completion{};
+	auto batch = vuh::Completion{};
+	{
+		ExampleFilter f;
+		f.enableProfiling();
+		auto d_y = vuh::Array<float>::fromHost(std::vector<float>(width*height, 1.0f), f.device, f.physDevice);
+		auto d_x = vuh::Array<float>::fromHost(std::vector<float>(width*height, 1.0f), f.device, f.physDevice);
+		run = f.async(d_y, d_x, {width, height, 2.0f});
+		batch = f.async({{d_y, d_x, {width, height, 2.0f}}});
+	} // filter and its context are released, the completions keep what they recycle to
+	run.wait();
+	batch.wait();
+	REQUIRE(run.poll());
+	REQUIRE(batch.poll());
+}
+
+TEST_CASE("concurrent callers", "[correctness]"){
+	const auto width = 64;
+	const auto height = 48;
+	const auto numThreads = 8;
+	const auto iterations = 50;
+
+	ExampleFilter f;
+	auto results = std::vector<std::vector<float>>(numThreads);
+	auto errors = std::vector<std::string>(numThreads); // catch assertions are not thread-safe
+	auto threads = std::vector<std::thread>{};
+	for(int t = 0; t < numThreads; ++t){
+		threads.emplace_back([&, t]{
+			try {
+				auto d_y = vuh::Array<float>::fromHost(std::vector<float>(width*height, float(t))
+				                                      , f.device, f.physDevice);
+				auto d_x = vuh::Array<float>::fromHost(std::vector<float>(width*height, 1.0f)
+				                                      , f.device, f.physDevice);
+				switch(t % 3){
+				case 0: // cached bindings
+					for(int i = 0; i < iterations; ++i){
+						f(d_y, d_x, {width, height, 1.0f});
+					}
+					break;
+				case 1: // parameters bound by this thread
+					f.bindParameters(d_y, d_x, {width, height, 1.0f});
+					for(int i = 0; i < iterations; ++i){
+						f.run();
+					}
+					f.unbindParameters();
+					break;
+				default: // batches recorded to the thread command pool
+					for(int i = 0; i < iterations; i += 2){
+						f({{d_y, d_x, {width, height, 1.0f}}, {d_y, d_x, {width, height, 1.0f}}});
+					}
+				}
+				d_y.to_host(results[t]);
+			} catch(std::exception& e) {
+				errors[t] = e.what();
+			}
+		});
+	}
+	for(auto& t: threads){
+		t.join();
+	}
+	for(int t = 0; t < numThreads; ++t){
+		INFO("thread " << t);
+		REQUIRE(errors[t].empty());
+		REQUIRE(results[t] == approx(std::vector<float>(width*height, float(t + iterations))).eps(1.e-5).verbose());
+	}
+}
+
+TEST_CASE("parameters bound by exited threads", "[correctness]"){
+	const auto width = 64;
+	const auto height = 48;
+	const auto a = 2.0f;
+
+	ExampleFilter f;
+	auto d_y = vuh::Array<float>::fromHost(std::vector<float>(width*height, 1.0f), f.device, f.physDevice);
+	auto d_x = vuh::Array<float>::fromHost(std::vector<float>(width*height, 1.0f), f.device, f.physDevice);
+	auto d_z = vuh::Array<float>::fromHost(std::vector<float>(width*height, 3.0f), f.device, f.physDevice);
+	for(int t = 0; t < 4; ++t){ // ids of the exited threads may be reused by the next ones
+		std::thread([&]{
+			f.bindParameters(d_y, d_x, {width, height, a}); // left bound
+			f.run();
+		}).join();
+	}
+
+	f.bindParameters(d_y, d_x, {width, height, a});
+	f.bindParameters(d_y, d_z, {width, height, a}); // replaces the bound parameters
+	f.run();
+	f.unbindParameters();
+	auto out = std::vector<float>{};
+	d_y.to_host(out);
+	REQUIRE(out == approx(std::vector<float>(width*height, 1.0f + 4*a + 3*a)).eps(1.e-5).verbose());
+}
+
+TEST_CASE("gpu timestamps", "[correctness]"){
+	const auto width = 90;
+	const auto height = 60;
+	const auto a = 2.0f;
+	auto y = std::vector<float>(width*height, 0.71f);
+	auto x = std::vector<float>(width*height, 0.65f);
+
+	ExampleFilter f;
+	const auto usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc
+	                   | vk::BufferUsageFlagBits::eTransferDst;
+	auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice, vk::MemoryPropertyFlagBits::eDeviceLocal, usage);
+	auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice, vk::MemoryPropertyFlagBits::eDeviceLocal, usage);
+	REQUIRE(f.takeTimings().empty()); // not profiling yet
+
+	if(!f.enableProfiling()){
+		WARN("compute queue does not support timestamps");
+		return;
+	}
+	for(int i = 0; i < 3; ++i){
+		f(d_y, d_x, {width, height, a});
+	}
+	const auto timings = f.takeTimings();
+	REQUIRE(timings.size() == 3);
+	for(const auto& t: timings){
+		REQUIRE(t.deviceSeconds >= 0.0);
+		REQUIRE(t.hostSeconds > 0.0);
+	}
+	REQUIRE(f.takeTimings().empty()); // taken
+
+	auto& transfer = vuh::deviceResources(f.device, f.physDevice).transfer;
+	if(transfer.enableProfiling()){
+		transfer.takeTimings();
+		vuh::copyBuf(d_x, d_y, uint32_t(x.size()*sizeof(float)), f.device, f.physDevice);
+		REQUIRE(transfer.takeTimings().size() == 1);
+	}
+
+	f.enableProfiling(false);
+	f(d_y, d_x, {width, height, a});
+	REQUIRE(f.takeTimings().empty());
+}
+
+TEST_CASE("trace events", "[correctness]"){
+	const auto width = 90;
+	const auto height = 60;
+	const auto a = 2.0f;
+	auto y = std::vector<float>(width*height, 0.71f);
+	auto x = std::vector<float>(width*height, 0.65f);
+	ExampleFilter f;
+
+	{ vuh::TraceScope scope("untraced"); }
+	vuh::Trace::start();
+	{
+		vuh::TraceScope outer("outer");
+		{ vuh::TraceScope inner("inner"); }
+		std::thread([]{ vuh::TraceScope scope("other thread"); }).join();
+	}
+	const auto usage = vk::BufferUsageFlagBits::eStorageBuffer
+	                   | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+	auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice, vk::MemoryPropertyFlagBits::eDeviceLocal, usage);
+	auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice, vk::MemoryPropertyFlagBits::eDeviceLocal, usage);
+	auto& transfer = vuh::deviceResources(f.device, f.physDevice).transfer;
+	transfer.copy(d_x, d_y, x.size()*sizeof(float)).wait(); // on the transfer queue, before the dispatches
+	const auto uploaded = vuh::Trace::events();
+	f.bindParameters(d_y, d_x, {width, height, a});
+	f.run();
+	f.run();
+	d_y.to_host(y);
+	vuh::Trace::stop();
+	{ vuh::TraceScope scope("untraced"); }
+
+	const auto events = vuh::Trace::events();
+	auto named = [&events](const char* name){
+		auto ret = std::vector<vuh::Trace::Event>{};
+		std::copy_if(begin(events), end(events), std::back_inserter(ret)
+		             , [name](const vuh::Trace::Event& e){ return std::strcmp(e.name, name) == 0; });
+		return ret;
+	};
+	REQUIRE(named("untraced").empty());
+	REQUIRE(named("outer").size() == 1);
+	REQUIRE(named("inner").size() == 1);
+	REQUIRE(named("other thread").size() == 1);
+	REQUIRE(named("fromHost").size() == 2);
+	REQUIRE(named("bindParameters").size() == 1);
+	REQUIRE(named("run").size() == 2);
+	REQUIRE(named("to_host").size() == 1);
+
+	const auto outer = named("outer")[0];
+	const auto inner = named("inner")[0];
+	REQUIRE(inner.tid == outer.tid);
+	REQUIRE(named("other thread")[0].tid != outer.tid);
+	REQUIRE(inner.begin >= outer.begin);
+	REQUIRE(inner.begin + inner.duration <= outer.begin + outer.duration);
+
+	// ordered by start, scopes on the same thread are either nested or disjoint
+	REQUIRE(std::is_sorted(begin(events), end(events)
+	                       , [](const vuh::Trace::Event& l, const vuh::Trace::Event& r){ return l.begin < r.begin; }));
+	for(size_t i = 0; i < events.size(); ++i){
+		for(size_t j = i + 1; j < events.size(); ++j){
+			if(events[i].device || events[j].device || events[i].tid != events[j].tid){
+				continue;
+			}
+			const auto end_i = events[i].begin + events[i].duration;
+			REQUIRE((events[j].begin >= end_i || events[j].begin + events[j].duration <= end_i));
+		}
+	}
+	REQUIRE(named("fromHost")[1].begin + named("fromHost")[1].duration <= named("bindParameters")[0].begin);
+	REQUIRE(named("bindParameters")[0].begin + named("bindParameters")[0].duration <= named("run")[0].begin);
+	REQUIRE(named("run")[1].begin + named("run")[1].duration <= named("to_host")[0].begin);
+
+	if(vuh::Profiler::supported(f.physDevice, f.compute_queue_familly_id)){
+		const auto runs = named("run");
+		const auto dispatches = named("dispatch");
+		REQUIRE(dispatches.size() == runs.size());
+		for(const auto& d: dispatches){
+			REQUIRE(d.device);
+		}
+		if(vuh::Profiler::supported(f.physDevice, transfer.queueFamilyId())){
+			// copies were waited for before the dispatches were submitted, both queues are on the same clock
+			auto copies = size_t(0);
+			for(const auto& e: uploaded){
+				if(std::strcmp(e.name, "copy") == 0){
+					REQUIRE(e.device);
+					REQUIRE(e.tid == transfer.queueFamilyId());
+					REQUIRE(e.begin + e.duration <= dispatches[0].begin);
+					++copies;
+				}
+			}
+			REQUIRE(copies >= 1);
+		} else {
+			WARN("transfer queue does not support timestamps");
+		}
+	} else {
+		WARN("compute queue does not support timestamps");
+	}
+
+	const auto json = vuh::Trace::json();
+	REQUIRE(json.find("\"traceEvents\"") != std::string::npos);
+	REQUIRE(json.find("\"name\":\"bindParameters\"") != std::string::npos);
+}
+
+TEST_CASE("multiple devices", "[correctness]"){
+	const auto width = 90;
+	const auto height = 61;
+	const auto a = 2.0f;
+	auto x = std::vector<float>(width*height);
+	auto y0 = std::vector<float>(width*height);
+	for(size_t i = 0; i < x.size(); ++i){
+		x[i] = float(i % 17);
+		y0[i] = float(i % 5);
+	}
+	auto out_ref = y0;
+	for(size_t i = 0; i < y0.size(); ++i){
+		out_ref[i] += a*x[i];
+	}
+
+	SECTION("all devices"){
+		MultiDeviceFilter f;
+		REQUIRE(f.size() >= 1);
+		auto y = y0;
+		f(y, x, {width, height, a});
+		REQUIRE(y == approx(out_ref).eps(1.e-5).verbose());
+	}
+	SECTION("two logical devices on the same physical device"){
+		MultiDeviceFilter f("", {0, 0});
+		REQUIRE(f.size() == 2);
+		for(int frame = 0; frame < 3; ++frame){ // band split changes as throughput gets measured
+			auto y = y0;
+			f(y, x, {width, height, a});
+			REQUIRE(y == approx(out_ref).eps(1.e-5).verbose());
+			const auto bands = f.bands(height);
+			REQUIRE(std::accumulate(begin(bands), end(bands), 0u) == height);
+		}
+	}
+}
+
+TEST_CASE("device selection", "[correctness]"){
+	ExampleFilter f;
+	REQUIRE(f.deviceInfo.suitable);
+	REQUIRE(f.deviceInfo.physDevice == f.physDevice);
+	REQUIRE(!f.deviceInfo.reason.empty());
+
+	const auto ranked = vuh::rankDevices(f.instance);
+	REQUIRE(!ranked.empty());
+	REQUIRE(ranked.front().suitable);
+
+	SECTION("override by index"){
+		const auto& last = ranked.back();
+		if(last.suitable){
+			auto c = vuh::selectDevice(f.instance, {std::to_string(last.index)});
+			REQUIRE(c.index == last.index);
+		}
+	}
+	SECTION("override by name"){
+		auto c = vuh::selectDevice(f.instance, {ranked.front().name});
+		REQUIRE(c.name == ranked.front().name);
+	}
+	SECTION("override by UUID"){
+		const auto uuid = vuh::uuidString(f.deviceInfo.uuid);
+		if(uuid != std::string(2*VK_UUID_SIZE, '0')){
+			auto c = vuh::selectDevice(f.instance, {uuid});
+			REQUIRE(c.index == f.deviceInfo.index);
+		}
+	}
+	SECTION("override matching no device"){
+		REQUIRE_THROWS(vuh::selectDevice(f.instance, {"no such device"}));
+		REQUIRE_THROWS(vuh::selectDevice(f.instance, {std::to_string(ranked.size())}));
+	}
+}
+
+TEST_CASE("workgroup autotune", "[correctness]"){
+	const auto width = 200;
+	const auto height = 3;  // narrow frame, not a multiple of any 2D workgroup
+	const auto a = 2.0f;
+	const auto cachePath = std::string("saxpy_t_tune.pipecache");
+	std::remove(cachePath.c_str());
+	std::remove((cachePath + ".workgroups").c_str());
+
+	auto y = std::vector<float>(width*height, 1.0f);
+	auto x = std::vector<float>(width*height);
+	for(size_t i = 0; i < x.size(); ++i){
+		x[i] = float(i % 13);
+	}
+	auto out_ref = y;
+	for(size_t i = 0; i < y.size(); ++i){
+		out_ref[i] += a*x[i];
+	}
+
+	auto tuned = vuh::WorkgroupSize{0, 0};
+	{
+		ExampleFilter f("", cachePath);
+		const auto limits = f.physDevice.getProperties().limits;
+		const auto candidates = vuh::workgroupCandidates(limits);
+		REQUIRE(!candidates.empty());
+		for(const auto& wg: candidates){
+			REQUIRE(wg.x <= limits.maxComputeWorkGroupSize[0]);
+			REQUIRE(wg.y <= limits.maxComputeWorkGroupSize[1]);
+			REQUIRE(wg.x*wg.y <= limits.maxComputeWorkGroupInvocations);
+		}
+		if(limits.maxComputeWorkGroupInvocations >= 256){
+			REQUIRE(std::count(begin(candidates), end(candidates), vuh::WorkgroupSize{256, 1}) == 1);
+		}
+
+		f.autotune({{width, height, a}}, 2);
+		tuned = f.workgroupFor({width, height, a});
+		REQUIRE(std::count(begin(candidates), end(candidates), tuned) == 1);
+
+		auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice);
+		auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+		f(d_y, d_x, {width, height, a});
+		auto out_tst = std::vector<float>{};
+		d_y.to_host(out_tst);
+		REQUIRE(out_tst == approx(out_ref).eps(1.e-5).verbose());
+	}
+	ExampleFilter f("", cachePath); // picks up the saved result
+	REQUIRE(f.workgroupFor({width, height, a}) == tuned);
+	REQUIRE(f.workgroupFor({4*width, 4*height, a}) == tuned); // nearest tuned bucket
+}
+
+TEST_CASE("vectorized shader variants", "[correctness]"){
+	const auto height = 37;
+	const auto a = 2.0f;
+	ExampleFilter f;
+	REQUIRE(f.vectorShaders.size() == 2);
+
+	auto check = [&](uint32_t width, uint32_t expectedVecWidth){
+		const auto p = ExampleFilter::PushParams{width, height, a};
+		REQUIRE(f.vectorWidthFor(p) == expectedVecWidth);
+		auto y = std::vector<float>(width*height);
+		auto x = std::vector<float>(width*height);
+		for(size_t i = 0; i < x.size(); ++i){
+			y[i] = float(i % 7);
+			x[i] = float(i % 11);
+		}
+		auto out_ref = y;
+		for(size_t i = 0; i < y.size(); ++i){
+			out_ref[i] += a*x[i];
+		}
+		auto d_y = vuh::Array<float>::fromHost(y, f.device, f.physDevice);
+		auto d_x = vuh::Array<float>::fromHost(x, f.device, f.physDevice);
+		f(d_y, d_x, p);
+		auto out_tst = std::vector<float>{};
+		d_y.to_host(out_tst);
+		REQUIRE(out_tst == approx(out_ref).eps(1.e-5).verbose());
+	};
+
+	SECTION("vec4"){ check(64, 4); }
+	SECTION("vec2"){ check(66, 2); }
+	SECTION("scalar"){ check(67, 1); }
+	SECTION("vector variants disabled"){
+		f.maxVectorWidth = 1;
+		check(64, 1);
+	}
+}
+
+namespace {
+	/// Run saxpy on arrays of T through the filter attached to the context, compare to the host result.
+	/// Values are small integers, exact in all element types.
+	template<class T>
+	auto checkElementType(const std::shared_ptr<vuh::Context>& context)-> void {
+		using Scalar = typename BasicFilter<T>::Scalar;
+		const auto type = vuh::ElementTraits<T>::type;
+		if(!vuh::elementTypeSupported(context->instance(), context->physicalDevice(), type)){
+			REQUIRE_THROWS(BasicFilter<T>(context));
+			return;
+		}
+		const auto width = 67u;
+		const auto height = 37u;
+		const auto a = Scalar(3);
+		auto y = std::vector<T>(width*height);
+		auto x = std::vector<T>(width*height);
+		auto out_ref = std::vector<T>(width*height);
+		for(size_t i = 0; i < y.size(); ++i){
+			y[i] = T(Scalar(i % 7));
+			x[i] = T(Scalar(i % 11));
+			out_ref[i] = T(Scalar(i % 7) + a*Scalar(i % 11));
+		}
+		BasicFilter<T> f(context);
+		auto d_y = vuh::Array<T>::fromHost(y, f.device, f.physDevice);
+		auto d_x = vuh::Array<T>::fromHost(x, f.device, f.physDevice);
+		f(d_y, d_x, {width, height, a});
+		auto out_tst = std::vector<T>{};
+		d_y.to_host(out_tst);
+		REQUIRE(out_tst == out_ref);
+	}
+} // namespace
+
+TEST_CASE("element types", "[correctness]"){
+	auto context = std::make_shared<vuh::Context>();
+	SECTION("f32"){ checkElementType<float>(context); }
+	SECTION("f64"){ checkElementType<double>(context); }
+	SECTION("f16"){ checkElementType<vuh::half>(context); }
+	SECTION("i32"){ checkElementType<int32_t>(context); }
+	SECTION("u32"){ checkElementType<uint32_t>(context); }
+	SECTION("unsupported types fall back to f32"){
+		const auto& pd = context->physicalDevice();
+		const auto instance = context->instance();
+		for(auto t: {vuh::ElementType::Float16, vuh::ElementType::Float64}){
+			REQUIRE(vuh::supportedElementType(instance, pd, t)
+			        == (vuh::elementTypeSupported(instance, pd, t) ? t : vuh::ElementType::Float32));
+		}
+	}
+	SECTION("half conversions"){
+		REQUIRE(vuh::half(1.f).bits == 0x3c00);
+		REQUIRE(vuh::half(-2.f).bits == 0xc000);
+		REQUIRE(vuh::half(65504.f).bits == 0x7bff);     // largest finite
+		REQUIRE(vuh::half(1.e6f).bits == 0x7c00);       // overflow to infinity
+		REQUIRE(vuh::half(5.9604645e-8f).bits == 0x0001); // smallest subnormal
+		REQUIRE(vuh::half(1.f + 1.f/2048).bits == 0x3c00); // tie rounds to even
+		for(auto v: {0.f, 0.5f, 3.f, -7.25f, 1024.f, 6.1035156e-5f}){
+			REQUIRE(float(vuh::half(v)) == v);
+		}
+		REQUIRE(std::abs(float(vuh::half(0.1f)) - 0.1f) < 1.e-4f);
+	}
+}
+
+TEST_CASE("cpu backend", "[correctness]"){
+	const auto a = 2.0f;
+	auto check = [a](CpuFilter& f, uint32_t width, uint32_t height){
+		auto y = std::vector<float>(width*height);
+		auto x = std::vector<float>(width*height);
+		std::iota(begin(y), end(y), 0.0f);
+		std::iota(begin(x), end(x), 1.0f);
+		auto ref = std::vector<float>(width*height);
+		for(size_t i = 0; i < ref.size(); ++i){
+			ref[i] = y[i] + a*x[i];
+		}
+		f(y, x, {width, height, a});
+		REQUIRE(y == approx(ref).eps(1.e-5).verbose());
+	};
+
+	SECTION("single thread, widths not a multiple of the simd width"){
+		CpuFilter f(1);
+		check(f, 1, 1);
+		check(f, 17, 3);
+		check(f, 90, 60);
+	}
+	SECTION("rows split between threads"){
+		CpuFilter f(4);
+		REQUIRE(f.threads() == 4);
+		check(f, 1025, 131);  // above the parallel threshold, rows do not divide evenly
+		check(f, 1 << 17, 1); // single row
+	}
+	SECTION("forced cpu backend"){
+		AutoFilter f("", AutoFilter::Backend::Cpu);
+		REQUIRE(f.backend() == AutoFilter::Backend::Cpu);
+		auto y = std::vector<float>(90*60, 0.71f);
+		auto x = std::vector<float>(90*60, 0.65f);
+		const auto ref = std::vector<float>(90*60, 0.71f + a*0.65f);
+		f(y, x, {90, 60, a});
+		REQUIRE(y == approx(ref).eps(1.e-5).verbose());
+	}
+	SECTION("auto backend picks the vulkan device when present"){
+		AutoFilter f;
+		INFO(f.reason());
+		REQUIRE(f.backend() == AutoFilter::Backend::Vulkan);
+		auto y = std::vector<float>(90*60, 0.71f);
+		auto x = std::vector<float>(90*60, 0.65f);
+		const auto ref = std::vector<float>(90*60, 0.71f + a*0.65f);
+		f(y, x, {90, 60, a});
+		REQUIRE(y == approx(ref).eps(1.e-5).verbose());
+	}
+}
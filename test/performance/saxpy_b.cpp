@@ -1,9 +1,31 @@
 #include <sltbench/Bench.h>
 
+#include <auto_filter.h>
+#include <cpu_filter.h>
 #include <example_filter.h>
+#include <multi_device_filter.h>
 #include <vulkan_helpers.hpp>
 
+#ifdef _WIN32
+   #ifndef NOMINMAX
+      #define NOMINMAX
+   #endif
+   #include <windows.h>
+#else
+   #include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
 #include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 namespace {
@@ -24,8 +46,142 @@ struct Params{
    }
 };
 
+constexpr auto BenchJsonEnv = "SAXPY_BENCH_JSON";        ///< path of the JSON results file, saxpy_b.json by default
+constexpr auto BenchMaxSideEnv = "SAXPY_BENCH_MAX_SIDE"; ///< largest frame side of the size sweep
+constexpr auto MaxSweepSide = uint32_t(32768);          ///< sweep never goes beyond 1G elements frames
+
+/// @return physical memory installed on the host, bytes
+auto hostMemoryBytes()-> uint64_t {
+#ifdef _WIN32
+   auto status = MEMORYSTATUSEX{};
+   status.dwLength = sizeof(status);
+   return ::GlobalMemoryStatusEx(&status) ? uint64_t(status.ullTotalPhys) : 0;
+#else
+   return uint64_t(sysconf(_SC_PHYS_PAGES))*uint64_t(sysconf(_SC_PAGE_SIZE));
+#endif
+}
+
+auto secondsSince(std::chrono::steady_clock::time_point start)-> double {
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// Timings of the benchmark phases accumulated over the run.
+/// Written to a JSON file at exit so that results from different runs can be compared.
+/// Phases not bound to a frame size (startup) are recorded with zero width and height.
+class Report {
+public:
+   ~Report(){ write(); }
+
+   /// Account a single run of the phase on frame p moving the given number of bytes.
+   auto add(const std::string& phase, const Params& p, double seconds, double bytes)-> void {
+      auto& r = _results[std::make_tuple(phase, p.width, p.height)];
+      r.runs += 1;
+      r.seconds += seconds;
+      r.bytes += bytes;
+   }
+
+   auto device(const std::string& name)-> void { _device = name; }
+private: // helpers
+   struct Result {
+      uint64_t runs = 0;
+      double seconds = 0.0;
+      double bytes = 0.0;
+   };
+
+   auto write() const-> void {
+      if(_results.empty()){
+         return;
+      }
+      const auto env = std::getenv(BenchJsonEnv);
+      const auto path = std::string(env && *env ? env : "saxpy_b.json");
+      std::ofstream out(path);
+      out << "{\n  \"benchmark\": \"saxpy\",\n  \"device\": \"" << escaped(_device)
+          << "\",\n  \"results\": [";
+      auto sep = "\n";
+      for(const auto& r: _results){
+         const auto elements = double(std::get<1>(r.first))*std::get<2>(r.first);
+         const auto& v = r.second;
+         out << sep << "    {\"phase\": \"" << std::get<0>(r.first) << "\""
+             << ", \"width\": " << std::get<1>(r.first) << ", \"height\": " << std::get<2>(r.first)
+             << ", \"runs\": " << v.runs << ", \"seconds_per_run\": " << v.seconds/v.runs;
+         if(v.seconds > 0.0 && v.bytes > 0.0){
+            out << ", \"gb_per_s\": " << v.bytes/v.seconds*1.e-9;
+         }
+         if(v.seconds > 0.0 && elements > 0.0){
+            out << ", \"elements_per_s\": " << elements*v.runs/v.seconds;
+         }
+         out << "}";
+         sep = ",\n";
+      }
+      out << "\n  ]\n}\n";
+      std::cout << "saxpy phase timings written to " << path << "\n";
+   }
+
+   static auto escaped(const std::string& str)-> std::string {
+      auto ret = std::string();
+      for(auto c: str){
+         if(c == '"' || c == '\\'){
+            ret += '\\';
+         }
+         ret += c;
+      }
+      return ret;
+   }
+private: // data
+   std::map<std::tuple<std::string, uint32_t, uint32_t>, Result> _results; ///< by phase and frame size
+   std::string _device;  ///< name of the device benchmarked
+}; // class Report
+
+auto report()-> Report& {
+   static Report r;
+   return r;
+}
+
+/// Square frames with sides doubling from 32 up to the memory limit.
+/// The limit is taken from BenchMaxSideEnv if set. Otherwise it is the largest frame
+/// for which the phase fixture fits into half of the device-local heap
+/// (two arrays bound to the filter and one being uploaded) and half of the host memory
+/// (inputs, downloaded result and the CPU reference output), and whose array does not exceed
+/// maxStorageBufferRange of the device.
+struct SweepParams {
+   using ArgType = Params;
+
+   auto Generate(int /*argc*/, char** /*argv*/)-> std::vector<ArgType> {
+      static const auto maxSide = maxSweepSide();
+      auto ret = std::vector<ArgType>{};
+      for(auto side = uint32_t(32); side <= maxSide; side *= 2){
+         ret.push_back({side, side, 2.f});
+      }
+      return ret;
+   }
+private:
+   static auto maxSweepSide()-> uint32_t {
+      if(const auto env = std::getenv(BenchMaxSideEnv)){
+         return std::min(uint32_t(std::stoul(env)), MaxSweepSide);
+      }
+      auto appInfo = vk::ApplicationInfo("saxpy_b", 0, "no_engine", 0, vuh::instanceApiVersion());
+      auto instance = vk::createInstance({vk::InstanceCreateFlags(), &appInfo});
+      auto deviceBytes = vk::DeviceSize(0);
+      auto bufferBytes = vk::DeviceSize(0);
+      try {
+         const auto device = vuh::selectDevice(instance);
+         deviceBytes = device.localHeapSize;
+         bufferBytes = device.physDev.getProperties().limits.maxStorageBufferRange;
+      } catch(const std::exception&) {} // no device, sweep the smallest size only
+      instance.destroy();
+      const auto hostBytes = hostMemoryBytes();
+      const auto maxElements = std::min(std::min(deviceBytes/(2*3*sizeof(float)), hostBytes/(2*4*sizeof(float)))
+                                        , bufferBytes/sizeof(float)); // whole frame is bound as a single buffer
+      auto side = uint32_t(32);
+      while(side < MaxSweepSide && uint64_t(2*side)*(2*side) <= maxElements){
+         side *= 2;
+      }
+      return side;
+   }
+}; // struct SweepParams
+
 struct DataFixFull {
-   ExampleFilter f{"shaders/saxpy.spv"};
+   ExampleFilter f;
    Params p;
    std::vector<float> y;
    std::vector<float> x;
@@ -79,6 +235,426 @@ private:
    std::unique_ptr<DeviceData> _dev_data;
 }; // struct FixShaderOnly
 
+struct DataFixKernel: DataFixFull {
+   std::unique_ptr<FixShaderOnly::DeviceData> dev_data;
+   std::string phase;      ///< report phase naming the vector width of the shader variant in use
+};
+
+/// Kernel runs with shader variant of at most VecWidth vector width.
+/// Achieved memory bandwidth is reported under the kernel_vecN phase of the variant actually used.
+template<uint32_t VecWidth>
+struct FixKernel: private DataFixKernel {
+   using Type = DataFixKernel;
+
+   auto SetUp(const Params& p)-> Type& {
+      if(p != this->p){
+         this->p = p;
+         y = std::vector<float>(p.width*p.height, 3.1f);
+         x = std::vector<float>(p.width*p.height, 1.9f);
+         f.maxVectorWidth = VecWidth;
+         f.unbindParameters();
+         dev_data = std::make_unique<FixShaderOnly::DeviceData>(static_cast<const DataFixFull&>(*this));
+         f.bindParameters(dev_data->d_y, dev_data->d_x, {p.width, p.height, p.a});
+         phase = "kernel_vec" + std::to_string(f.vectorWidthFor({p.width, p.height, p.a}));
+      }
+      return *this;
+   }
+
+   auto TearDown()-> void {}
+}; // struct FixKernel
+
+using FixScalarKernel = FixKernel<1>;
+using FixVectorKernel = FixKernel<4>;
+
+struct DataFixProfiled: DataFixFull {
+   std::unique_ptr<FixShaderOnly::DeviceData> dev_data;
+};
+
+/// Kernel runs bracketed with GPU timestamps.
+/// Device time and host wall time per run are reported as profiled_device and profiled_host phases,
+/// the difference is the submission and fence overhead.
+struct FixProfiled: private DataFixProfiled {
+   using Type = DataFixProfiled;
+
+   FixProfiled(){
+      if(!f.enableProfiling()){
+         std::cerr << "compute queue does not support timestamps, profiled runs not reported\n";
+      }
+   }
+
+   auto SetUp(const Params& p)-> Type& {
+      if(p != this->p){
+         this->p = p;
+         y = std::vector<float>(p.width*p.height, 3.1f);
+         x = std::vector<float>(p.width*p.height, 1.9f);
+         f.unbindParameters();
+         dev_data = std::make_unique<FixShaderOnly::DeviceData>(static_cast<const DataFixFull&>(*this));
+         f.bindParameters(dev_data->d_y, dev_data->d_x, {p.width, p.height, p.a});
+         f.takeTimings();
+      }
+      return *this;
+   }
+
+   auto TearDown()-> void {}
+}; // struct FixProfiled
+
+struct DataFixRepeated: DataFixFull {
+   std::unique_ptr<FixShaderOnly::DeviceData> dev_data;
+};
+
+/// Filter called over and over on the same device arrays.
+struct FixRepeatedCall: private DataFixRepeated {
+   using Type = DataFixRepeated;
+
+   auto SetUp(const Params& p)-> Type& {
+      if(p != this->p){
+         this->p = p;
+         y = std::vector<float>(p.width*p.height, 3.1f);
+         x = std::vector<float>(p.width*p.height, 1.9f);
+         dev_data = std::make_unique<FixShaderOnly::DeviceData>(static_cast<const DataFixFull&>(*this));
+      }
+      return *this;
+   }
+
+   auto TearDown()-> void {}
+}; // struct FixRepeatedCall
+
+struct DataFixBatch: DataFixFull {
+   std::vector<std::unique_ptr<FixShaderOnly::DeviceData>> dev_data;
+   std::vector<ExampleFilter::Job> jobs;
+};
+
+/// Many independent small jobs submitted at once.
+struct FixBatch: private DataFixBatch {
+   using Type = DataFixBatch;
+   static constexpr auto NumJobs = 64;
+
+   auto SetUp(const Params& p)-> Type& {
+      if(p != this->p){
+         this->p = p;
+         y = std::vector<float>(p.width*p.height, 3.1f);
+         x = std::vector<float>(p.width*p.height, 1.9f);
+         jobs.clear();
+         dev_data.clear();
+         for(size_t i = 0; i < NumJobs; ++i){
+            dev_data.push_back(std::make_unique<FixShaderOnly::DeviceData>(static_cast<const DataFixFull&>(*this)));
+            jobs.push_back({dev_data.back()->d_y, dev_data.back()->d_x, {p.width, p.height, p.a}});
+         }
+      }
+      return *this;
+   }
+
+   auto TearDown()-> void {}
+}; // struct FixBatch
+
+struct DataFixStream {
+   ExampleFilter f;
+   Params p;
+   std::vector<std::vector<float>> ys;
+   std::vector<std::vector<float>> xs;
+   std::vector<ExampleFilter::Frame> frames;
+};
+
+/// Batch of frames streamed through the upload-dispatch-download pipeline.
+struct FixStream: private DataFixStream {
+   using Type = DataFixStream;
+   static constexpr auto NumFrames = 16;
+
+   auto SetUp(const Params& p)-> Type& {
+      if(p != this->p) {
+         this->p = p;
+         ys.assign(NumFrames, std::vector<float>(p.width*p.height, 3.1f));
+         xs.assign(NumFrames, std::vector<float>(p.width*p.height, 1.9f));
+         frames.clear();
+         for(size_t i = 0; i < NumFrames; ++i){
+            frames.push_back({ys[i].data(), xs[i].data()});
+         }
+      }
+      return *this;
+   }
+
+   auto TearDown()-> void {}
+}; // struct FixStream
+
+struct DataFixMulti {
+   MultiDeviceFilter f;
+   Params p;
+   std::vector<float> y;
+   std::vector<float> x;
+};
+
+/// Host frame split in row bands over all available devices.
+struct FixMulti: private DataFixMulti {
+   using Type = DataFixMulti;
+
+   auto SetUp(const Params& p)-> Type& {
+      if(p != this->p) {
+         this->p = p;
+         y.assign(p.width*p.height, 3.1f);
+         x.assign(p.width*p.height, 1.9f);
+      }
+      return *this;
+   }
+
+   auto TearDown()-> void {}
+}; // struct FixMulti
+
+struct DataFixImport: DataFixFull {
+   std::vector<float> y_storage;  ///< y with room for page alignment
+   std::vector<float> x_storage;  ///< x with room for page alignment
+   float* y_host = nullptr;       ///< page-aligned y
+   float* x_host = nullptr;       ///< page-aligned x
+   size_t n = 0;                  ///< number of elements in the arrays
+   uint32_t width = 0;            ///< frame shape covering n elements
+   uint32_t height = 0;
+   bool useImport = false;        ///< import arrays instead of copying
+   const char* phase = "";        ///< report phase, tells import apart from its copying fallback
+};
+
+/// Host arrays handed to the device with Array::importHost (zero-copy when supported)
+/// or with Array::fromHost followed by the readback.
+/// Frame sizes are rounded to whole pages so that import does not fall back to the copy.
+/// Runs are reported as host_import, host_import_copied when the device can not import, or host_copy.
+template<bool Import>
+struct FixHostArrays: private DataFixImport {
+   using Type = DataFixImport;
+   static constexpr size_t PageFloats = 64*1024/sizeof(float); ///< covers import alignment of known devices
+
+   auto SetUp(const Params& p)-> Type& {
+      if(p != this->p){
+         this->p = p;
+         n = (size_t(p.width)*p.height + PageFloats - 1)/PageFloats*PageFloats;
+         width = uint32_t(PageFloats);
+         height = uint32_t(n/PageFloats);
+         useImport = Import;
+         y.assign(n, 3.1f);
+         x.assign(n, 1.9f);
+         y_storage.assign(n + PageFloats, 3.1f);
+         x_storage.assign(n + PageFloats, 1.9f);
+         y_host = align(y_storage);
+         x_host = align(x_storage);
+         phase = "host_copy";
+         if(Import){
+            auto probe = vuh::Array<float>::importHost(y_host, n, f.device, f.physDevice);
+            phase = probe.imported() ? "host_import" : "host_import_copied";
+         }
+      }
+      return *this;
+   }
+
+   auto TearDown()-> void {}
+private:
+   auto align(std::vector<float>& v)-> float* {
+      void* ptr = v.data();
+      auto space = v.size()*sizeof(float);
+      return static_cast<float*>(std::align(PageFloats*sizeof(float), n*sizeof(float), ptr, space));
+   }
+}; // struct FixHostArrays
+
+using FixImport = FixHostArrays<true>;
+using FixCopy = FixHostArrays<false>;
+
+struct DataFixFile: DataFixFull {
+   std::string yPath = "saxpy_b_y.bin";
+   std::string xPath = "saxpy_b_x.bin";
+   std::string outPath = "saxpy_b_out.bin";
+};
+
+/// Frame read from and written to binary files.
+struct FixFile: private DataFixFile {
+   using Type = DataFixFile;
+
+   ~FixFile(){
+      std::remove(yPath.c_str());
+      std::remove(xPath.c_str());
+      std::remove(outPath.c_str());
+   }
+
+   auto SetUp(const Params& p)-> Type& {
+      if(p != this->p){
+         this->p = p;
+         const auto y = std::vector<float>(p.width*p.height, 3.1f);
+         const auto x = std::vector<float>(p.width*p.height, 1.9f);
+         std::ofstream(yPath, std::ios::binary).write(reinterpret_cast<const char*>(y.data()), y.size()*sizeof(float));
+         std::ofstream(xPath, std::ios::binary).write(reinterpret_cast<const char*>(x.data()), x.size()*sizeof(float));
+      }
+      return *this;
+   }
+
+   auto TearDown()-> void {}
+}; // struct FixFile
+
+struct DataFixHost {
+   std::unique_ptr<AutoFilter> f;
+   Params p;
+   std::vector<float> y;
+   std::vector<float> x;
+   const char* phase;      ///< report phase of the backend
+};
+
+/// Host frame processed by the given backend, GPU path includes the transfers.
+/// Frame throughput is reported under host_cpu and host_vulkan phases, comparing the
+/// backends across frame sizes gives the break-even point of the GPU path.
+template<AutoFilter::Backend B>
+struct FixHost: private DataFixHost {
+   using Type = DataFixHost;
+
+   auto SetUp(const Params& p)-> Type& {
+      if(!f){
+         f = std::make_unique<AutoFilter>("", B);
+         phase = B == AutoFilter::Backend::Cpu ? "host_cpu" : "host_vulkan";
+      }
+      if(p != this->p){
+         this->p = p;
+         y.assign(p.width*p.height, 3.1f);
+         x.assign(p.width*p.height, 1.9f);
+      }
+      return *this;
+   }
+
+   auto TearDown()-> void {}
+}; // struct FixHost
+
+using FixCpu = FixHost<AutoFilter::Backend::Cpu>;
+using FixGpuHost = FixHost<AutoFilter::Backend::Vulkan>;
+
+struct DataFixPhases: DataFixFull {
+   CpuFilter cpu;
+   std::vector<float> out;    ///< downloaded result
+   std::vector<float> cpuY;   ///< CPU reference output
+   std::unique_ptr<FixShaderOnly::DeviceData> dev_data;
+};
+
+/// Frame data on host and device for the benchmarks of separate processing phases.
+/// All phases share the single filter and the data, so that only one frame is held in memory
+/// at the upper end of the size sweep.
+struct FixPhases {
+   using Type = DataFixPhases;
+
+   auto SetUp(const Params& p)-> Type& {
+      auto& d = data();
+      if(p != d.p){
+         d.p = p;
+         d.f.unbindParameters();
+         d.dev_data.reset(); // free the previous frame first
+         d.y = std::vector<float>(size_t(p.width)*p.height, 3.1f);
+         d.x = std::vector<float>(size_t(p.width)*p.height, 1.9f);
+         d.out = std::vector<float>(size_t(p.width)*p.height);
+         d.cpuY = d.y;
+         d.dev_data = std::make_unique<FixShaderOnly::DeviceData>(static_cast<const DataFixFull&>(d));
+         d.f.bindParameters(d.dev_data->d_y, d.dev_data->d_x, {p.width, p.height, p.a});
+         report().device(d.f.deviceInfo.name);
+      }
+      return d;
+   }
+
+   auto TearDown()-> void {}
+private:
+   static auto data()-> DataFixPhases& {
+      static DataFixPhases d;
+      return d;
+   }
+}; // struct FixPhases
+
+/// Context shared by the filters created in the attach benchmark.
+struct FixContext {
+   using Type = std::shared_ptr<vuh::Context>;
+
+   auto SetUp()-> Type& { return context; }
+   auto TearDown()-> void {}
+private:
+   Type context = std::make_shared<vuh::Context>();
+}; // struct FixContext
+
+/// Filter with the shader loaded, for the pipeline creation benchmark.
+struct FixFilter {
+   using Type = ExampleFilter;
+
+   auto SetUp()-> Type& { return f; }
+   auto TearDown()-> void {}
+private:
+   ExampleFilter f;
+}; // struct FixFilter
+
+/// Filter and device arrays of element type T, filter is null if the device does not support T.
+template<class T>
+struct DataFixTyped {
+   std::unique_ptr<BasicFilter<T>> f;
+   Params p;
+   std::unique_ptr<vuh::Array<T>> d_y;
+   std::unique_ptr<vuh::Array<T>> d_x;
+};
+
+/// Parameters bound to arrays of T, to compare kernel throughput between element types.
+/// Benchmarks of types not supported by the device do nothing.
+template<class T>
+struct FixTyped: private DataFixTyped<T> {
+   using Type = DataFixTyped<T>;
+   using Scalar = typename BasicFilter<T>::Scalar;
+
+   FixTyped(){
+      const auto context = std::make_shared<vuh::Context>();
+      const auto type = vuh::ElementTraits<T>::type;
+      if(vuh::elementTypeSupported(context->instance(), context->physicalDevice(), type)){
+         this->f = std::make_unique<BasicFilter<T>>(context);
+      } else {
+         std::cerr << vuh::elementTypeName(type) << " arrays not supported by the device, skipped\n";
+      }
+   }
+
+   auto SetUp(const Params& p)-> Type& {
+      if(this->f && p != this->p){
+         this->p = p;
+         const auto y = std::vector<T>(p.width*p.height, T(Scalar(3)));
+         const auto x = std::vector<T>(p.width*p.height, T(Scalar(2)));
+         auto& f = *this->f;
+         f.unbindParameters();
+         this->d_y = std::make_unique<vuh::Array<T>>(vuh::Array<T>::fromHost(y, f.device, f.physDevice));
+         this->d_x = std::make_unique<vuh::Array<T>>(vuh::Array<T>::fromHost(x, f.device, f.physDevice));
+         f.bindParameters(*this->d_y, *this->d_x, {p.width, p.height, Scalar(p.a)});
+      }
+      return *this;
+   }
+
+   auto TearDown()-> void {}
+}; // struct FixTyped
+
+using FixF16 = FixTyped<vuh::half>;
+using FixF32 = FixTyped<float>;
+using FixF64 = FixTyped<double>;
+using FixI32 = FixTyped<int32_t>;
+
+constexpr auto ThreadsFrameSide = uint32_t(256);  ///< frame side of each caller thread
+constexpr auto ThreadsCalls = 16;                 ///< filter calls per caller thread
+
+struct DataFixThreads {
+   ExampleFilter f;
+   uint32_t numThreads = 0;
+   std::vector<vuh::Array<float>> d_ys;  ///< in-out array of each caller thread
+   std::vector<vuh::Array<float>> d_xs;  ///< input array of each caller thread
+};
+
+/// Single filter shared by the given number of caller threads, each working on its own frame.
+struct FixThreads: private DataFixThreads {
+   using Type = DataFixThreads;
+
+   auto SetUp(const uint32_t& numThreads)-> Type& {
+      if(numThreads != this->numThreads){
+         this->numThreads = numThreads;
+         d_ys.clear();
+         d_xs.clear();
+         const auto n = ThreadsFrameSide*ThreadsFrameSide;
+         for(uint32_t t = 0; t < numThreads; ++t){
+            d_ys.push_back(vuh::Array<float>::fromHost(std::vector<float>(n, 3.1f), f.device, f.physDevice));
+            d_xs.push_back(vuh::Array<float>::fromHost(std::vector<float>(n, 1.9f), f.device, f.physDevice));
+         }
+      }
+      return *this;
+   }
+
+   auto TearDown()-> void {}
+}; // struct FixThreads
+
 /// Copy arrays data to gpu device, setup the kernel and run it.
 auto saxpy(DataFixFull& fix, const Params& p)-> void {
    auto d_y = vuh::Array<float>::fromHost(fix.y, fix.f.device, fix.f.physDevice);
@@ -92,12 +668,256 @@ auto saxpy(ExampleFilter& f, const Params& p)-> void {
    f.run();
 }
 
+const auto pipeCachePath = "saxpy_b.pipecache";
+
+const auto shaderFile = SHADER_DIR "/saxpy.spv"; ///< same shader as the embedded one, read from the build tree
+
+/// Filter startup with no pipeline cache on disk, shader gets compiled from scratch.
+auto init_cold_cache()-> void {
+   std::remove(pipeCachePath);
+   const auto start = std::chrono::steady_clock::now();
+   ExampleFilter f{"", pipeCachePath};
+   report().add("init_cold_cache", {0, 0, 0.f}, secondsSince(start), 0.0);
+}
+
+/// Same as init_cold_cache, with the shader read from file instead of the one embedded in the binary.
+auto init_cold_cache_file()-> void {
+   std::remove(pipeCachePath);
+   const auto start = std::chrono::steady_clock::now();
+   ExampleFilter f{shaderFile, pipeCachePath};
+   report().add("init_cold_cache_file", {0, 0, 0.f}, secondsSince(start), 0.0);
+}
+
+/// Filter startup reusing the pipeline cache saved by the previous run.
+auto init_warm_cache()-> void {
+   const auto start = std::chrono::steady_clock::now();
+   ExampleFilter f{"", pipeCachePath};
+   report().add("init_warm_cache", {0, 0, 0.f}, secondsSince(start), 0.0);
+}
+
+/// Filter startup on the existing context: shader modules, layouts, pipeline and pools only.
+auto init_attach_context(std::shared_ptr<vuh::Context>& context)-> void {
+   const auto start = std::chrono::steady_clock::now();
+   ExampleFilter f{context};
+   report().add("init_attach_context", {0, 0, 0.f}, secondsSince(start), 0.0);
+}
+
+/// Same as init_attach_context, with the shader read from file. Shader loading is most of the difference.
+auto init_attach_context_file(std::shared_ptr<vuh::Context>& context)-> void {
+   const auto start = std::chrono::steady_clock::now();
+   ExampleFilter f{context, shaderFile};
+   report().add("init_attach_context_file", {0, 0, 0.f}, secondsSince(start), 0.0);
+}
+
+/// Instance creation, device selection and logical device creation, nothing else.
+auto device_init()-> void {
+   const auto start = std::chrono::steady_clock::now();
+   auto appInfo = vk::ApplicationInfo("saxpy_b", 0, "no_engine", 0, vuh::instanceApiVersion());
+   auto instance = vk::createInstance({vk::InstanceCreateFlags(), &appInfo});
+   const auto physDev = vuh::selectDevice(instance).physDev;
+   auto device = vuh::createDevice(physDev, {}, vuh::getComputeQueueFamilyId(physDev));
+   report().add("device_init", {0, 0, 0.f}, secondsSince(start), 0.0);
+   device.destroy();
+   instance.destroy();
+}
+
+/// Compute pipeline creation bypassing the pipeline cache, that is the shader compilation by the driver.
+auto pipeline_creation(ExampleFilter& f)-> void {
+   const auto start = std::chrono::steady_clock::now();
+   auto pipe = ExampleFilter::createComputePipeline(f.device, f.shader, f.pipeLayout
+                                                    , vk::PipelineCache(), vuh::DefaultWorkgroupSize);
+   report().add("pipeline_creation", {0, 0, 0.f}, secondsSince(start), 0.0);
+   f.device.destroyPipeline(pipe);
+}
+
+/// Copy input array from host to the newly allocated device array.
+auto upload(DataFixPhases& fix, const Params& p)-> void {
+   const auto start = std::chrono::steady_clock::now();
+   auto d_x = vuh::Array<float>::fromHost(fix.x, fix.f.device, fix.f.physDevice);
+   report().add("upload", p, secondsSince(start), double(fix.x.size()*sizeof(float)));
+}
+
+/// Kernel run alone, reads y and x and writes y.
+auto dispatch(DataFixPhases& fix, const Params& p)-> void {
+   const auto start = std::chrono::steady_clock::now();
+   fix.f.run();
+   report().add("dispatch", p, secondsSince(start), 3.0*fix.y.size()*sizeof(float));
+}
+
+/// Copy the result array from device to host.
+auto download(DataFixPhases& fix, const Params& p)-> void {
+   const auto start = std::chrono::steady_clock::now();
+   fix.dev_data->d_y.to_host(fix.out);
+   report().add("download", p, secondsSince(start), double(fix.out.size()*sizeof(float)));
+}
+
+/// Same computation on the CPU, the baseline for the phases above.
+auto cpu_reference(DataFixPhases& fix, const Params& p)-> void {
+   const auto start = std::chrono::steady_clock::now();
+   fix.cpu(fix.cpuY.data(), fix.x.data(), {p.width, p.height, p.a});
+   report().add("cpu_reference", p, secondsSince(start), 3.0*fix.cpuY.size()*sizeof(float));
+}
+
+/// Kernel run on arrays of T, memory traffic scales with the element size.
+template<class T>
+auto dispatchTyped(DataFixTyped<T>& fix, const Params& p, const char* phase)-> void {
+   if(!fix.f){
+      return;
+   }
+   const auto start = std::chrono::steady_clock::now();
+   fix.f->run();
+   report().add(phase, p, secondsSince(start), 3.0*sizeof(T)*p.width*p.height);
+}
+
+auto dispatch_f16(DataFixTyped<vuh::half>& fix, const Params& p)-> void { dispatchTyped(fix, p, "dispatch_f16"); }
+auto dispatch_f32(DataFixTyped<float>& fix, const Params& p)-> void { dispatchTyped(fix, p, "dispatch_f32"); }
+auto dispatch_f64(DataFixTyped<double>& fix, const Params& p)-> void { dispatchTyped(fix, p, "dispatch_f64"); }
+auto dispatch_i32(DataFixTyped<int32_t>& fix, const Params& p)-> void { dispatchTyped(fix, p, "dispatch_i32"); }
+
+/// Just run the kernel, keeping track of the memory bandwidth achieved.
+auto saxpy(DataFixKernel& fix, const Params& p)-> void {
+   const auto start = std::chrono::steady_clock::now();
+   fix.f.run();
+   report().add(fix.phase, p, secondsSince(start), 3.0*sizeof(float)*p.width*p.height); // y and x read, y written
+}
+
+/// Just run the kernel, timestamps are collected by the filter.
+auto saxpy(DataFixProfiled& fix, const Params& p)-> void {
+   fix.f.run();
+   const auto bytes = 3.0*sizeof(float)*p.width*p.height;
+   for(const auto& t: fix.f.takeTimings()){
+      report().add("profiled_device", p, t.deviceSeconds, bytes);
+      report().add("profiled_host", p, t.hostSeconds, bytes);
+   }
+}
+
+/// Call the filter on the same arrays, recorded commands are reused.
+auto saxpy(DataFixRepeated& fix, const Params& p)-> void {
+   fix.f(fix.dev_data->d_y, fix.dev_data->d_x, {p.width, p.height, p.a});
+}
+
+/// Run batch of jobs with a single submission.
+auto saxpy(DataFixBatch& fix, const Params& p)-> void {
+   fix.f(fix.jobs);
+}
+
+/// Same jobs as the batch, submitted one by one.
+auto saxpy_unbatched(DataFixBatch& fix, const Params& p)-> void {
+   for(auto& job: fix.jobs){
+      fix.f(job.out, job.in, job.p);
+   }
+}
+
+/// Stream a batch of frames through the filter.
+auto saxpy(DataFixStream& fix, const Params& p)-> void {
+   fix.f.stream(fix.frames, {p.width, p.height, p.a});
+}
+
+/// Process the frame on all devices.
+auto saxpy(DataFixMulti& fix, const Params& p)-> void {
+   fix.f(fix.y, fix.x, {p.width, p.height, p.a});
+}
+
+/// Run the filter on host arrays, imported or copied depending on the fixture.
+auto saxpy(DataFixImport& fix, const Params& p)-> void {
+   const auto start = std::chrono::steady_clock::now();
+   const auto frame = ExampleFilter::PushParams{fix.width, fix.height, p.a};
+   if(fix.useImport){ // results land in the host array, nothing to read back
+      auto d_y = vuh::Array<float>::importHost(fix.y_host, fix.n, fix.f.device, fix.f.physDevice);
+      auto d_x = vuh::Array<float>::importHost(fix.x_host, fix.n, fix.f.device, fix.f.physDevice);
+      fix.f(d_y, d_x, frame);
+   } else {
+      auto d_y = vuh::Array<float>::fromHost(fix.y, fix.f.device, fix.f.physDevice);
+      auto d_x = vuh::Array<float>::fromHost(fix.x, fix.f.device, fix.f.physDevice);
+      fix.f(d_y, d_x, frame);
+      d_y.to_host(fix.y);
+   }
+   report().add(fix.phase, p, secondsSince(start), 3.0*sizeof(float)*fix.n);
+}
+
+/// Files mapped and streamed straight to the device arrays and back.
+auto saxpy(DataFixFile& fix, const Params& p)-> void {
+   auto d_y = vuh::Array<float>::fromFile(fix.yPath, fix.f.device, fix.f.physDevice);
+   auto d_x = vuh::Array<float>::fromFile(fix.xPath, fix.f.device, fix.f.physDevice);
+   fix.f(d_y, d_x, {p.width, p.height, p.a});
+   d_y.toFile(fix.outPath);
+}
+
+/// Files read to host vectors copied to the device arrays and back, for comparison with the mapped files.
+auto saxpy_via_vector(DataFixFile& fix, const Params& p)-> void {
+   const auto n = size_t(p.width)*p.height;
+   fix.y.resize(n);
+   fix.x.resize(n);
+   std::ifstream(fix.yPath, std::ios::binary).read(reinterpret_cast<char*>(fix.y.data()), n*sizeof(float));
+   std::ifstream(fix.xPath, std::ios::binary).read(reinterpret_cast<char*>(fix.x.data()), n*sizeof(float));
+   auto d_y = vuh::Array<float>::fromHost(fix.y, fix.f.device, fix.f.physDevice);
+   auto d_x = vuh::Array<float>::fromHost(fix.x, fix.f.device, fix.f.physDevice);
+   fix.f(d_y, d_x, {p.width, p.height, p.a});
+   d_y.to_host(fix.y);
+   std::ofstream(fix.outPath, std::ios::binary).write(reinterpret_cast<const char*>(fix.y.data()), n*sizeof(float));
+}
+
+/// Process the host frame on the fixture backend.
+auto saxpy(DataFixHost& fix, const Params& p)-> void {
+   const auto start = std::chrono::steady_clock::now();
+   (*fix.f)(fix.y, fix.x, {p.width, p.height, p.a});
+   report().add(fix.phase, p, secondsSince(start), 3.0*sizeof(float)*p.width*p.height);
+}
+
+/// Each caller thread runs the shared filter ThreadsCalls times on its own frame.
+auto saxpy_threads(DataFixThreads& fix, const uint32_t& numThreads)-> void {
+   auto threads = std::vector<std::thread>{};
+   for(uint32_t t = 0; t < numThreads; ++t){
+      threads.emplace_back([&fix, t]{
+         for(int i = 0; i < ThreadsCalls; ++i){
+            fix.f(fix.d_ys[t], fix.d_xs[t], {ThreadsFrameSide, ThreadsFrameSide, 2.f});
+         }
+      });
+   }
+   for(auto& t: threads){
+      t.join();
+   }
+}
+
 static const auto params = std::vector<Params>({{32u, 32u, 2.f}, {128, 128, 2.f}, {1024, 1024, 3.f}});
+static const auto threadCounts = std::vector<uint32_t>({1, 2, 4, 8});
 
 } // namespace
 
 
 SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixSaxpyFull, params);
 SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixShaderOnly, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixScalarKernel, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixVectorKernel, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixProfiled, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(dispatch_f16, FixF16, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(dispatch_f32, FixF32, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(dispatch_f64, FixF64, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(dispatch_i32, FixI32, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixRepeatedCall, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixBatch, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy_unbatched, FixBatch, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixStream, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy_threads, FixThreads, threadCounts);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixMulti, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixImport, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixCopy, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixFile, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy_via_vector, FixFile, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixCpu, params);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS(saxpy, FixGpuHost, params);
+
+SLTBENCH_FUNCTION(init_cold_cache);
+SLTBENCH_FUNCTION(init_cold_cache_file);
+SLTBENCH_FUNCTION(init_warm_cache);
+SLTBENCH_FUNCTION(device_init);
+SLTBENCH_FUNCTION_WITH_FIXTURE(init_attach_context, FixContext);
+SLTBENCH_FUNCTION_WITH_FIXTURE(init_attach_context_file, FixContext);
+SLTBENCH_FUNCTION_WITH_FIXTURE(pipeline_creation, FixFilter);
+
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS_GENERATOR(upload, FixPhases, SweepParams);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS_GENERATOR(dispatch, FixPhases, SweepParams);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS_GENERATOR(download, FixPhases, SweepParams);
+SLTBENCH_FUNCTION_WITH_FIXTURE_AND_ARGS_GENERATOR(cpu_reference, FixPhases, SweepParams);
 
 SLTBENCH_MAIN();